@@ -23,6 +23,8 @@
 
 #include "editormain.h"
 
+#include <stdio.h>
+
 extern GuiMain gui;
 extern MinimapMain minimap;
 extern GuiResources resources;
@@ -33,7 +35,9 @@ extern TilesetMain tileset;
 // TODO: Fix the bug that appears when selecting collision after defining an object
 // TODO: ^The object bug seems to appear when selecting any other brush. Add a clearObject() method.
 
-EditorMain::EditorMain() {
+EditorMain::EditorMain()
+    : Map(document.getTiles()), Collision(document.getCollision()), Emitters(document.getEmitters()),
+      journal(document.getJournal()) {
 
     // This stores the brush size
     // Used only to display the correct selector between Canvas and Tileset
@@ -55,14 +59,48 @@ EditorMain::EditorMain() {
     // while writing or reading data to/from disk/memory
     dataAccessState = ACCESS_FREE;
 
+    // Map file threads, one per processor unless editor.ini says otherwise
+    io_threads = 0;
+
+    // No save in the background yet
+    save_result = false;
+    save_state = SAVE_IDLE;
+
+    // Nor a load
+    loadFile = NULL;
+    legacyLoad = NULL;
+    changes_base = NULL;
+
+    // The journal is started along with the first map
+    autosave_interval = 0;
+    last_checkpoint = 0;
+    save_checkpoint = false;
 
     emitter_state = PAUSE_PARTICLES;
 
+    // Nothing's on the canvas yet, the first frame draws all of it
+    belowLayers = NULL;
+    below_state = -1;
+    below_version = 0;
+    clearView(dirty);
+    clearView(redraw);
+    markViewAll(dirty);
+    drawn_state = -1;
+    selector_area.x1 = selector_area.y1 = drawn_selector.x1 = drawn_selector.y1 = 0;
+    selector_area.x2 = selector_area.y2 = drawn_selector.x2 = drawn_selector.y2 = -1;
+
 } // EditorMain::EditorMain()
 
 EditorMain::~EditorMain() {
-    // Just empty like that
+    // Just empty like that, once the save in flight is over. A map still
+    // coming in isn't worth reading
+    waitSave();
+    finishLoad(false);
     freeMap();
+
+    // A clean exit, nothing to recover next time
+    journal.close(true);
+    remove(AUTOSAVE_FILE);
 } // EditorMain::~EditorMain()
 
 // Editor initializer
@@ -80,24 +118,28 @@ void EditorMain::initEditor() {
     mapWidth = get_config_int("mapdata", "width", 1);
     mapHeight = get_config_int("mapdata", "height", 1);
 
-    // First Map initialization
-    // Allocate memory for the first dimension of the matrix
-    Map = new Tile**[layers];
-    for (short i = 0; i < layers; i++) {
-        // Allocate memory for the columns
-        Map[i]= new Tile*[mapHeight];
-    }
+    // How much memory the tiles may take before chunks are paged out to disk,
+    // in MB. 0 keeps the whole map in memory
+    Map.setPaging(get_config_int("mapdata", "chunk_budget", 256), "Data\\Map\\chunks.swp");
 
-    for (short i = 0; i < layers; i++) {
-        for (short j = 0; j < mapHeight; j++) {
-            // And rows
-            Map[i][j]= new Tile[mapWidth];
-        }
-    }
+    // Threads used to encode and decode the map chunks, 0 for one per processor
+    io_threads = get_config_int("mapdata", "io_threads", 0);
+
+    // Seconds between the checkpoints of the edit journal, 0 turns it off
+    autosave_interval = get_config_int("mapdata", "autosave", 120);
+
+    // How much memory the pre-drawn layer chunks may take, in MB
+    layerCache.setBudget(get_config_int("mapdata", "layer_cache", 32));
+
+    // And the translucent tiles, made once and kept
+    transTiles.setBudget(get_config_int("mapdata", "trans_cache", 8));
+
+    // First Map initialization, empty chunked layers holding only the fill
+    document.create(layers, mapWidth, mapHeight);
 
     // Load the map from disk (set the access flag to read-only as well)
     dataAccessState = ACCESS_READ_ONLY;
-    loadMap();
+    if (!recoverMap()) loadMap();
     //saveMap("test_map.dat");
 
     // Create the map buffer
@@ -105,20 +147,22 @@ void EditorMain::initEditor() {
     // Drop some paint
     clear_to_color(map, makecol(255, 0, 255));
 
-    // Load the map datafile
+    // And the one the layers under the current one are flattened in
+    belowLayers = create_bitmap(map->w, map->h);
+
+    // Load the map datafile, and sort its tiles by how they're drawn
     mapData = load_datafile("Data\\Map\\mapData.dat");
+    tileProps.classify(mapData);
     // Set the transparency blender
     set_trans_blender(128, 128, 128, 128);
 
-    transTile = create_bitmap(TILESIZE, TILESIZE);
-    clear_to_color(transTile, makecol(128,128,128));
-
-    // Well, now we can go nuts with it, we got access
-    dataAccessState = ACCESS_FREE;
+    // Well, now we can go nuts with it, we got access. Unless the map is
+    // still coming in, updateLoad() lets go once it's all there
+    if (!isLoading()) dataAccessState = ACCESS_FREE;
 
 } // void EditorMain::initEditor()
 
-// This should reinitialize the weird ***Map when loading a different-sized map
+// This should reinitialize the Map when loading a different-sized map
 // from the disk
 void EditorMain::restartEditor(int lays, int width, int height) {
 
@@ -128,42 +172,33 @@ void EditorMain::restartEditor(int lays, int width, int height) {
     dataAccessState = ACCESS_WRITE_ONLY;
     //cout << "bleah";
     // Delete the Map and unload any other data
-    if (Map) {
-        freeMap();
-
-        // Set the new map variables accordingly
-        /*
-        layers = lays;
-        mapWidth = width;
-        mapHeight = height;
-        */
-
-        // Reset the viewport in case the map is smaller than
-        // the viewport size
-        resetViewport();
+    freeMap();
 
-        // See the initEditor() comments for questions
-        Map = new Tile**[layers];
-        for (short i = 0; i < layers; i++) {
-            Map[i]= new Tile*[mapHeight];
-        }
+    // Set the new map variables accordingly
+    /*
+    layers = lays;
+    mapWidth = width;
+    mapHeight = height;
+    */
 
-        for (short i = 0; i < layers; i++) {
-            for (short j = 0; j < mapHeight; j++) {
-                Map[i][j]= new Tile[mapWidth];
-            }
-        }
+    // Reset the viewport in case the map is smaller than
+    // the viewport size
+    resetViewport();
 
-        // TODO: EditorMain::restartEditor() Handle dynamic resolution
-        // Recreate the bitmaps and datafiles
-        /*
-        map = create_bitmap(768, TILESIZE*19);
-        clear_to_color(map, makecol(255, 0, 255));
+    // See the initEditor() comments for questions
+    document.create(layers, mapWidth, mapHeight);
+    layerCache.invalidateAll();
+    markViewAll(dirty);
 
-        mapData = load_datafile("Data\\Map\\mapData.dat");
-        set_trans_blender(128, 128, 128, 128);
-        */
-    }
+    // TODO: EditorMain::restartEditor() Handle dynamic resolution
+    // Recreate the bitmaps and datafiles
+    /*
+    map = create_bitmap(768, TILESIZE*19);
+    clear_to_color(map, makecol(255, 0, 255));
+
+    mapData = load_datafile("Data\\Map\\mapData.dat");
+    set_trans_blender(128, 128, 128, 128);
+    */
 
 
     // Yeah, yeah, do whatever you want now
@@ -178,49 +213,18 @@ void EditorMain::restartEditor(int lays, int width, int height) {
 // TODO: EditorMain Remove deprecated functions
 short EditorMain::newMap() {
 
-
     // Set the access flag
     dataAccessState = ACCESS_WRITE_ONLY;
 
-    PACKFILE *pfile;
-    pfile = pack_fopen("Data\\Map\\test_map.dat", "wp");
+    // Fill the first layer with the first tile of the first tileset and the
+    // other layers with the first tile on the second row
+    short returnValue = writeNewMap("Data\\Map\\test_map.dat", layers, mapWidth, mapHeight, 0, 1);
 
-    int i, j, l;
-
-    // Write map sizes
-    pack_iputl(layers, pfile);
-    pack_iputl(mapWidth, pfile);
-    pack_iputl(mapHeight, pfile);
-
-    // Fill the first layer with the first tile of the first tileset
-    for (i = 0; i < mapWidth; i++) {
-        for (j = 0; j < mapHeight; j++) {
-            pack_iputl(0, pfile);
-            pack_iputl(0, pfile);
-            pack_iputl(-1, pfile);
-        }
-    }
-
-    // Fill the other layers with the first tile on the second row from
-    // the first tileset
-    for (l = 1; l < layers; l++) {
-        for (i = 0; i < mapWidth; i++) {
-            for (j = 0; j < mapHeight; j++) {
-                pack_iputl(1, pfile);
-                pack_iputl(0, pfile);
-                pack_iputl(0, pfile);
-
-                pack_iputl(-1, pfile);
-            }
-        }
-    }
-
-    // Close the map file, set the current_map name and release access
-    pack_fclose(pfile);
-    current_map = "test_map.dat";
+    // Set the current_map name and release access
+    if (returnValue == 0) current_map = "test_map.dat";
     dataAccessState = ACCESS_FREE;
 
-    return 0;
+    return returnValue;
 
 } // short EditorMain::newMap()
 
@@ -233,7 +237,6 @@ short EditorMain::newMap(string name) {
 
     dataAccessState = ACCESS_WRITE_ONLY;
 
-    PACKFILE *pfile;
     string path = "Data\\Map\\";
     // I should check what extension the current
     // filename has and only add/replace it with
@@ -242,40 +245,11 @@ short EditorMain::newMap(string name) {
     // TODO: EditorMain Proper filename handling
     string final = path+name;
 
-    pfile = pack_fopen(final.c_str(), "wp");
-
-    if (pfile == NULL) {
+    if (writeNewMap(final, layers, mapWidth, mapHeight, 0, 1) == -1) {
+        dataAccessState = ACCESS_FREE;
         return -1;
     }
 
-    pack_iputl(layers, pfile);
-    pack_iputl(mapWidth, pfile);
-    pack_iputl(mapHeight, pfile);
-
-    int i, j, l;
-
-    for (i = 0; i < mapWidth; i++) {
-        for (j = 0; j < mapHeight; j++) {
-            pack_iputl(0, pfile);
-            pack_iputl(0, pfile);
-            pack_iputl(0, pfile);
-
-            pack_iputl(-1, pfile);
-        }
-    }
-
-    for (l = 1; l < layers; l++) {
-        for (i = 0; i < mapWidth; i++) {
-            for (j = 0; j < mapHeight; j++) {
-                pack_iputl(1, pfile);
-                pack_iputl(0, pfile);
-                pack_iputl(0, pfile);
-
-                pack_iputl(-1, pfile);
-            }
-        }
-    }
-    pack_fclose(pfile);
     current_map = name;
     dataAccessState = ACCESS_FREE;
 
@@ -307,38 +281,19 @@ short EditorMain::newMap(string name, string lay, string width, string height) {
     if (h == 0) return returnValue;
 
     // Simply follow the same algorithms as in the methods above
-    PACKFILE *pfile;
     string path = "Data\\Map\\";
     // string ext =".dat";
     string final = path+name;
 
-    pfile = pack_fopen(final.c_str(), "wp");
-
-    if (pfile == NULL) {
-        return -1;
+    if (writeNewMap(final, lays, w, h, 0, 0) == -1) {
+        dataAccessState = ACCESS_FREE;
+        return returnValue;
     }
 
     layers = lays;
     mapWidth = w;
     mapHeight = h;
 
-    // Should write map size to the packfile, duh
-    pack_iputl(layers, pfile);
-    pack_iputl(mapWidth, pfile);
-    pack_iputl(mapHeight, pfile);
-
-    for (short l = 0; l < layers; l++) {
-        for (short i = 0; i < mapWidth; i++) {
-            for (short j = 0; j < mapHeight; j++) {
-                pack_iputl(0, pfile);
-                pack_iputl(0, pfile);
-                pack_iputl(0, pfile);
-
-                pack_iputl(-1, pfile);
-            }
-        }
-    }
-    pack_fclose(pfile);
     current_map = name;
     dataAccessState = ACCESS_FREE;
     return 0;
@@ -348,118 +303,181 @@ short EditorMain::newMap(string name, string lay, string width, string height) {
 // DEPRECATED: loads the default map
 short EditorMain::loadMap() {
 
-    dataAccessState = ACCESS_WRITE_ONLY;
-
-    PACKFILE *pfile;
-    pfile = pack_fopen("Data\\Map\\test_map.dat", "rp");
+    if (loadMap("test_map.dat") == 0) return 0;
 
     // If we couldn't open the file, try and create it
-    // Should be verified better, what if the second attempt
-    // to open the file fails as well?
-    if (pfile == NULL) {
-        newMap();
-        //pfile = pack_fopen("Data\\Map\\test_map.dat", "rp");
-        loadMap();
-    }
-    //cout << "done";
-    short load_layers = pack_igetl(pfile);
-    short load_mapWidth = pack_igetl(pfile);
-    short load_mapHeight = pack_igetl(pfile);
-    /*
-    if (load_layers != layers || load_mapHeight != mapHeight || load_mapWidth != mapWidth) {
-        layers = load_layers;
-        mapWidth = load_mapWidth;
-        mapHeight = load_mapHeight;
+    if (newMap() == -1) return -1;
+    return loadMap("test_map.dat");
 
-        restartEditor(layers, mapWidth, mapHeight);
-        resetViewport();
-    }
-    */
-    layers = load_layers;
-    mapWidth = load_mapWidth;
-    mapHeight = load_mapHeight;
+} // short EditorMain::loadMap()
 
-    restartEditor(layers, mapWidth, mapHeight);
-    resetViewport();
 
-    //cout << "here";
-    int i, j, l;
-    for (l = 0; l < layers; l++) {
-        for (i = 0; i < mapWidth; i++) {
-            for (j = 0; j < mapHeight; j++) {
-                //cout << j <<endl;
-                Map[l][j][i].index = pack_igetl(pfile);
-                Map[l][j][i].tileset = pack_igetl(pfile);
-                Map[l][j][i].collision = pack_igetl(pfile);
+// Loads any map found as "name". Only what it takes to draw the map is read
+// here, the rest comes in through updateLoad()
+short EditorMain::loadMap(string name) {
 
-                Map[l][j][i].emitter = pack_igetl(pfile);
-            }
-        }
-    }
-    pack_fclose(pfile);
-    current_map = "test_map.dat";
-    dataAccessState = ACCESS_FREE;
-    return 0;
+    string path = "Data\\Map\\";
+    string final = path+name;
 
-} // short EditorMain::loadMap()
+    if (openMap(final) == -1) return -1;
+    current_map = name;
 
+    // The edits from here on are journaled on top of the file just opened
+    startJournal(final);
+    return 0;
 
-// Loads any map found as "name"
-short EditorMain::loadMap(string name) {
+} // short EditorMain::loadMap(string name)
 
-    dataAccessState = ACCESS_READ_ONLY;
+short EditorMain::openMap(string final) {
 
-    PACKFILE *pfile;
-    string path = "Data\\Map\\";
-    string final = path+name;
+    // The map is about to be replaced, let the save in flight finish
+    waitSave();
 
-    pfile = pack_fopen(final.c_str(), "rp");
+    // Open the new map before dropping one that's still coming in
+    MapFile *mapFile = new MapFile;
+    LegacyMapFile *legacyFile = NULL;
+    mapFile->setThreads(io_threads);
 
-    if (pfile == NULL) {
-        return -1;
+    if (!mapFile->open(final)) {
+        delete mapFile;
+        mapFile = NULL;
+
+        legacyFile = new LegacyMapFile;
+        if (!legacyFile->open(final)) {
+            delete legacyFile;
+            return -1;
+        }
     }
 
-    short load_layers = pack_igetl(pfile);
-    short load_mapWidth = pack_igetl(pfile);
-    short load_mapHeight = pack_igetl(pfile);
-    /*
-    if (load_layers != layers || load_mapHeight != mapHeight || load_mapWidth != mapWidth) {
-        layers = load_layers;
-        mapWidth = load_mapWidth;
-        mapHeight = load_mapHeight;
+    finishLoad(false);
+    load_warning.clear();
+
+    // v2 maps are opened in place, the raw tiles are only read as they're
+    // drawn and copied once they're edited. The compressed ones are decoded
+    // on a thread, the ones on screen first. Old maps are read front to back,
+    // a few strips a frame
+    if (mapFile != NULL) {
+        layers = mapFile->getLayers();
+        mapWidth = mapFile->getWidth();
+        mapHeight = mapFile->getHeight();
 
         restartEditor(layers, mapWidth, mapHeight);
         resetViewport();
+
+        mapFile->beginLoad(Map, Collision, Emitters);
+        loadFile = mapFile;
+    } else {
+        layers = legacyFile->getLayers();
+        mapWidth = legacyFile->getWidth();
+        mapHeight = legacyFile->getHeight();
+
+        restartEditor(layers, mapWidth, mapHeight);
+        resetViewport();
+
+        legacyLoad = legacyFile;
     }
-    */
-    layers = load_layers;
-    mapWidth = load_mapWidth;
-    mapHeight = load_mapHeight;
 
-    restartEditor(layers, mapWidth, mapHeight);
-    resetViewport();
+    // Look but don't touch until it's all in
+    dataAccessState = ACCESS_READ_ONLY;
 
-    int i, j, l;
-    for (l = 0; l < layers; l++) {
-        for (i = 0; i < mapWidth; i++) {
-            for (j = 0; j < mapHeight; j++) {
-                cout << j <<endl;
-                Map[l][j][i].index = pack_igetl(pfile);
-                Map[l][j][i].tileset = pack_igetl(pfile);
-                Map[l][j][i].collision = pack_igetl(pfile);
+    // With no thread to spare for the decoding, read it all right away
+    if (loadFile != NULL) {
+        loadFile->setLoadFocus(viewport.scroll_x + viewport.tile_w/2, viewport.scroll_y + viewport.tile_h/2);
+        if (!loadThread.start(loadThreadMain, this)) waitLoad();
+    }
+    updateLoad();
+
+    return 0;
+
+} // short EditorMain::openMap(string final)
+
+void EditorMain::loadThreadMain(void *context, int index) {
+    EditorMain *self = (EditorMain*)context;
+    self->loadFile->decodeLoad();
+} // void EditorMain::loadThreadMain(void *context, int index)
 
-                Map[l][j][i].emitter = pack_igetl(pfile);
+void EditorMain::finishLoad(bool complete) {
+    if (!isLoading()) return;
+
+    if (loadFile != NULL) {
+        loadFile->stopLoad();
+        loadThread.wait();
+
+        // Damaged chunks read as the fill, say so before they're saved
+        if (complete) {
+            loadFile->finishLoad(Map);
+            if (loadFile->getLoadDamaged() > 0) {
+                char text[128];
+                snprintf(text, sizeof(text), "%d damaged chunks, read as the fill", loadFile->getLoadDamaged());
+                load_warning = text;
             }
         }
+        loadFile->endLoad(Map);
+        delete loadFile;
+        loadFile = NULL;
     }
 
-    pack_fclose(pfile);
-    current_map = name;
+    // Same for the tiles that didn't fit, which are read as blanks
+    if (legacyLoad != NULL) {
+        if (complete && !legacyLoad->load(Map, Collision, Emitters)) {
+            char text[128];
+            if (legacyLoad->getBadTiles() > 0) {
+                snprintf(text, sizeof(text), "%d tiles out of range, read as blanks", legacyLoad->getBadTiles());
+            } else {
+                snprintf(text, sizeof(text), "the file ends early");
+            }
+            load_warning = text;
+        }
+        delete legacyLoad;
+        legacyLoad = NULL;
+    }
+
+    layerCache.invalidateAll();
     dataAccessState = ACCESS_FREE;
+} // void EditorMain::finishLoad(bool complete)
+
+void EditorMain::updateLoad() {
+    // Only the layer chunks drawn over what came in are drawn again
+    if (loadFile != NULL) {
+        // Whatever is on screen goes first
+        loadFile->setLoadFocus(viewport.scroll_x + viewport.tile_w/2, viewport.scroll_y + viewport.tile_h/2);
+        loadFile->installLoad(Map, LOAD_FRAME_CHUNKS);
+
+        const vector< pair<int, const MapFileChunk*> > &installed = loadFile->getInstalled();
+        for (unsigned int n = 0; n < installed.size(); n++) {
+            int x = installed[n].second->cx * CHUNK_SIZE, y = installed[n].second->cy * CHUNK_SIZE;
+            layerCache.invalidate(installed[n].first, x, y, x+CHUNK_SIZE-1, y+CHUNK_SIZE-1);
+        }
+        if (loadThread.isDone()) finishLoad(true);
+    } else if (legacyLoad != NULL) {
+        int first = legacyLoad->getStripsRead();
+        legacyLoad->loadStrips(Map, Collision, Emitters, MAX(1, LOAD_FRAME_TILES / (CHUNK_SIZE * mapHeight)));
+
+        // A strip is CHUNK_SIZE columns of a layer. The first one of a layer
+        // sets its fill as well, which shows everywhere nothing came in yet
+        int strips_x = (mapWidth + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        for (int n = first; n < legacyLoad->getStripsRead(); n++) {
+            int x = (n % strips_x) * CHUNK_SIZE;
+            if (x == 0) layerCache.invalidateLayer(n / strips_x);
+            else layerCache.invalidate(n / strips_x, x, 0, x+CHUNK_SIZE-1, mapHeight-1);
+        }
+        if (legacyLoad->isDone()) finishLoad(true);
+    }
+} // void EditorMain::updateLoad()
 
-    return 0;
+void EditorMain::waitLoad() {
+    if (isLoading()) finishLoad(true);
+} // void EditorMain::waitLoad()
 
-} // short EditorMain::loadMap(string name)
+int EditorMain::getLoadProgress() {
+    if (loadFile != NULL && loadFile->getLoadTotal() > 0) {
+        return (int)((int64_t)100 * loadFile->getLoadDone() / loadFile->getLoadTotal());
+    }
+    if (legacyLoad != NULL && legacyLoad->getStripCount() > 0) {
+        return (int)((int64_t)100 * legacyLoad->getStripsRead() / legacyLoad->getStripCount());
+    }
+    return 100;
+} // int EditorMain::getLoadProgress()
 
 // TODO: Why the hell do I have a loadMap(name, layers, mapWidth, mapHeight) method?!
 short EditorMain::loadMap(string name, string lay, string w, string h) {
@@ -472,37 +490,9 @@ short EditorMain::loadMap(string name, string lay, string w, string h) {
     if (width == 0) return -1;
     if (height == 0) return -1;
 
-    PACKFILE *pfile;
-    string path = "Data\\Map\\";
-    string final = path+name;
-
-    pfile = pack_fopen(final.c_str(), "rp");
-
-    if (pfile == NULL) {
-        return -1;
-    }
-
-    restartEditor(lays, width, height);
-    dataAccessState = ACCESS_WRITE_ONLY;
-
-    for (short l = 0; l < layers; l++) {
-        for (short i = 0; i < mapWidth; i++) {
-            for (short j = 0; j < mapHeight; j++) {
-                Map[l][j][i].index = pack_igetl(pfile);
-                Map[l][j][i].tileset = pack_igetl(pfile);
-                Map[l][j][i].collision = pack_igetl(pfile);
-
-                Map[l][j][i].emitter = pack_igetl(pfile);
-            }
-        }
-    }
-    pack_fclose(pfile);
-    current_map = name;
-
-    //cout << "loaded like a motha fucka'";
-    dataAccessState = ACCESS_FREE;
-
-    return 0;
+    // Both file formats carry their own sizes, which always win; the map
+    // goes through the same bulk loaders as loadMap(name)
+    return loadMap(name);
 
 } // short EditorMain::loadMap(string name, string lay, string w, string h)
 
@@ -548,60 +538,174 @@ short EditorMain::saveMap() {
 //       The current_map will now become cba.dat, altough I'm not working on it.
 short EditorMain::saveMap(string name) {
 
-    PACKFILE *pfile;
+    waitSave();
+    waitLoad();
+    closeChanges();
+
     string path = "Data\\Map\\";
     string final = path+name;
-    pfile = pack_fopen(final.c_str(), "wp");
 
-    if (pfile == NULL) {
+    if (!document.save(final, io_threads)) {
         return -1;
     }
+    return 0;
 
-    pack_iputl(layers, pfile);
-    pack_iputl(mapWidth, pfile);
-    pack_iputl(mapHeight, pfile);
+} //short EditorMain::saveMap(string name)
 
-    int i, j, l;
+// Save the current map in the background. Only a snapshot is taken here, the
+// editor keeps drawing and editing while the file is written; updateSave()
+// picks up the result
+short EditorMain::saveMapAsync(string name) {
 
-    for (l = 0; l < layers; l++) {
-        for (i = 0; i < mapWidth; i++) {
-            for (j = 0; j < mapHeight; j++) {
-                pack_iputl(Map[l][j][i].index, pfile);
-                pack_iputl(Map[l][j][i].tileset, pfile);
-                pack_iputl(Map[l][j][i].collision, pfile);
+    // One save at a time, of a map that's all there
+    waitSave();
+    waitLoad();
+    closeChanges();
 
-                pack_iputl(Map[l][j][i].emitter, pfile);
-            }
-        }
+    string path = "Data\\Map\\";
+    string final = path+name;
+
+    saveFile.setThreads(io_threads);
+    journal.mark(final);
+    saveFile.beginSave(final, Map, Collision, Emitters);
+    save_name = name;
+    save_state = SAVE_RUNNING;
+
+    // No thread to spare, write it right away
+    if (!saveThread.start(saveThreadMain, this)) {
+        saveThreadMain(this, 0);
+        finishSave();
+        return (save_state == SAVE_DONE) ? 0 : -1;
     }
-    pack_fclose(pfile);
-    current_map = current_map;
     return 0;
 
-} //short EditorMain::saveMap(string name)
+} // short EditorMain::saveMapAsync(string name)
 
-// Sets the viewport using the passed parameters
-void EditorMain::setViewport(int px, int py, int w, int h) {
+void EditorMain::saveThreadMain(void *context, int index) {
+    EditorMain *self = (EditorMain*)context;
+    self->save_result = self->saveFile.writeSave();
+} // void EditorMain::saveThreadMain(void *context, int index)
+
+void EditorMain::finishSave() {
+    saveThread.wait();
+    saveFile.endSave(save_result);
+
+    // The journal starts over on top of the file just written
+    if (save_result) journal.rebase();
+
+    // A checkpoint isn't the user's business
+    if (save_checkpoint) {
+        save_checkpoint = false;
+        last_checkpoint = time(NULL);
+    } else {
+        save_state = save_result ? SAVE_DONE : SAVE_FAILED;
+    }
+} // void EditorMain::finishSave()
+
+void EditorMain::updateSave() {
+    if (isSaving() && saveThread.isDone()) finishSave();
+} // void EditorMain::updateSave()
+
+void EditorMain::waitSave() {
+    if (isSaving()) finishSave();
+} // void EditorMain::waitSave()
+
+void EditorMain::startJournal(const string &base) {
+    if (autosave_interval > 0) journal.start(EDIT_JOURNAL_FILE, base, current_map, layers, mapWidth, mapHeight);
+    last_checkpoint = time(NULL);
+} // void EditorMain::startJournal(const string &base)
+
+// Save a copy of the map in the background, the same way saveMapAsync()
+// does, so the journal can start over on top of it. The map keeps its
+// name and unsaved state
+void EditorMain::checkpoint() {
+    if (changes_path == AUTOSAVE_FILE) closeChanges();
+    saveFile.setThreads(io_threads);
+    journal.mark(AUTOSAVE_FILE);
+    saveFile.beginSave(AUTOSAVE_FILE, Map, Collision, Emitters, true);
+    save_checkpoint = true;
+
+    if (!saveThread.start(saveThreadMain, this)) {
+        saveThreadMain(this, 0);
+        finishSave();
+    }
+} // void EditorMain::checkpoint()
+
+// Pick up where a session that didn't exit cleanly left off: the map the
+// journal was written on top of, with its edits replayed
+bool EditorMain::recoverMap() {
+    if (autosave_interval <= 0 || !journal.recover(EDIT_JOURNAL_FILE)) return false;
+
+    if (openMap(journal.getBase()) == -1) {
+        journal.close(false);
+        return false;
+    }
+
+    // The edits go on top of the whole map
+    waitLoad();
+    journal.replay(Map, Collision, Emitters);
+    current_map = journal.getName();
+
+    // Keep journaling on top of the same base, then have the recovered edits
+    // in a checkpoint right away
+    if (!journal.resume()) startJournal(journal.getBase());
+    if (journal.isOpen()) checkpoint();
+    return true;
+} // bool EditorMain::recoverMap()
+
+// Write the map in the old .dat layout, for the tools that still read it
+short EditorMain::exportMap(string name) {
+
+    waitSave();
+    waitLoad();
+    closeChanges();
+
+    string path = "Data\\Map\\";
+    string final = path+name;
+
+    if (!document.exportMap(final)) {
+        return -1;
+    }
+    return 0;
+
+} // short EditorMain::exportMap(string name)
 
-    viewport.tile_x = 0;
-    viewport.tile_y = 0;
-    viewport.tile_w = viewport.init_w = w;
-    viewport.tile_h = viewport.init_h = h;
+// Write an empty map in the v2 format. Only the layer fills are stored, so
+// it's just as quick whatever the size of the map
+short EditorMain::writeNewMap(string path, int lays, int width, int height, int first_index, int other_index) {
 
-    viewport.pos_x = px;
-    viewport.pos_y = py;
+    // It may be the very file the save in flight writes or the map loading
+    // reads from
+    waitSave();
+    waitLoad();
+    closeChanges();
 
-    viewport.scroll_x = viewport.scroll_y = 0;
+    TileMap blank;
+    CollisionMask noCollision;
+    EmitterIndex noEmitters;
+
+    if (!blank.create(lays, width, height)) return -1;
+    noCollision.create(width, height);
+
+    for (int l = 0; l < lays; l++) {
+        blank.setFill(l, makeTile(l == 0 ? first_index : other_index, 0, 0));
+    }
+
+    MapFile mapFile;
+    if (!mapFile.save(path, blank, noCollision, noEmitters)) return -1;
+    return 0;
+
+} // short EditorMain::writeNewMap(string path, int lays, int width, int height, int first_index, int other_index)
+
+// Sets the viewport using the passed parameters
+void EditorMain::setViewport(int px, int py, int w, int h) {
+    initCamera(viewport, px, py, w, h);
 } // void EditorMain::setViewport(int px, int py, int w, int h)
 
 // Check wheter the viewport is too large for the current display options
 // and chenge it accordingly.
-// TODO: EditorMain::resetViewport() Add SCREEN_H and SCREEN_W for comparison
 void EditorMain::resetViewport() {
-    if (viewport.tile_w > mapWidth) viewport.tile_w = mapWidth-1;
-    else if (viewport.tile_w != viewport.init_w) viewport.tile_w = viewport.init_w;
-    if (viewport.tile_h > mapHeight) viewport.tile_h = mapHeight-1;
-    else if (viewport.tile_h != viewport.init_h) viewport.tile_h = viewport.init_h;
+    fitCamera(viewport, mapWidth, mapHeight);
 } // void EditorMain::resetViewport()
 
 
@@ -611,6 +715,7 @@ void EditorMain::drawGrid() {
     int grid_x, grid_y, grid_x1, grid_y1;
     for (int i = viewport.tile_x; i < viewport.tile_w; i++) {
         for (int j = viewport.tile_y; j < viewport.tile_h+2; j++) {
+            if (!isViewDirty(redraw, i, j)) continue;
 
             grid_x = i*TILESIZE + viewport.pos_x;
             grid_x1 = grid_x+TILESIZE-1;
@@ -623,49 +728,120 @@ void EditorMain::drawGrid() {
 } // void EditorMain::drawGrid()
 
 // Draw the collision mask
-// Works very much like the drawGrid() method just that it also checks wheter a tile has
-// a collision flag or not.
+// Works very much like the drawGrid() method just that it only outlines the
+// blocked tiles. Each viewport row is read from the collision mask 64 cells
+// at a time and only the set bits of the cells being redrawn are visited.
 void EditorMain::drawCollision() {
 
     int grid_x, grid_y, grid_x1, grid_y1;
-    int collision;
 
-    for (int i = viewport.tile_x; i < viewport.tile_w; i++) {
-        for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
-            collision = Map[gui.getCurrentLayer()][j+viewport.scroll_y][i+viewport.scroll_x].collision;
+    for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
+        if (!isViewRowDirty(redraw, j)) continue;
 
+        grid_y = j*TILESIZE + viewport.pos_y;
+        grid_y1 = grid_y+TILESIZE-1;
 
-            grid_x = i*TILESIZE + viewport.pos_x;
-            grid_x1 = grid_x+TILESIZE-1;
-            grid_y = j*TILESIZE + viewport.pos_y;
-            grid_y1 = grid_y+TILESIZE-1;
+        for (int i = viewport.tile_x; i < viewport.tile_w; i += 64) {
+            uint64_t bits = Collision.getBits(i+viewport.scroll_x, j+viewport.scroll_y, viewport.tile_w - i);
+            if (!redraw.all) bits &= redraw.rows[j] >> i;
 
-            if (collision > 0)
+            while (bits) {
+                int k = lowestBit(bits);
+                bits &= bits - 1;
+
+                grid_x = (i+k)*TILESIZE + viewport.pos_x;
+                grid_x1 = grid_x+TILESIZE-1;
                 rect(map, grid_x, grid_y, grid_x1, grid_y1, makecol(255, 0, 0));
+            }
         }
     }
 } // void EditorMain::drawCollision()
 
+// Outline what changed on the current layer and in the collision. Only the
+// chunks on screen are compared, so it's as quick on any map size and never
+// out of date
+void EditorMain::drawChanges() {
+
+    // Half a map isn't worth comparing, and the file may be the one a save
+    // in flight writes. Nor is anything, if no cell is drawn again
+    if (isLoading() || isSaving() || !redraw.any) return;
+
+    // The map only ever comes from or goes to v2 files, whose directory says
+    // where every chunk is; nothing else is read until it's compared
+    if (changes_path != Map.getSource()) {
+        closeChanges();
+        changes_path = Map.getSource();
+        if (!changes_path.empty()) {
+            changes_base = new MapFile;
+            if (changes_base->open(changes_path)) {
+                changes_collision.create(changes_base->getWidth(), changes_base->getHeight());
+                changes_base->loadCollision(changes_collision);
+            } else {
+                delete changes_base;
+                changes_base = NULL;
+            }
+        }
+    }
+    if (changes_base == NULL) return;
+
+    int x1 = viewport.tile_x+viewport.scroll_x, y1 = viewport.tile_y+viewport.scroll_y;
+    if (!changes.compare(*changes_base, changes_collision, document, gui.getCurrentLayer(),
+                         x1, y1, viewport.tile_w+viewport.scroll_x-1, viewport.tile_h+viewport.scroll_y-1)) return;
+
+    const vector<MapPatchRun> &runs = changes.getRuns();
+    for (unsigned int r = 0; r < runs.size(); r++) {
+        int grid_y = runs[r].y-viewport.scroll_y;
+        if (grid_y < viewport.tile_y || grid_y >= viewport.tile_h) continue;
+        grid_y = grid_y*TILESIZE + viewport.pos_y;
+
+        // Inside the collision marks, which may be drawn too
+        int color = (runs[r].lay == MAPPATCH_COLLISION) ? makecol(255, 0, 255) : makecol(255, 128, 0);
+
+        for (int i = 0; i < runs[r].count; i++) {
+            int grid_x = runs[r].x+i-viewport.scroll_x;
+            if (grid_x < viewport.tile_x || grid_x >= viewport.tile_w) continue;
+            if (!isViewDirty(redraw, grid_x, runs[r].y-viewport.scroll_y)) continue;
+            grid_x = grid_x*TILESIZE + viewport.pos_x;
+
+            rect(map, grid_x+2, grid_y+2, grid_x+TILESIZE-3, grid_y+TILESIZE-3, color);
+        }
+    }
+} // void EditorMain::drawChanges()
+
+void EditorMain::closeChanges() {
+    delete changes_base;
+    changes_base = NULL;
+    changes_collision.destroy();
+    changes_path.clear();
+
+    // Whatever is outlined was compared to the file just dropped
+    markViewAll(dirty);
+} // void EditorMain::closeChanges()
+
+// Outline the emitters of the current layer, only the emitters of the chunks
+// on screen are looked at
 void EditorMain::drawEmitterGrid() {
 
     int grid_x, grid_y, grid_x1, grid_y1;
-    int collision;
 
-    for (int i = viewport.tile_x; i < viewport.tile_w; i++) {
-        for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
-            collision = Map[gui.getCurrentLayer()][j+viewport.scroll_y][i+viewport.scroll_x].emitter;
+    if (!redraw.any) return;
 
+    visibleEmitters.clear();
+    Emitters.query(gui.getCurrentLayer(),
+                   viewport.tile_x+viewport.scroll_x, viewport.tile_y+viewport.scroll_y,
+                   viewport.tile_w+viewport.scroll_x-1, viewport.tile_h+viewport.scroll_y-1, visibleEmitters);
 
-            grid_x = i*TILESIZE + viewport.pos_x;
-            grid_x1 = grid_x+TILESIZE-1;
-            grid_y = j*TILESIZE + viewport.pos_y;
-            grid_y1 = grid_y+TILESIZE-1;
+    for (unsigned int e = 0; e < visibleEmitters.size(); e++) {
+        if (!isViewDirty(redraw, visibleEmitters[e].x-viewport.scroll_x, visibleEmitters[e].y-viewport.scroll_y)) continue;
 
-            if (collision > 0)
-                rect(map, grid_x, grid_y, grid_x1, grid_y1, makecol(0, 0, 255));
-        }
+        grid_x = (visibleEmitters[e].x-viewport.scroll_x)*TILESIZE + viewport.pos_x;
+        grid_x1 = grid_x+TILESIZE-1;
+        grid_y = (visibleEmitters[e].y-viewport.scroll_y)*TILESIZE + viewport.pos_y;
+        grid_y1 = grid_y+TILESIZE-1;
+
+        rect(map, grid_x, grid_y, grid_x1, grid_y1, makecol(0, 0, 255));
     }
-} // void EditorMain::drawCollision()
+} // void EditorMain::drawEmitterGrid()
 
 // Draws a selector according to the action the user is currently doing
 void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short type) {
@@ -723,8 +899,8 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                 // If the brush isn't enlarged, draw a 2px bordered rectangle holding the selected tile at the mouse position
                 if (mouse_z < 2) {
 
-                    if (type == BRUSH_DRAW || type == BRUSH_FLOOD) {
-                        masked_blit((BITMAP*)mapData[TILES1+mouse_tileset].dat, map, TILESIZE*(current_tile/TILESIZE), TILESIZE*(current_tile%TILESIZE),
+                    if ((type == BRUSH_DRAW || type == BRUSH_FLOOD) && gui.getMouseFrame() == MAIN_FRAME) {
+                        masked_blit((BITMAP*)mapData[TILES1+mouse_tileset].dat, bmp, TILESIZE*(current_tile/TILESIZE), TILESIZE*(current_tile%TILESIZE),
                                     TILESIZE*(mouse_x/TILESIZE)+viewport.pos_x,TILESIZE*(mouse_y/TILESIZE)+viewport.pos_y-32,TILESIZE,TILESIZE);
                     }
                     rect(bmp, x1, y1, x2, y2, tmp_col);
@@ -742,7 +918,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                     rectfill(bmp, x2 + 5, y1 - text_height(font)*2-5, x2 + 10 + text_length(font, "X: 999"), y1 + 5, makecol(255, 255, 128));
                     rect(bmp, x2 + 5, y1 - text_height(font)*2-5, x2 + 10 + text_length(font, "X: 999"), y1 + 5, makecol(255, 200, 128));
 
-                    short tooltip_x, tooltip_y;
+                    int tooltip_x, tooltip_y;
 
                     if (gui.getMouseFrame() == MAIN_FRAME) {
                         tooltip_x = gui.gui_x/32+viewport.scroll_x;
@@ -762,10 +938,10 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                     if (mouse_z % 2 != 0) size_alter = mouse_z-1;
                     else size_alter = mouse_z;
 
-                    if (type == BRUSH_DRAW) {
+                    if (type == BRUSH_DRAW && gui.getMouseFrame() == MAIN_FRAME) {
                         for (short tmpx = 0; tmpx < size_alter+1; tmpx++) {
                             for (short tmpy = 0; tmpy < size_alter+1; tmpy++) {
-                                masked_blit((BITMAP*)mapData[TILES1+mouse_tileset].dat, map, TILESIZE*(current_tile/TILESIZE), TILESIZE*(current_tile%TILESIZE),
+                                masked_blit((BITMAP*)mapData[TILES1+mouse_tileset].dat, bmp, TILESIZE*(current_tile/TILESIZE), TILESIZE*(current_tile%TILESIZE),
                                             x1+1+viewport.pos_x - (size_alter*32)/2 + tmpx*32, y1-(size_alter*32)/2 + tmpy*32,TILESIZE,TILESIZE);
                             }
                         }
@@ -782,7 +958,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                     x2 = mouse_x + 20;
                     y1 = mouse_y;
 
-                    short tooltip_x, tooltip_y, tooltip_x2, tooltip_y2;
+                    int tooltip_x, tooltip_y, tooltip_x2, tooltip_y2;
                     tooltip_x = tooltip_y = tooltip_x2 = tooltip_y2 = 0;
 
                     if (gui.getMouseFrame() == MAIN_FRAME) {
@@ -806,7 +982,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                 if (mouse_z < 2) {
                     for (int i = 0; i < 2; i++) {
                         for (int j = 0; j < 2; j++) {
-                            draw_trans_sprite(map, (BITMAP*)resources.data[TRANS_BK].dat, i + x1-1, j + y1-1);
+                            draw_trans_sprite(bmp, (BITMAP*)resources.data[TRANS_BK].dat, i + x1-1, j + y1-1);
                         }
                     }
                     rect(bmp, x1, y1, x2, y2, tmp_col);
@@ -818,7 +994,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                     rectfill(bmp, x2 + 5, y1 - text_height(font)*2-5, x2 + 10 + text_length(font, "X: 999"), y1 + 5, makecol(255, 255, 128));
                     rect(bmp, x2 + 5, y1 - text_height(font)*2-5, x2 + 10 + text_length(font, "X: 999"), y1 + 5, makecol(255, 200, 128));
 
-                    short tooltip_x, tooltip_y;
+                    int tooltip_x, tooltip_y;
 
                     if (gui.getMouseFrame() == MAIN_FRAME) {
                         tooltip_x = gui.gui_x/32+viewport.scroll_x;
@@ -838,7 +1014,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                     for (int i = 0; i <= size_alter; i++) {
                         for (int j = 0; j <= size_alter; j++) {
                             //draw_trans_sprite(map, (BITMAP*)resources.data[TRANS_BK].dat, i*32 + x1-1, j*32 + y1-1);
-                            draw_trans_sprite(map, (BITMAP*)resources.data[TRANS_BK].dat,x1+1+viewport.pos_x - (size_alter*32)/2 + i*32, y1-(size_alter*32)/2 + j*32);
+                            draw_trans_sprite(bmp, (BITMAP*)resources.data[TRANS_BK].dat,x1+1+viewport.pos_x - (size_alter*32)/2 + i*32, y1-(size_alter*32)/2 + j*32);
                         }
                     }
                     /*
@@ -848,7 +1024,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
                     rect(bmp, x1 - (size_alter*32)/2, y1 - (size_alter*32)/2, x2 + (size_alter*32)/2, y2 + (size_alter*32)/2, tmp_col);
                     rect(bmp, x1 - (size_alter*32)/2 - 1, y1 - (size_alter*32)/2 + 1, x2 + (size_alter*32)/2 + 1, y2 + (size_alter*32)/2 - 1, tmp_col);
 
-                    short tooltip_x, tooltip_y, tooltip_x2, tooltip_y2;
+                    int tooltip_x, tooltip_y, tooltip_x2, tooltip_y2;
                     tooltip_x = tooltip_y = tooltip_x2 = tooltip_y2 = 0;
 
                     if (gui.getMouseFrame() == MAIN_FRAME) {
@@ -891,7 +1067,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
             // TODO: Draw the object selector correctly
             for (short i = 0; i <= current_object_x2-current_object_x1; i++) {
                 for (short j = 0; j <= current_object_y2-current_object_y1; j++) {
-                    masked_blit((BITMAP*)mapData[TILES1+object_tileset].dat, map, TILESIZE*i+current_object_x1*32, TILESIZE*j+current_object_y1*32,
+                    masked_blit((BITMAP*)mapData[TILES1+object_tileset].dat, bmp, TILESIZE*i+current_object_x1*32, TILESIZE*j+current_object_y1*32,
                                 x1+i*32,y1+j*32,TILESIZE,TILESIZE);
                 }
             }
@@ -901,7 +1077,7 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
             rect(bmp, x1, y1, x2+delta_x, y2+delta_y, tmp_col);
             rect(bmp, x1+1, y1+1, x2+delta_x-1, y2+delta_y-1, tmp_col);
 
-            short tooltip_x, tooltip_y, tooltip_x2, tooltip_y2;
+            int tooltip_x, tooltip_y, tooltip_x2, tooltip_y2;
             tooltip_x = tooltip_y = tooltip_x2 = tooltip_y2 = 0;
 
             if (gui.getMouseFrame() == MAIN_FRAME) {
@@ -927,47 +1103,32 @@ void EditorMain::drawSelector(BITMAP *bmp, int x1, int y1, int x2, int y2, short
 
 // Assign the proper index and tileset values on the Map array
 void EditorMain::drawTile(int x1, int y1) {
-    /*
-     if (mouse_z % 2 != 0) brush_size = mouse_z -1;
-        else brush_size = mouse_z;
-    */
-    if (((((y1/TILESIZE+viewport.scroll_y-1) > 0)) && (x1/TILESIZE+viewport.scroll_x) > -1) &&
-            (((x1/TILESIZE+viewport.scroll_x) <= mapWidth) && ((y1/TILESIZE+viewport.scroll_y) <= mapHeight))) {
-        Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].index = current_tile;
-        Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].tileset = mouse_tileset;
-    }
+    int x, y;
+    getCameraCell(viewport, x1, y1, x, y);
+    document.setTile(gui.getCurrentLayer(), x, y, current_tile, mouse_tileset);
+    layerCache.invalidate(gui.getCurrentLayer(), x, y, x, y);
+    markTiles(x, y, x, y);
 } // void EditorMain::drawTile(int x1, int y1)
 
 
 // Assign the proper index and tileset to each tile necessary to draw the object
 void EditorMain::drawObject(int x1, int y1) {
-    for (short i = 0; i <= current_object_x2-current_object_x1; i++) {
-        for (short j = 0; j <= current_object_y2-current_object_y1; j++) {
-            if ((y1/TILESIZE+viewport.scroll_y-2+j) > -1 && (y1/TILESIZE+viewport.scroll_y-2+j) < mapHeight &&
-                    (x1/TILESIZE+viewport.scroll_x+i) > -1 && (x1/TILESIZE+viewport.scroll_x+i) < mapWidth) {
-                Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2+j][x1/TILESIZE+viewport.scroll_x+i].index = (i+current_object_x1)*TILESIZE+j+current_object_y1;
-                Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2+j][x1/TILESIZE+viewport.scroll_x+i].tileset = object_tileset;
-            }
-        }
-    }
-
+    int x, y;
+    getCameraCell(viewport, x1, y1, x, y);
+    document.setObject(gui.getCurrentLayer(), x, y, current_object_x1, current_object_y1,
+                       current_object_x2, current_object_y2, object_tileset);
+    layerCache.invalidate(gui.getCurrentLayer(), x, y, x+current_object_x2-current_object_x1, y+current_object_y2-current_object_y1);
+    markTiles(x, y, x+current_object_x2-current_object_x1, y+current_object_y2-current_object_y1);
 } // void EditorMain::drawObject(int x1, int y1)
 
 // Replace all similar tiles on map
 void EditorMain::floodFill(int x1, int y1) {
-
-    short flooded_tile = Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].index;
-    short flooded_tset = Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].tileset;
-
-    for (short i = 0; i < mapWidth; i++) {
-        for (short j = 0; j < mapHeight; j++) {
-            if (Map[gui.getCurrentLayer()][j][i].index == flooded_tile &&
-                    Map[gui.getCurrentLayer()][j][i].tileset == flooded_tset) {
-                Map[gui.getCurrentLayer()][j][i].index = current_tile;
-                Map[gui.getCurrentLayer()][j][i].tileset = mouse_tileset;
-            }
-        }
-    }
+    int x, y;
+    getCameraCell(viewport, x1, y1, x, y);
+    document.floodFill(gui.getCurrentLayer(), x, y, current_tile, mouse_tileset);
+    // Any tile of the layer may have been the one replaced
+    layerCache.invalidateLayer(gui.getCurrentLayer());
+    markViewAll(dirty);
 } // void EditorMain::floodFill(int x1, int y1)
 
 
@@ -993,28 +1154,27 @@ void createCustomType(PARTICLE *p) {
 }
 
 void EditorMain::playEmitters() {
-    for (short l=0; l<layers; l++) {
-        for (short i = viewport.scroll_x; i < viewport.scroll_x+viewport.tile_w; i++) {
-            for (short j = viewport.scroll_y; j < viewport.scroll_y+viewport.tile_h; j++) {
-                if (Map[l][j][i].emitter > 0) {
+    // Every layer's emitters, but only from the chunks on screen
+    visibleEmitters.clear();
+    Emitters.query(-1, viewport.scroll_x, viewport.scroll_y,
+                   viewport.scroll_x+viewport.tile_w-1, viewport.scroll_y+viewport.tile_h-1, visibleEmitters);
 
+    for (unsigned int e = 0; e < visibleEmitters.size(); e++) {
+        const EmitterCell &cell = visibleEmitters[e];
 
-                    double x = i*TILESIZE+TILESIZE/2;
-                    double y = j*TILESIZE+TILESIZE;
+        double x = cell.x*TILESIZE+TILESIZE/2;
+        double y = cell.y*TILESIZE+TILESIZE;
 
-                    //particleEmitter.createParticles(x-viewport.scroll_x*32, y-viewport.scroll_y*32, 0.2, -0.7, 2, 1, life, color, 1, Map[l][j][i].emitter);
-                    particleEmitter.createParticles(x-viewport.scroll_x*32, y-viewport.scroll_y*32, Map[l][j][i].emitter, createCustomType);
-                    particleEmitter.applyForce(13*32, 4*32, 100, 10, -0.7, 0.2);
-                    //particleEmitter.applyForce(7*32, 2*32, 32, 10, 0, -0.5);
-                    //particleEmitter.applyForce(5*32, 4*32, 200, 200, 0, -2);
+        //particleEmitter.createParticles(x-viewport.scroll_x*32, y-viewport.scroll_y*32, 0.2, -0.7, 2, 1, life, color, 1, Map[l][j][i].emitter);
+        particleEmitter.createParticles(x-viewport.scroll_x*32, y-viewport.scroll_y*32, cell.type, createCustomType);
+        particleEmitter.applyForce(13*32, 4*32, 100, 10, -0.7, 0.2);
+        //particleEmitter.applyForce(7*32, 2*32, 32, 10, 0, -0.5);
+        //particleEmitter.applyForce(5*32, 4*32, 200, 200, 0, -2);
 
-                    particleEmitter.updateParticles();
-                    particleEmitter.drawParticles(map, &drawCustomParticle);
+        particleEmitter.updateParticles();
+        particleEmitter.drawParticles(map, &drawCustomParticle);
 
-                    textprintf_ex(map, font, (int)x-viewport.scroll_x*32-TILESIZE/2, (int)y-viewport.scroll_y*32+32+text_height(font), makecol(0, 0, 255), -1, "%d particles", particleEmitter.getParticleCount());
-                }
-            }
-        }
+        textprintf_ex(map, font, (int)x-viewport.scroll_x*32-TILESIZE/2, (int)y-viewport.scroll_y*32+32+text_height(font), makecol(0, 0, 255), -1, "%d particles", particleEmitter.getParticleCount());
     }
 }
 
@@ -1023,7 +1183,14 @@ short EditorMain::editorEngine() {
     int lay ;
     int x1, x2, y1, y2;
 
-    // ********* (1) Check editor state and draw the layer(s) accordingly
+    // Wrap up the background save if its thread is done, take in whatever
+    // arrived of a map that's loading
+    updateSave();
+    updateLoad();
+
+    // ********* (1) Check editor state and draw the layer(s) accordingly, on
+    //               the cells of the canvas that changed since it was last drawn
+    updateCanvas();
 
     // If the editor is in preview mode, draw every layer in order
     if (gui.getPreview()) {
@@ -1031,20 +1198,12 @@ short EditorMain::editorEngine() {
             drawLayer(i);
         }
     } else {
-        // If the editor is in the layered mode ("Show layers" checkbox)
-        if (gui.getLayers()) {
-            for (int i=0; i < gui.getCurrentLayer(); i++) {
-                // If the editor is in the Alpha mode ("Enable alpha" checkbox)
-                if (gui.getAlpha()) {
-                    // Draw all the layers with transparency up to the current layer
-                    drawTransLayer(i);
-                    // else draw every layer, up to the current one, in normal mode
-                } else drawLayer(i);
-            }
-            // No matter what, the current layer should be drawn without transparency
-            drawLayer(gui.getCurrentLayer());
-            // If the editor isn't in the layered mode, draw the current layer only
-        } else drawLayer(gui.getCurrentLayer());
+        // In the layered mode ("Show layers" checkbox) the layers up to the
+        // current one came from belowLayers with the background, see
+        // updateCanvas(). No matter what, the current layer should be drawn
+        // without transparency, and if the editor isn't in the layered mode
+        // it's the only one
+        drawLayer(gui.getCurrentLayer());
     }
 
     if (gui.getPanelState() == STATE_PARTICLES) {
@@ -1056,8 +1215,8 @@ short EditorMain::editorEngine() {
     }
     // ********* (2) Update editor actions in case we're drawing a one-tiler, collision or erasing
 
-    // Only edit the map if we're not in the preview mode
-    if (!gui.getPreview()) {
+    // Only edit the map if we're not in the preview mode, nor loading it
+    if (!gui.getPreview() && dataAccessState == ACCESS_FREE) {
         // Check if the mouse hovers over the canvas
         if (gui.getMouseFrame() == MAIN_FRAME) {
 
@@ -1115,22 +1274,18 @@ short EditorMain::editorEngine() {
                         if (mouse_z > 1) {
                             if (mouse_z % 2 != 0) brush_size = mouse_z -1;
                             else brush_size = mouse_z;
-                            // Plot the collision mask as necessary
-                            for (lay = 0; lay < layers; lay++) {
-                                for (int i = 0; i < brush_size; i++) {
-                                    for (int j = 0; j < brush_size; j++) {
-                                        Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].collision = 1;
-                                        Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].collision = 1;
-                                        Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].collision = 1;
-                                        Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].collision = 1;
-                                    }
-                                }
-                            }
+                            // Plot the collision mask as necessary, the brush
+                            // covers one rectangle so it's written a word at a time
+                            int bx1, by1, bx2, by2;
+                            getCameraBrush(viewport, x1, y1, brush_size, bx1, by1, bx2, by2);
+                            document.setCollision(bx1, by1, bx2, by2, true);
+                            markTiles(bx1, by1, bx2, by2);
                             // For one-tiler collisions
                         } else {
-                            for (lay = 0; lay < layers; lay++) {
-                                Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].collision = 1;
-                            }
+                            int cx, cy;
+                            getCameraCell(viewport, x1, y1, cx, cy);
+                            document.setCollision(cx, cy, cx, cy, true);
+                            markTiles(cx, cy, cx, cy);
                         }
                     }
 
@@ -1143,22 +1298,18 @@ short EditorMain::editorEngine() {
                         if (mouse_z > 1) {
                             if (mouse_z % 2 != 0) brush_size = mouse_z -1;
                             else brush_size = mouse_z;
-                            // Plot the collision mask as necessary
-                            for (lay = 0; lay < layers; lay++) {
-                                for (int i = 0; i < brush_size; i++) {
-                                    for (int j = 0; j < brush_size; j++) {
-                                        Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].collision = 0;
-                                        Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].collision = 0;
-                                        Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].collision = 0;
-                                        Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].collision = 0;
-                                    }
-                                }
-                            }
+                            // Plot the collision mask as necessary, the brush
+                            // covers one rectangle so it's written a word at a time
+                            int bx1, by1, bx2, by2;
+                            getCameraBrush(viewport, x1, y1, brush_size, bx1, by1, bx2, by2);
+                            document.setCollision(bx1, by1, bx2, by2, false);
+                            markTiles(bx1, by1, bx2, by2);
                             // For one-tiler collisions
                         } else {
-                            for (lay = 0; lay < layers; lay++) {
-                                Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].collision = 0;
-                            }
+                            int cx, cy;
+                            getCameraCell(viewport, x1, y1, cx, cy);
+                            document.setCollision(cx, cy, cx, cy, false);
+                            markTiles(cx, cy, cx, cy);
                         }
 
                     }
@@ -1185,19 +1336,22 @@ short EditorMain::editorEngine() {
                     if (mouse_z > 1) {
                         if (mouse_z % 2 != 0) brush_size = mouse_z -1;
                         else brush_size = mouse_z;
-                        // Plot the collision mask as necessary
-                        for (int i = 0; i < brush_size; i++) {
-                            for (int j = 0; j < brush_size; j++) {
-                                Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].emitter = 1;
-                                Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].emitter = 1;
-                                Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].emitter = 1;
-                                Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].emitter = 1;
+                        // Plot the emitters as necessary, once per covered cell
+                        int bx1, by1, bx2, by2;
+                        getCameraBrush(viewport, x1, y1, brush_size, bx1, by1, bx2, by2);
+                        for (int j = by1; j <= by2; j++) {
+                            for (int i = bx1; i <= bx2; i++) {
+                                document.setEmitter(gui.getCurrentLayer(), i, j, 1);
                             }
                         }
+                        markTiles(bx1, by1, bx2, by2);
 
                         // For one-tiler collisions
                     } else {
-                        Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].emitter = 1;
+                        int cx, cy;
+                        getCameraCell(viewport, x1, y1, cx, cy);
+                        document.setEmitter(gui.getCurrentLayer(), cx, cy, 1);
+                        markTiles(cx, cy, cx, cy);
 
                     }
                 }
@@ -1211,19 +1365,22 @@ short EditorMain::editorEngine() {
                     if (mouse_z > 1) {
                         if (mouse_z % 2 != 0) brush_size = mouse_z -1;
                         else brush_size = mouse_z;
-                        // Plot the collision mask as necessary
-                        for (int i = 0; i < brush_size; i++) {
-                            for (int j = 0; j < brush_size; j++) {
-                                Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].emitter = 0;
-                                Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].emitter = 0;
-                                Map[gui.getCurrentLayer()][(y1+(j*TILESIZE)/2)/TILESIZE+viewport.scroll_y-1][(x1 - (i*TILESIZE)/2)/TILESIZE+viewport.scroll_x].emitter = 0;
-                                Map[gui.getCurrentLayer()][(y1-(j*TILESIZE)/2-TILESIZE)/TILESIZE+viewport.scroll_y-1][(x1 + (i*TILESIZE)/2+TILESIZE)/TILESIZE+viewport.scroll_x].emitter = 0;
+                        // Plot the emitters as necessary, once per covered cell
+                        int bx1, by1, bx2, by2;
+                        getCameraBrush(viewport, x1, y1, brush_size, bx1, by1, bx2, by2);
+                        for (int j = by1; j <= by2; j++) {
+                            for (int i = bx1; i <= bx2; i++) {
+                                document.setEmitter(gui.getCurrentLayer(), i, j, 0);
                             }
                         }
+                        markTiles(bx1, by1, bx2, by2);
 
                         // For one-tiler collisions
                     } else {
-                        Map[gui.getCurrentLayer()][y1/TILESIZE+viewport.scroll_y-2][x1/TILESIZE+viewport.scroll_x].emitter = 0;
+                        int cx, cy;
+                        getCameraCell(viewport, x1, y1, cx, cy);
+                        document.setEmitter(gui.getCurrentLayer(), cx, cy, 0);
+                        markTiles(cx, cy, cx, cy);
 
                     }
 
@@ -1235,93 +1392,213 @@ short EditorMain::editorEngine() {
 
     scrollMap();
 
+    // ********* (5) Write this frame's edits to the journal, and every now and
+    //               then a checkpoint so the journal doesn't grow for ever
+    journal.flush();
+    if (autosave_interval > 0 && journal.hasEdits() && !isSaving() && !isLoading() &&
+        time(NULL) - last_checkpoint >= autosave_interval) {
+        checkpoint();
+    }
+
+    // Let the layer chunks drawn longest ago go, if there are too many
+    layerCache.endFrame();
+
     return 0;
 } // short EditorMain::editorEngine()
 
 
-// Draw the specified layer in the normal mode
+// Draw the specified layer in the normal mode, from the layer cache: the
+// whole view takes a blit per cached chunk, a run of cells being redrawn
+// one or two
 void EditorMain::drawLayer(int lay) {
 
-    short index, tileset;
-    int posx, posy;
-
     // Check if we should reset the viewport
     resetViewport();
 
-    // If we're not performing any file IO operations
-    if (dataAccessState == ACCESS_FREE) {
-        // Draw every tile that should appear in the current viewport
-        for (int i = viewport.tile_x; i < viewport.tile_w; i++) {
-            for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
-                index = Map[lay][j+viewport.scroll_y][i+viewport.scroll_x].index;
-                tileset = Map[lay][j+viewport.scroll_y][i+viewport.scroll_x].tileset;
+    // If we're not writing to the Map, a map still loading is drawn as it
+    // comes in
+    if (dataAccessState != ACCESS_WRITE_ONLY) {
+        if (redraw.all) {
+            drawViewLayer(map, lay);
+            return;
+        }
 
-                posx = TILESIZE * (index / TILESIZE);
-                posy = TILESIZE * (index % TILESIZE);
+        for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
+            if (!isViewRowDirty(redraw, j)) continue;
 
-                masked_blit((BITMAP*)mapData[TILES1 + tileset].dat, map, posx, posy,
-                            i*TILESIZE + viewport.pos_x, j*TILESIZE + viewport.pos_y, TILESIZE, TILESIZE);
+            for (int i = viewport.tile_x, n; (n = nextViewRun(redraw, viewport, j, i)) > 0; i += n) {
+                layerCache.draw(map, Map, mapData, tileProps, lay, i+viewport.scroll_x, j+viewport.scroll_y, n, 1,
+                                i*TILESIZE + viewport.pos_x, j*TILESIZE + viewport.pos_y);
             }
         }
     }
 } // void EditorMain::drawLayer(int lay)
 
+void EditorMain::drawViewLayer(BITMAP *bmp, int lay) {
+    layerCache.draw(bmp, Map, mapData, tileProps, lay, viewport.tile_x+viewport.scroll_x, viewport.tile_y+viewport.scroll_y,
+                    viewport.tile_w-viewport.tile_x, viewport.tile_h-viewport.tile_y,
+                    viewport.tile_x*TILESIZE + viewport.pos_x, viewport.tile_y*TILESIZE + viewport.pos_y);
+} // void EditorMain::drawViewLayer(BITMAP *bmp, int lay)
+
 
-// Draw a semi-transparent layer
-void EditorMain::drawTransLayer(int lay) {
+// Draw a semi-transparent layer, the whole view of it
+void EditorMain::drawTransLayer(BITMAP *bmp, int lay) {
 
     short index, tileset;
-    int posx, posy;
 
     // Reset the viewport if that's the case
     resetViewport();
 
-    // If we have access to the Map array
-    if (dataAccessState == ACCESS_FREE) {
-        for (int i = viewport.tile_x; i < viewport.tile_w; i++) {
-            for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
-                index = Map[lay][j+viewport.scroll_y][i+viewport.scroll_x].index;
-                tileset = Map[lay][j+viewport.scroll_y][i+viewport.scroll_x].tileset;
-
-                posx = TILESIZE * (index / TILESIZE);
-                posy = TILESIZE * (index % TILESIZE);
-
-                // Draw the tile on the transparent tile
-                masked_blit((BITMAP*)mapData[0 + tileset].dat, transTile, posx, posy, 0, 0, TILESIZE, TILESIZE);
-                // Draw the transparent tile on the specified BITMAP
-                draw_trans_sprite(map, transTile, i*TILESIZE + viewport.pos_x, j*TILESIZE + viewport.pos_y);
-                // Fill the transparent tile with a medium gray
-                clear_to_color(transTile, makecol(128,128,128));
+    // If we have read access to the Map array
+    if (dataAccessState != ACCESS_WRITE_ONLY) {
+        for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
+            int i = viewport.tile_x;
+            while (i < viewport.tile_w) {
+                // Walk the row one chunk span at a time
+                const Tile *span;
+                int count = Map.getSpan(lay, i+viewport.scroll_x, j+viewport.scroll_y, span);
+                if (count <= 0) break;
+
+                for (int k = 0; k < count && i < viewport.tile_w; k++, i++) {
+                    // Nothing to see, or a tileset mapData.dat doesn't have
+                    if (tileProps.getOpacity(span[k]) == TILE_TRANSPARENT) continue;
+
+                    index = span[k].getIndex();
+                    tileset = span[k].getTileset();
+
+                    // Draw the transparent tile, made the first time it's used, on the specified BITMAP
+                    BITMAP *tile = transTiles.getTile(mapData, tileset, index);
+                    if (tile != NULL) draw_trans_sprite(bmp, tile, i*TILESIZE + viewport.pos_x, j*TILESIZE + viewport.pos_y);
+                }
             }
         }
     }
-} // void EditorMain::drawTransLayer(int lay)
+} // void EditorMain::drawTransLayer(BITMAP *bmp, int lay)
 
 // Scroll map using the arrow keys
 void EditorMain::scrollMap() {
     if (!gui.isFieldActive()) {
-        if (key[KEY_RIGHT]) {
-            if (viewport.scroll_x < mapWidth - viewport.tile_w) viewport.scroll_x++;
-        }
+        int dx = 0, dy = 0;
 
-        if (key[KEY_LEFT]) {
-            if (viewport.scroll_x > 0 ) viewport.scroll_x--;
-        }
+        if (key[KEY_RIGHT]) dx++;
+        if (key[KEY_LEFT]) dx--;
+        if (key[KEY_UP]) dy--;
+        if (key[KEY_DOWN]) dy++;
 
-        if (key[KEY_UP]) {
-            if (viewport.scroll_y > 0) viewport.scroll_y--;
+        if (dx != 0 || dy != 0) scrollCamera(viewport, dx, dy, mapWidth, mapHeight);
+    }
+} // void EditorMain::scrollMap()
+
+int EditorMain::getCanvasState() {
+    return gui.getPreview() | gui.getLayers() << 1 | gui.getAlpha() << 2 | gui.getGrid() << 3 |
+           gui.getOtherGrids() << 4 | gui.getChanges() << 5 | (gui.getPanelState() == STATE_PARTICLES) << 6 |
+           isBusy() << 7 | (dataAccessState == ACCESS_WRITE_ONLY) << 8 | gui.getCurrentLayer() << 9;
+} // int EditorMain::getCanvasState()
+
+// Work out which cells of the canvas are drawn this frame and lay down their
+// background, the layers and overlays are drawn over the same cells
+void EditorMain::updateCanvas() {
+
+    // Check if we should reset the viewport
+    resetViewport();
+
+    // Scrolling, a display option or a map that's still coming in changes
+    // every cell
+    int state = getCanvasState();
+    if (state != drawn_state || isLoading() ||
+        viewport.scroll_x != drawn_view.scroll_x || viewport.scroll_y != drawn_view.scroll_y ||
+        viewport.tile_w != drawn_view.tile_w || viewport.tile_h != drawn_view.tile_h) {
+        markViewAll(dirty);
+    }
+    drawn_state = state;
+    drawn_view = viewport;
+
+    // The edits made from here on are drawn next frame, like they always were
+    redraw.rows.swap(dirty.rows);
+    redraw.any = dirty.any;
+    redraw.all = dirty.all;
+    clearView(dirty);
+
+    if (!redraw.any) return;
+
+    // In the layered mode the cells start from the layers under the current
+    // one, background included
+    bool layered = gui.getLayers() && !gui.getPreview();
+    if (layered) updateBelow();
+
+    int background = gui.getAlpha() ? 0 : makecol(255,255,255);
+    if (redraw.all) clear_to_color(map, background);
+
+    for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
+        if (!isViewRowDirty(redraw, j)) continue;
+
+        for (int i = viewport.tile_x, n; (n = nextViewRun(redraw, viewport, j, i)) > 0; i += n) {
+            int x = i*TILESIZE + viewport.pos_x, y = j*TILESIZE + viewport.pos_y;
+
+            if (layered) {
+                blit(belowLayers, map, x, y, x, y, n*TILESIZE, TILESIZE);
+                continue;
+            }
+
+            if (!redraw.all) rectfill(map, x, y, x+n*TILESIZE-1, y+TILESIZE-1, background);
+            if (gui.getAlpha()) {
+                for (int k = 0; k < n; k++) {
+                    masked_blit((BITMAP*)resources.data[TRANS_BK].dat, map, 0, 0, x+k*TILESIZE, y, TILESIZE, TILESIZE);
+                }
+            }
         }
+    }
+} // void EditorMain::updateCanvas()
+
+// Flatten the background and the layers under the current one, the way the
+// canvas used to draw them every frame
+void EditorMain::updateBelow() {
+    int state = gui.getAlpha() | gui.getCurrentLayer() << 1;
+
+    // Every layer version only goes up, so does their sum
+    unsigned int version = 0;
+    for (int i = 0; i < gui.getCurrentLayer(); i++) version += layerCache.getVersion(i);
+
+    if (state == below_state && version == below_version &&
+        viewport.scroll_x == below_view.scroll_x && viewport.scroll_y == below_view.scroll_y &&
+        viewport.tile_w == below_view.tile_w && viewport.tile_h == below_view.tile_h) return;
 
-        if (key[KEY_DOWN]) {
-            if (viewport.scroll_y < mapHeight - viewport.tile_h) viewport.scroll_y++;
+    below_state = state;
+    below_version = version;
+    below_view = viewport;
+
+    if (!gui.getAlpha()) {
+        clear_to_color(belowLayers, makecol(255,255,255));
+    } else {
+        clear(belowLayers);
+        for (int i = viewport.tile_x; i < viewport.tile_w; i++) {
+            for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
+                masked_blit((BITMAP*)resources.data[TRANS_BK].dat, belowLayers, 0, 0, i*TILESIZE + viewport.pos_x, j*TILESIZE + viewport.pos_y, TILESIZE, TILESIZE);
+            }
         }
     }
-} // void EditorMain::scrollMap()
+
+    if (dataAccessState == ACCESS_WRITE_ONLY) return;
+
+    for (int i = 0; i < gui.getCurrentLayer(); i++) {
+        // If the editor is in the Alpha mode ("Enable alpha" checkbox), with
+        // transparency
+        if (gui.getAlpha()) drawTransLayer(belowLayers, i);
+        else drawViewLayer(belowLayers, i);
+    }
+} // void EditorMain::updateBelow()
 
 // Render the map to the specified BITMAP
-// Renders the correponding selector as well
+// Renders the correponding selector as well, straight on the BITMAP so the
+// canvas underneath stays as it is
 void EditorMain::renderMap(BITMAP* bmp) {
 
+    masked_blit(map, bmp, 0, 0, 0, 0, SCREEN_W, SCREEN_H);
+
+    drawn_selector = selector_area;
+    selector_area.x1 = selector_area.y1 = 0;
+    selector_area.x2 = selector_area.y2 = -1;
+
     if (gui.getMouseFrame() == MAIN_FRAME) {
 
         short x1=TILESIZE*(mouse_x/TILESIZE);
@@ -1329,29 +1606,71 @@ void EditorMain::renderMap(BITMAP* bmp) {
         short x2=x1+TILESIZE-1;
         short y2=y1+TILESIZE+1;
 
-        drawSelector(map, x1, y1, x2, y2, gui.getBrush());
+        drawSelector(bmp, x1, y1, x2, y2, gui.getBrush());
+
+        // Whatever drawSelector() may have covered: the brush or the object,
+        // with a tile to spare for the previews, and the tooltip by the pointer
+        int reach_x = TILESIZE, reach_y = TILESIZE;
+        if (isObject) {
+            reach_x += (current_object_x2-current_object_x1)*TILESIZE;
+            reach_y += (current_object_y2-current_object_y1)*TILESIZE;
+        } else if (mouse_z > 1) {
+            reach_x = reach_y = TILESIZE + (mouse_z+1)*TILESIZE/2;
+        }
+
+        // drawSelector() moves its x2 and y1 to the pointer for the tooltip,
+        // the text starts half an "X:00" right of that and reads up to two
+        // five digit cells
+        int tooltip_x1 = mouse_x + 20, tooltip_y1 = mouse_y;
+        int tooltip_x2 = tooltip_x1 + text_length(font, "X:00")/2 + text_length(font, "X:99999, 99999");
+
+        selector_area.x1 = MIN(x1 - (isObject ? TILESIZE : reach_x), mouse_x);
+        selector_area.y1 = MIN(y1 - (isObject ? TILESIZE : reach_y), tooltip_y1 - text_height(font)*2 - 5);
+        selector_area.x2 = MAX(x2 + reach_x, tooltip_x2);
+        selector_area.y2 = MAX(y2 + reach_y, tooltip_y1 + 5);
     }
-    masked_blit(map, bmp, 0, 0, 0, 0, SCREEN_W, SCREEN_H);
-    if (!gui.getAlpha()) {
-        clear_to_color(map, makecol(255,255,255));
-    } else {
-        clear(map);
-        for (int i = viewport.tile_x; i < viewport.tile_w; i++) {
-            for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
-                masked_blit((BITMAP*)resources.data[TRANS_BK].dat, map, 0, 0, i*TILESIZE + viewport.pos_x, j*TILESIZE + viewport.pos_y, TILESIZE, TILESIZE);
+} // void EditorMain::renderMap(BITMAP* bmp)
+
+// The cells drawn this frame, a rectangle per run of them in a row, and the
+// selector where it is and where it was
+void EditorMain::getCanvasRects(vector<CanvasRect> &rects) {
+    CanvasRect area;
+
+    if (redraw.all) {
+        area.x1 = area.y1 = 0;
+        area.x2 = map->w-1;
+        area.y2 = map->h-1;
+        rects.push_back(area);
+    } else if (redraw.any) {
+        for (int j = viewport.tile_y; j < viewport.tile_h; j++) {
+            if (!isViewRowDirty(redraw, j)) continue;
+
+            for (int i = viewport.tile_x, n; (n = nextViewRun(redraw, viewport, j, i)) > 0; i += n) {
+                area.x1 = i*TILESIZE + viewport.pos_x;
+                area.x2 = area.x1 + n*TILESIZE - 1;
+                area.y1 = j*TILESIZE + viewport.pos_y;
+                area.y2 = area.y1 + TILESIZE - 1;
+                rects.push_back(area);
             }
         }
     }
-} // void EditorMain::renderMap(BITMAP* bmp)
+
+    if (drawn_selector.x1 <= drawn_selector.x2) rects.push_back(drawn_selector);
+    if (selector_area.x1 <= selector_area.x2) rects.push_back(selector_area);
+} // void EditorMain::getCanvasRects(vector<CanvasRect> &rects)
 
 void EditorMain::freeMap() {
-    delete[] Map;
+    waitSave();
+    finishLoad(false);
+    closeChanges();
+    document.destroy();
 }
 
 // Clear the memory
-// TODO: Look into the Map de-allocating code, make sure there are no memory-leaks
 void EditorMain::freeEditor() {
+    layerCache.freeCache();
+    destroy_bitmap(belowLayers);
     destroy_bitmap(map);
     unload_datafile(mapData);
-    destroy_bitmap(transTile);
+    transTiles.freeCache();
 } // EditorMain::freeEditor()
@@ -33,21 +33,25 @@
 #include <allegro.h>
 
 #include <malloc.h>
+#include <time.h>
 #include <iostream>
 #include "..\gui\guimain.h"
 #include "mapData.h"
+#include "..\map\mapdocument.h"
+#include "..\map\mappatch.h"
+#include "..\map\mapview.h"
+#include "..\map\mapfile.h"
+#include "..\map\legacyfile.h"
 #include "..\utils\dataformat.h"
+#include "..\utils\workerpool.h"
 #include "..\input\inputmouse.h"
 #include "particleemitter.h"
+#include "layercache.h"
+#include "transtilecache.h"
+#include "tileprops.h"
 
 using namespace std;
 
-/** \def This defines the tilesize used through-out the editor
-*** \todo Make the TILESIZE a member of Tile so the editor can use more
-****      tilesizes
-**/
-#define TILESIZE 32
-
 /** \def These define the editor current file IO state. The editor
 ***      shouldn't perform any reading/writing operations on the
 ***      EditorMain#Map private member while IO operations are beeing
@@ -62,55 +66,39 @@ using namespace std;
 #define PLAY_PARTICLES  0
 #define PAUSE_PARTICLES 1
 
-/** \struct Tile editormain.h "src\editor\editormain.h"
-*** \brief The Tile structure defines a map tile. The Map is defined
-***        as an array of the form Map[layers][mapHeight][mapWidth]
+/** \def The states of a background save, see EditorMain::saveMapAsync()
 **/
-typedef struct Tile {
-    short index;        /**< short variable, defines the index of the tile from the tileset **/
-    short tileset;      /**< short variable, defines the index of the tileset **/
-    short collision;    /**< short variable, defines the walkability status **/
-
-    short emitter;      /**< keep it simple for starters, should hold the value of the particle type (this will indicate a file in ParticleEmitter later on... **/
-    //short force;
-} Tile;
+//@{
+#define SAVE_IDLE    0
+#define SAVE_RUNNING 1
+#define SAVE_DONE    2
+#define SAVE_FAILED  3
+//@}
 
-/** \struct Camera editormain.h "src\editor\editormain.h"
-*** \brief The Camera structure defines the EditorMain#viewport
-***
-*** This is used in order to save memory and CPU usage by only
-*** rendering the area of the map that we're currently looking at.
-*** It also offers flexibility by defining the position and size of
-*** the viewport, both in pixels or TILESIZE
+/** \def How much of a map loading in the background is taken in per frame,
+***      see EditorMain::updateLoad()
 **/
-typedef struct Camera {
-    /** The position variables **/
-    //@{
-    short tile_x, tile_y;
-    short pixel_x, pixel_y;
-    //@}
-
-    /** The size variables **/
-    //@{
-    int tile_w, tile_h;
-    int pixel_w, pixel_h;
-    //@}
-
-    /** Size variables used in EditorMain#resetViewport **/
-    //@{
-    int init_w, init_h;
-    //@}
+//@{
+//! Decoded v2 chunks copied into the Map
+#define LOAD_FRAME_CHUNKS 256
+//! Tiles read from an old .dat map, whole strips at least
+#define LOAD_FRAME_TILES  (256 * 1024)
+//@}
 
-    /** Viewport position on screen **/
-    //@{
-    int pos_x, pos_y;
-    //@}
+/** \def Where the edit journal and the checkpoints it's rebased on are
+***      written, see EditorMain::checkpoint()
+**/
+//@{
+#define EDIT_JOURNAL_FILE "Data\\Map\\edits.jrn"
+#define AUTOSAVE_FILE     "Data\\Map\\autosave.map"
+//@}
 
-    /** Scroll variables used with EditorMain#scrollMap() **/
-    //@{
-    int scroll_x, scroll_y;
-    //@}
-} Camera;
+/** \struct CanvasRect editormain.h "src\editormain.h"
+*** \brief A part of the screen the canvas changed, corners included
+**/
+typedef struct CanvasRect {
+    int x1, y1, x2, y2;
+} CanvasRect;
 
 /** \class EditorMain editormain.h "src\editormain.h"
 *** \brief This provides the methods used to edit and render tiled maps
@@ -168,7 +156,41 @@ public:
 
     //! Saves a map with the default test_map.dat filename
     short saveMap();
+    //! Saves in the v2 format, whatever the extension
     short saveMap(string name);
+    //! Same as saveMap(name) but the file is written in the background
+    short saveMapAsync(string name);
+    //! Saves in the old .dat layout
+    short exportMap(string name);
+    //@}
+
+    /** \name Background save
+    *** \brief updateSave() is called every frame and wraps up a background
+    ***        save once its thread is done. waitSave() blocks until then; the
+    ***        IO functions call it before they touch the map.
+    **/
+    //@{
+    void updateSave();
+    void waitSave();
+    short getSaveState() { return save_state; }
+    string getSaveName() { return save_name; }
+    //@}
+
+    /** \name Background load
+    *** \brief loadMap() only reads what it takes to draw the map, the rest
+    ***        comes in while the editor runs: updateLoad() is called every
+    ***        frame and takes in what arrived, the chunks on screen first.
+    ***        The map is drawn all along but can't be edited until it's all
+    ***        in. waitLoad() reads the rest at once.
+    **/
+    //@{
+    void updateLoad();
+    void waitLoad();
+    bool isLoading() { return loadFile != NULL || legacyLoad != NULL; }
+    //! How much of the map is in, in percent
+    int getLoadProgress();
+    //! What was wrong with the map last loaded, empty if nothing
+    string getLoadWarning() { return load_warning; }
     //@}
 
     /** \name getCurrentMap()
@@ -178,13 +200,17 @@ public:
     string getCurrentMap() {
         return current_map;
     }
+    void setCurrentMap(string name) {
+        current_map = name;
+        journal.setName(name);
+    }
 
     /** \name getMaxLayers()
     *** \brief Returns the number of layers of the current map.
     ***        Used to display the "Current Layer" button
     *** \return Current map's number of layers
     **/
-    short getMaxLayers() {
+    int getMaxLayers() {
         return layers;
     }
 
@@ -226,9 +252,12 @@ public:
     **/
     //@{
     void drawLayer(int lay);
-    void drawTransLayer(int lay);
+    //! Draws the whole view of the layer on bmp, half transparent
+    void drawTransLayer(BITMAP *bmp, int lay);
     void drawGrid();
     void drawCollision();
+    //! Outlines the cells that differ from the file the map was read from or saved to
+    void drawChanges();
     /** drawSelector() draws a rectangle around the cursor. In case the pointer
     *** hovers over the map Canvas, it draws a rectangle the size of the brush,
     *** on the tileset it draws a rectangle around the selected/focused tile/object
@@ -260,7 +289,20 @@ public:
     **/
     void renderMap(BITMAP *bmp);
 
-    // Extras from freeEditor() - clean the ***Map
+    /** \name Canvas updates
+    *** \brief The canvas is kept from frame to frame and only the cells that
+    ***        changed are drawn again. isCanvasDirty() tells if any were this
+    ***        frame, getCanvasRects() adds the parts of the screen renderMap()
+    ***        changed to rects, the selector included. While isBusy() a map
+    ***        is loading or saving and the screen keeps changing
+    **/
+    //@{
+    bool isCanvasDirty() { return redraw.any; }
+    void getCanvasRects(vector<CanvasRect> &rects);
+    bool isBusy() { return isLoading() || isSaving(); }
+    //@}
+
+    // Extras from freeEditor() - releases the Map tiles
     void freeMap();
 
     /** \name freeEditor()
@@ -283,10 +325,10 @@ public:
     int getScrollY() {return viewport.scroll_y;}
 protected:
 private:
-    /** Beeing a dynamic map structure, these define the map size
+    /** Beeing a dynamic map structure, these define the map size, in tiles
     **/
     //@{
-    short layers, mapWidth, mapHeight;
+    int layers, mapWidth, mapHeight;
     //@}
 
     /** Used with the drawTile() method
@@ -299,17 +341,45 @@ private:
 
     string current_map; //!< The current map's filename, used for various operations
 
-    Tile ***Map; //!< The dynamic 3D array used to hold the map data
+    /** The map being edited, its edit operations and journal. The others
+    *** are short for the parts of it the drawing and IO code works on
+    **/
+    //@{
+    MapDocument document;
+    TileMap &Map; //!< Every layer's tiles, in sparse chunks that read as the fill until written
+    CollisionMask &Collision; //!< One bit per map cell, shared by all the layers
+    EmitterIndex &Emitters; //!< Where the emitters are, kept in step with the tiles
+    EditJournal &journal; //!< Every edit goes in here, see checkpoint()
+    //@}
     //Tile map_debugger[3][100][20];
     Camera viewport;
 
     /** Allegro defined structures. The tileset datafile and an intermediary BITMAP used to draw the map
-    *** \note Added an extra BITMAP member. Moved from the drawTransLayer() to save memory and mem usage
     **/
     //@{
     DATAFILE *mapData;
     BITMAP *map;
-    BITMAP *transTile;
+    //@}
+
+    TransTileCache transTiles; //!< The tiles drawTransLayer() blends, ready made
+    TileProps tileProps; //!< How each tile of mapData is drawn, classified once it's loaded
+
+    LayerCache layerCache; //!< The layers drawn in chunks, drawLayer() blits from it
+    //! Draws the whole view of the layer on bmp, from the layerCache
+    void drawViewLayer(BITMAP *bmp, int lay);
+
+    /** In the layered mode, the layers under the current one flattened over
+    *** the canvas background for the whole view; the canvas cells start from
+    *** it. updateBelow() only draws it again once the view, the current
+    *** layer, the alpha mode or one of the layers under it changed
+    **/
+    //@{
+    BITMAP *belowLayers;
+    Camera below_view;
+    int below_state;
+    unsigned int below_version;
+
+    void updateBelow();
     //@}
 
     /** Used with the setBrushSize() method, for the transition between the tileset frame and the map
@@ -328,11 +398,98 @@ private:
     bool isObject;
     //@}
 
+    //! Writes an empty map, used by the newMap() overloads
+    short writeNewMap(string path, int lays, int width, int height, int first_index, int other_index);
+
     /** A flag that determines wheter the editor is currently performing any file IO operations **/
     short dataAccessState;
 
+    int io_threads; //!< Threads the map files are encoded and decoded on, 0 for every processor
+
+    /** The background save, see saveMapAsync(). The MapFile holds the
+    *** snapshot of the Map until finishSave()
+    **/
+    //@{
+    MapFile saveFile;
+    WorkerThread saveThread;
+    bool save_result;
+    short save_state;
+    string save_name;
+
+    static void saveThreadMain(void *context, int index);
+    void finishSave();
+    bool isSaving() { return save_state == SAVE_RUNNING || save_checkpoint; }
+    //@}
+
+    /** Every edit goes in the journal, which is written out once a frame.
+    *** Every autosave_interval seconds a checkpoint of the map is saved in
+    *** the background and the journal starts over on top of it. If the
+    *** editor doesn't exit cleanly, recoverMap() puts the map back together
+    *** from the last checkpoint or save and the journal
+    **/
+    //@{
+    int autosave_interval;  //!< Seconds between checkpoints, 0 turns the journal off
+    time_t last_checkpoint;
+    bool save_checkpoint;   //!< The save in flight is a checkpoint, not the user's
+
+    void startJournal(const string &base);
+    void checkpoint();
+    bool recoverMap();
+    //@}
+
+    /** The background load, see loadMap(). Only one of the files is set
+    *** while a map is coming in; v2 chunks are decoded on loadThread, old
+    *** maps are read a few strips a frame
+    **/
+    //@{
+    MapFile *loadFile;
+    LegacyMapFile *legacyLoad;
+    WorkerThread loadThread;
+    string load_warning;
+
+    static void loadThreadMain(void *context, int index);
+    //! Reads the rest of the map, or drops it if complete is false
+    void finishLoad(bool complete);
+    //! loadMap() without naming the map, the path is taken as it is
+    short openMap(string final);
+    //@}
+
+    /** What drawChanges() compares the map to: the file it was last read
+    *** from or saved to, opened when the overlay is first shown. Only its
+    *** directory is read, the chunks are decoded as they're compared. It's
+    *** dropped before anything is written, the file may be the one saved over
+    **/
+    //@{
+    MapFile *changes_base;
+    CollisionMask changes_collision;
+    string changes_path;
+    MapPatch changes;
+
+    void closeChanges();
+    //@}
+
+    /** The cells of the canvas to draw again. Edits mark dirty, which is
+    *** what updateCanvas() draws the next frame, as redraw. drawn_view and
+    *** drawn_state are what the canvas was last drawn with; when they change
+    *** it's drawn whole. The selector is drawn over the canvas on the screen
+    *** buffer, selector_area is where it was this frame and drawn_selector
+    *** where it was the frame before
+    **/
+    //@{
+    ViewDirty dirty, redraw;
+    Camera drawn_view;
+    int drawn_state;
+    CanvasRect selector_area, drawn_selector;
+
+    void updateCanvas();
+    //! The display options the canvas is drawn with, packed in one number
+    int getCanvasState();
+    void markTiles(int x1, int y1, int x2, int y2) { markViewTiles(dirty, viewport, x1, y1, x2, y2); }
+    //@}
+
     short emitter_state;
     ParticleEmitter particleEmitter;
+    vector<EmitterCell> visibleEmitters; //!< Reused by the emitter queries every frame
 };
 
 #endif // EDITORMAIN_H
@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    layercache.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the layer chunk cache.
+******************************************************************************/
+
+#include "layercache.h"
+
+LayerCache::LayerCache() {
+    budget = 32 * 1024 * 1024;
+    memory = 0;
+    frame = 0;
+    all_version = 0;
+} // LayerCache::LayerCache()
+
+LayerCache::~LayerCache() {
+} // LayerCache::~LayerCache()
+
+// There are only a few dozen chunks at a time, it's quicker to walk them all
+// than to look up every chunk the rectangle covers
+void LayerCache::invalidate(int lay, int x1, int y1, int x2, int y2) {
+    int cx1 = x1 >> LAYERCACHE_SHIFT, cy1 = y1 >> LAYERCACHE_SHIFT;
+    int cx2 = x2 >> LAYERCACHE_SHIFT, cy2 = y2 >> LAYERCACHE_SHIFT;
+
+    bumpVersion(lay);
+
+    for (map<uint64_t, LayerChunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        LayerChunk *chunk = it->second;
+        if (chunk->lay == lay && chunk->cx >= cx1 && chunk->cx <= cx2 && chunk->cy >= cy1 && chunk->cy <= cy2) {
+            chunk->valid = false;
+        }
+    }
+} // void LayerCache::invalidate(int lay, int x1, int y1, int x2, int y2)
+
+void LayerCache::invalidateLayer(int lay) {
+    bumpVersion(lay);
+    for (map<uint64_t, LayerChunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        if (it->second->lay == lay) it->second->valid = false;
+    }
+} // void LayerCache::invalidateLayer(int lay)
+
+void LayerCache::invalidateAll() {
+    all_version++;
+    for (map<uint64_t, LayerChunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        it->second->valid = false;
+    }
+} // void LayerCache::invalidateAll()
+
+void LayerCache::bumpVersion(int lay) {
+    if (lay < 0) return;
+    if (lay >= (int)versions.size()) versions.resize(lay+1, 0);
+    versions[lay]++;
+} // void LayerCache::bumpVersion(int lay)
+
+// One blit per chunk the rectangle crosses, masked unless it's opaque
+void LayerCache::draw(BITMAP *bmp, TileMap &tiles, DATAFILE *gfx, const TileProps &props, int lay, int x, int y, int w, int h, int px, int py) {
+    if (w <= 0 || h <= 0) return;
+
+    for (int cy = y >> LAYERCACHE_SHIFT; cy <= (y+h-1) >> LAYERCACHE_SHIFT; cy++) {
+        int y1 = MAX(y, cy << LAYERCACHE_SHIFT);
+        int y2 = MIN(y+h, (cy+1) << LAYERCACHE_SHIFT);
+
+        for (int cx = x >> LAYERCACHE_SHIFT; cx <= (x+w-1) >> LAYERCACHE_SHIFT; cx++) {
+            int x1 = MAX(x, cx << LAYERCACHE_SHIFT);
+            int x2 = MIN(x+w, (cx+1) << LAYERCACHE_SHIFT);
+
+            LayerChunk *chunk = getChunk(tiles, gfx, props, lay, cx, cy);
+            if (chunk == NULL || chunk->opacity == TILE_TRANSPARENT) continue;
+
+            int sx = (x1 & (LAYERCACHE_SIZE-1))*TILESIZE, sy = (y1 & (LAYERCACHE_SIZE-1))*TILESIZE;
+            int dx = px + (x1-x)*TILESIZE, dy = py + (y1-y)*TILESIZE;
+            if (chunk->opacity == TILE_OPAQUE) {
+                blit(chunk->bmp, bmp, sx, sy, dx, dy, (x2-x1)*TILESIZE, (y2-y1)*TILESIZE);
+            } else {
+                masked_blit(chunk->bmp, bmp, sx, sy, dx, dy, (x2-x1)*TILESIZE, (y2-y1)*TILESIZE);
+            }
+        }
+    }
+} // void LayerCache::draw(BITMAP *bmp, TileMap &tiles, DATAFILE *gfx, const TileProps &props, int lay, int x, int y, int w, int h, int px, int py)
+
+LayerChunk *LayerCache::getChunk(TileMap &tiles, DATAFILE *gfx, const TileProps &props, int lay, int cx, int cy) {
+    LayerChunk *chunk;
+
+    map<uint64_t, LayerChunk*>::iterator it = chunks.find(chunkKey(lay, cx, cy));
+    if (it != chunks.end()) {
+        chunk = it->second;
+    } else {
+        BITMAP *bmp = create_bitmap(LAYERCACHE_PIXELS, LAYERCACHE_PIXELS);
+        if (bmp == NULL) return NULL;
+
+        chunk = new LayerChunk;
+        chunk->lay = lay;
+        chunk->cx = cx;
+        chunk->cy = cy;
+        chunk->bmp = bmp;
+        chunk->valid = false;
+        chunks[chunkKey(lay, cx, cy)] = chunk;
+        memory += (size_t)LAYERCACHE_PIXELS * LAYERCACHE_PIXELS * ((bitmap_color_depth(bmp) + 7) / 8);
+    }
+
+    if (!chunk->valid) renderChunk(chunk, tiles, gfx, props);
+    chunk->used = frame;
+    return chunk;
+} // LayerChunk *LayerCache::getChunk(TileMap &tiles, DATAFILE *gfx, const TileProps &props, int lay, int cx, int cy)
+
+// The same walk drawLayer() used to do for the whole view, one chunk span
+// at a time, for the tiles of the chunk. Past the edges of the map the
+// chunk is left to the mask color. The chunk is opaque if all its tiles
+// are, and transparent if they all are
+void LayerCache::renderChunk(LayerChunk *chunk, TileMap &tiles, DATAFILE *gfx, const TileProps &props) {
+    short index, tileset;
+    int posx, posy;
+    int opaque = 0, transparent = 0;
+
+    clear_to_color(chunk->bmp, bitmap_mask_color(chunk->bmp));
+
+    int x = chunk->cx << LAYERCACHE_SHIFT, y = chunk->cy << LAYERCACHE_SHIFT;
+    for (int j = 0; j < LAYERCACHE_SIZE && y+j < tiles.getHeight(); j++) {
+        int i = 0;
+        while (i < LAYERCACHE_SIZE) {
+            const Tile *span;
+            int count = tiles.getSpan(chunk->lay, x+i, y+j, span);
+            if (count <= 0) break;
+
+            for (int k = 0; k < count && i < LAYERCACHE_SIZE; k++, i++) {
+                index = span[k].getIndex();
+                tileset = span[k].getTileset();
+
+                // The chunk starts out as the mask color, a masked tile
+                // only needs its other pixels and a transparent one nothing
+                int opacity = props.getOpacity(tileset, index);
+                if (opacity == TILE_TRANSPARENT) {
+                    transparent++;
+                    continue;
+                }
+
+                posx = TILESIZE * (index / TILESIZE);
+                posy = TILESIZE * (index % TILESIZE);
+
+                if (opacity == TILE_OPAQUE) {
+                    opaque++;
+                    blit((BITMAP*)gfx[TILES1 + tileset].dat, chunk->bmp, posx, posy,
+                         i*TILESIZE, j*TILESIZE, TILESIZE, TILESIZE);
+                } else {
+                    masked_blit((BITMAP*)gfx[TILES1 + tileset].dat, chunk->bmp, posx, posy,
+                                i*TILESIZE, j*TILESIZE, TILESIZE, TILESIZE);
+                }
+            }
+        }
+    }
+
+    if (opaque == LAYERCACHE_SIZE * LAYERCACHE_SIZE) chunk->opacity = TILE_OPAQUE;
+    else if (transparent == LAYERCACHE_SIZE * LAYERCACHE_SIZE) chunk->opacity = TILE_TRANSPARENT;
+    else chunk->opacity = TILE_MASKED;
+
+    chunk->valid = true;
+} // void LayerCache::renderChunk(LayerChunk *chunk, TileMap &tiles, DATAFILE *gfx, const TileProps &props)
+
+// Whatever wasn't drawn this frame may go, the oldest first
+void LayerCache::endFrame() {
+    while (memory > budget) {
+        map<uint64_t, LayerChunk*>::iterator oldest = chunks.end();
+        for (map<uint64_t, LayerChunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+            if (it->second->used == frame) continue;
+            if (oldest == chunks.end() || frame - it->second->used > frame - oldest->second->used) oldest = it;
+        }
+        if (oldest == chunks.end()) break;
+
+        LayerChunk *chunk = oldest->second;
+        memory -= (size_t)LAYERCACHE_PIXELS * LAYERCACHE_PIXELS * ((bitmap_color_depth(chunk->bmp) + 7) / 8);
+        destroy_bitmap(chunk->bmp);
+        delete chunk;
+        chunks.erase(oldest);
+    }
+    frame++;
+} // void LayerCache::endFrame()
+
+void LayerCache::freeCache() {
+    for (map<uint64_t, LayerChunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        destroy_bitmap(it->second->bmp);
+        delete it->second;
+    }
+    chunks.clear();
+    memory = 0;
+} // void LayerCache::freeCache()
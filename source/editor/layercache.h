@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    layercache.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the layer chunk cache.
+***
+*** This code keeps the layers of the map drawn in bitmaps of LAYERCACHE_SIZE
+*** x LAYERCACHE_SIZE tiles, so the canvas is put together from a few large
+*** blits instead of one per tile. A chunk is drawn again once the tiles in
+*** it are edited, the chunks off screen are let go when the cache gets over
+*** its budget.
+***
+*** \note This code uses the following libraries:
+***   -# Allegro 4.2.2, http://www.allegro.cc/
+******************************************************************************/
+
+#ifndef LAYERCACHE_H
+#define LAYERCACHE_H
+
+#include <allegro.h>
+
+#include <map>
+#include <vector>
+#include "mapData.h"
+#include "tileprops.h"
+#include "..\map\tilemap.h"
+#include "..\map\mapview.h"
+
+using namespace std;
+
+/** \def The size of a cached chunk, in tiles and in pixels
+**/
+//@{
+#define LAYERCACHE_SHIFT  3
+#define LAYERCACHE_SIZE   (1 << LAYERCACHE_SHIFT)
+#define LAYERCACHE_PIXELS (LAYERCACHE_SIZE * TILESIZE)
+//@}
+
+/** \struct LayerChunk layercache.h "src\editor\layercache.h"
+*** \brief The tiles of one layer from (cx, cy) * LAYERCACHE_SIZE on, drawn
+***        over the mask color so the chunk is blitted masked like a tile.
+***        Like a tile, it's blitted plain if it's opaque and not at all if
+***        it's transparent
+**/
+typedef struct LayerChunk {
+    int lay, cx, cy;
+    BITMAP *bmp;
+    bool valid;         //!< The bitmap shows the tiles as they are
+    short opacity;      //!< TILE_OPAQUE, TILE_MASKED or TILE_TRANSPARENT, see TileProps
+    unsigned int used;  //!< The last frame it was drawn on, see LayerCache::endFrame()
+} LayerChunk;
+
+/** \class LayerCache layercache.h "src\editor\layercache.h"
+*** \brief This class keeps the layers of the map pre-drawn, a chunk at a time
+**/
+class LayerCache {
+public:
+    LayerCache();
+    ~LayerCache();
+
+    /** \name setBudget()
+    *** \brief How much memory the chunk bitmaps may take, in MB. The chunks
+    ***        drawn on the current frame are kept even over the budget
+    **/
+    void setBudget(int mb) { budget = (size_t)mb * 1024 * 1024; }
+
+    /** \name Invalidation
+    *** \brief The chunks holding the tiles x1, y1 to x2, y2 of lay, every
+    ***        chunk of lay, or every chunk, are drawn again when next used.
+    ***        Whatever edits the tiles has to call one of these
+    **/
+    //@{
+    void invalidate(int lay, int x1, int y1, int x2, int y2);
+    void invalidateLayer(int lay);
+    void invalidateAll();
+
+    //! Goes up every time some of lay is invalidated, for what's drawn from the cache to tell it's out of date
+    unsigned int getVersion(int lay) { return all_version + (lay < (int)versions.size() ? versions[lay] : 0); }
+    //@}
+
+    /** \name draw()
+    *** \brief Draws the w x h tiles of lay from x, y on at px, py on bmp,
+    ***        drawing the chunks they're in first if they aren't valid
+    *** \param gfx The datafile holding the tilesets
+    *** \param props What gfx was classified as, picks how each tile is drawn
+    **/
+    void draw(BITMAP *bmp, TileMap &tiles, DATAFILE *gfx, const TileProps &props, int lay, int x, int y, int w, int h, int px, int py);
+
+    /** \name endFrame()
+    *** \brief Lets go of the chunks drawn longest ago, as long as the cache
+    ***        is over its budget
+    **/
+    void endFrame();
+
+    /** \name freeCache()
+    *** \brief Destroys every chunk bitmap
+    **/
+    void freeCache();
+private:
+    map<uint64_t, LayerChunk*> chunks;
+    size_t budget;      //!< Bytes the chunk bitmaps may take
+    size_t memory;      //!< Bytes they take
+    unsigned int frame;
+
+    /** See getVersion() **/
+    //@{
+    vector<unsigned int> versions;
+    unsigned int all_version;
+    void bumpVersion(int lay);
+    //@}
+
+    LayerChunk *getChunk(TileMap &tiles, DATAFILE *gfx, const TileProps &props, int lay, int cx, int cy);
+    void renderChunk(LayerChunk *chunk, TileMap &tiles, DATAFILE *gfx, const TileProps &props);
+
+    static uint64_t chunkKey(int lay, int cx, int cy) {
+        return ((uint64_t)lay << 56) | ((uint64_t)(cx & 0xFFFFFFF) << 28) | (uint64_t)(cy & 0xFFFFFFF);
+    }
+};
+
+#endif // LAYERCACHE_H
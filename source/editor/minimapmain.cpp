@@ -79,7 +79,7 @@ void MinimapMain::updateMiniMapCoords() {
 }
 
 void MinimapMain::drawMiniMap(BITMAP *bmp) {
-    int i,j, l;
+    int i,j, l, n;
     int val, ts;
     int x,y;
     int r, g, b, color;
@@ -89,20 +89,54 @@ void MinimapMain::drawMiniMap(BITMAP *bmp) {
     rectfill(bmp, minimap_x, minimap_y, minimap_x+editor.mapWidth/aux_resize, minimap_y+editor.mapHeight/aux_resize, makecol(0, 0, 0));
 
     for (l = 0; l < editor.layers; l++) {
-        for (i = 0; i < editor.mapWidth; i++) {
-            for (j = 0; j < editor.mapHeight; j++) {
-                val = editor.Map[l][j][i].index;
-                ts = editor.Map[l][j][i].tileset;
-
-                x = val / TILESIZE;
-                y = val % TILESIZE;
-                if ((color = getpixel(mini, ts*8+x, y)) != makecol(255, 0, 255)) {
-                    r = getr(color);
-                    g = getg(color);
-                    b = getb(color);
-                    putpixel(bmp, minimap_x+i/aux_resize, minimap_y+j/aux_resize, makecol(r, g, b));
+        // Whatever hasn't been painted on this layer is the fill tile,
+        // plot it in one go instead of tile by tile
+        const Tile &fill = editor.Map.getFill(l);
+        if (editor.tileProps.getOpacity(fill) != TILE_TRANSPARENT &&
+            (color = getpixel(mini, fill.getTileset()*8+fill.getIndex()/TILESIZE, fill.getIndex()%TILESIZE)) != makecol(255, 0, 255)) {
+            rectfill(bmp, minimap_x, minimap_y, minimap_x+(editor.mapWidth-1)/aux_resize,
+                     minimap_y+(editor.mapHeight-1)/aux_resize, color);
+        }
+
+        for (n = 0; n < editor.Map.getChunkCount(l); n++) {
+            TileChunk *chunk = editor.Map.getChunkAt(l, n);
+            const Tile *tile = chunk->tiles;
+
+            // Don't page chunks back in just for the minimap, plot the ones
+            // on disk in the colour of the tile sampled when they went out
+            if (tile == NULL) {
+                val = chunk->summary.getIndex();
+                ts = chunk->summary.getTileset();
+                if (editor.tileProps.getOpacity(ts, val) != TILE_TRANSPARENT &&
+                    (color = getpixel(mini, ts*8+val/TILESIZE, val%TILESIZE)) != makecol(255, 0, 255)) {
+                    x = chunk->cx*CHUNK_SIZE;
+                    y = chunk->cy*CHUNK_SIZE;
+                    rectfill(bmp, minimap_x+x/aux_resize, minimap_y+y/aux_resize,
+                             minimap_x+MIN(x+CHUNK_SIZE, editor.mapWidth)/aux_resize-1,
+                             minimap_y+MIN(y+CHUNK_SIZE, editor.mapHeight)/aux_resize-1, color);
                 }
+                continue;
+            }
+
+            for (j = 0; j < CHUNK_SIZE; j++) {
+                for (i = 0; i < CHUNK_SIZE; i++, tile++) {
+                    x = chunk->cx*CHUNK_SIZE + i;
+                    y = chunk->cy*CHUNK_SIZE + j;
+                    if (x >= editor.mapWidth || y >= editor.mapHeight) continue;
 
+                    val = tile->getIndex();
+                    ts = tile->getTileset();
+
+                    // Nothing of a transparent tile would show
+                    if (editor.tileProps.getOpacity(ts, val) == TILE_TRANSPARENT) continue;
+
+                    if ((color = getpixel(mini, ts*8+val/TILESIZE, val%TILESIZE)) != makecol(255, 0, 255)) {
+                        r = getr(color);
+                        g = getg(color);
+                        b = getb(color);
+                        putpixel(bmp, minimap_x+x/aux_resize, minimap_y+y/aux_resize, makecol(r, g, b));
+                    }
+                }
             }
         }
     }
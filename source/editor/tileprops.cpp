@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    tileprops.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the tile property table.
+******************************************************************************/
+
+#include "tileprops.h"
+
+TileProps::TileProps() {
+} // TileProps::TileProps()
+
+TileProps::~TileProps() {
+} // TileProps::~TileProps()
+
+// A tile is looked at until it has both kinds of pixels, which for most of
+// them is only a row or two
+void TileProps::classify(DATAFILE *gfx) {
+    opacity.assign(TILEPROPS_TILESETS * TILEPROPS_TILES, TILE_TRANSPARENT);
+    if (gfx == NULL) return;
+
+    for (int ts = 0; ts < TILEPROPS_TILESETS && gfx[TILES1 + ts].type != DAT_END; ts++) {
+        if (gfx[TILES1 + ts].type != DAT_BITMAP) continue;
+
+        BITMAP *bmp = (BITMAP*)gfx[TILES1 + ts].dat;
+        int mask = bitmap_mask_color(bmp);
+
+        for (int index = 0; index < TILEPROPS_TILES; index++) {
+            int x = TILESIZE * (index / TILESIZE);
+            int y = TILESIZE * (index % TILESIZE);
+            if (x >= bmp->w || y >= bmp->h) continue;
+
+            // Whatever is past the edges of the tileset is drawn as if masked
+            bool masked = (x + TILESIZE > bmp->w || y + TILESIZE > bmp->h);
+            bool solid = false;
+
+            for (int j = 0; j < TILESIZE && y+j < bmp->h && !(masked && solid); j++) {
+                for (int i = 0; i < TILESIZE && x+i < bmp->w; i++) {
+                    if (getpixel(bmp, x+i, y+j) == mask) masked = true;
+                    else solid = true;
+                }
+            }
+
+            if (!solid) opacity[ts * TILEPROPS_TILES + index] = TILE_TRANSPARENT;
+            else if (masked) opacity[ts * TILEPROPS_TILES + index] = TILE_MASKED;
+            else opacity[ts * TILEPROPS_TILES + index] = TILE_OPAQUE;
+        }
+    }
+} // void TileProps::classify(DATAFILE *gfx)
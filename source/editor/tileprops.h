@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    tileprops.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the tile property table.
+***
+*** This code looks at every tile of the tilesets once, when mapData.dat is
+*** loaded, and keeps what it takes to draw each: a tile without mask pixels
+*** is drawn with a plain blit, one made only of them isn't drawn at all.
+***
+*** \note This code uses the following libraries:
+***   -# Allegro 4.2.2, http://www.allegro.cc/
+******************************************************************************/
+
+#ifndef TILEPROPS_H
+#define TILEPROPS_H
+
+#include <allegro.h>
+
+#include <vector>
+#include "mapData.h"
+#include "..\map\tilemap.h"
+#include "..\map\mapview.h"
+
+using namespace std;
+
+/** \def How a tile is drawn, see TileProps::getOpacity()
+**/
+//@{
+#define TILE_OPAQUE      0 //!< No mask pixels, blit() it
+#define TILE_MASKED      1 //!< Some mask pixels, masked_blit() it
+#define TILE_TRANSPARENT 2 //!< Nothing but mask pixels, or nothing there, skip it
+//@}
+
+/** \def The size of the table, every tileset and index a Tile can hold
+**/
+//@{
+#define TILEPROPS_TILESETS ((int)(TILE_TILESET_MASK >> TILE_TILESET_SHIFT) + 1)
+#define TILEPROPS_TILES    ((int)(TILE_INDEX_MASK >> TILE_INDEX_SHIFT) + 1)
+//@}
+
+/** \class TileProps tileprops.h "src\editor\tileprops.h"
+*** \brief This class holds the properties of every tile of the tilesets
+**/
+class TileProps {
+public:
+    TileProps();
+    ~TileProps();
+
+    /** \name classify()
+    *** \brief Looks at every tile of the tilesets in gfx, from TILES1 up to
+    ***        the end of the datafile. Tiles of tilesets it doesn't have, or
+    ***        past the edges of theirs, are transparent
+    **/
+    void classify(DATAFILE *gfx);
+
+    /** \name getOpacity()
+    *** \brief Returns TILE_OPAQUE, TILE_MASKED or TILE_TRANSPARENT
+    **/
+    int getOpacity(int tileset, int index) const {
+        if (opacity.empty()) return TILE_MASKED;
+        return opacity[tileset * TILEPROPS_TILES + index];
+    }
+    int getOpacity(const Tile &tile) const { return getOpacity(tile.getTileset(), tile.getIndex()); }
+private:
+    vector<unsigned char> opacity; //!< One per tile, tileset after tileset
+};
+
+#endif // TILEPROPS_H
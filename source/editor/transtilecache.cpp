@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    transtilecache.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the translucent tile cache.
+******************************************************************************/
+
+#include "transtilecache.h"
+
+TransTileCache::TransTileCache() {
+    budget = 8 * 1024 * 1024;
+    memory = 0;
+    tile_size = 0;
+} // TransTileCache::TransTileCache()
+
+TransTileCache::~TransTileCache() {
+} // TransTileCache::~TransTileCache()
+
+BITMAP *TransTileCache::getTile(DATAFILE *gfx, int tileset, int index) {
+    // mapData.dat ends after TILES7, a tileset past it has nothing to draw
+    for (int ts = 0; ts <= tileset; ts++) {
+        if (gfx[TILES1 + ts].type == DAT_END) return NULL;
+    }
+
+    int key = (tileset << 12) | index;
+
+    // Drawn before, move it to the front
+    map<int, list<TransTile>::iterator>::iterator it = keys.find(key);
+    if (it != keys.end()) {
+        tiles.splice(tiles.begin(), tiles, it->second);
+        return it->second->bmp;
+    }
+
+    // Otherwise reuse the bitmap of the tile drawn longest ago if the cache
+    // is full, or make a new one
+    TransTile tile;
+    tile.key = key;
+
+    if (!tiles.empty() && memory + tile_size > budget) {
+        tile.bmp = tiles.back().bmp;
+        keys.erase(tiles.back().key);
+        tiles.pop_back();
+    } else {
+        tile.bmp = create_bitmap(TILESIZE, TILESIZE);
+        if (tile.bmp == NULL) return NULL;
+        tile_size = (size_t)TILESIZE * TILESIZE * ((bitmap_color_depth(tile.bmp) + 7) / 8);
+        memory += tile_size;
+    }
+
+    // The tile over the medium gray, like drawTransLayer() used to make it
+    // every time
+    clear_to_color(tile.bmp, makecol(128,128,128));
+    masked_blit((BITMAP*)gfx[TILES1 + tileset].dat, tile.bmp, TILESIZE * (index / TILESIZE), TILESIZE * (index % TILESIZE),
+                0, 0, TILESIZE, TILESIZE);
+
+    tiles.push_front(tile);
+    keys[key] = tiles.begin();
+    return tile.bmp;
+} // BITMAP *TransTileCache::getTile(DATAFILE *gfx, int tileset, int index)
+
+void TransTileCache::freeCache() {
+    for (list<TransTile>::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        destroy_bitmap(it->bmp);
+    }
+    tiles.clear();
+    keys.clear();
+    memory = 0;
+} // void TransTileCache::freeCache()
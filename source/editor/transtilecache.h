@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    transtilecache.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the translucent tile cache.
+***
+*** This code keeps the tiles drawTransLayer() blends ready made: the tile
+*** over the medium gray it's blended with, so a translucent tile is a
+*** single draw_trans_sprite(). They're made the first time they're drawn
+*** and the ones drawn longest ago are let go when the cache is full.
+***
+*** \note This code uses the following libraries:
+***   -# Allegro 4.2.2, http://www.allegro.cc/
+******************************************************************************/
+
+#ifndef TRANSTILECACHE_H
+#define TRANSTILECACHE_H
+
+#include <allegro.h>
+
+#include <list>
+#include <map>
+#include "mapData.h"
+#include "..\map\mapview.h"
+
+using namespace std;
+
+/** \struct TransTile transtilecache.h "src\editor\transtilecache.h"
+*** \brief A tile of the cache, key is made of its tileset and index
+**/
+typedef struct TransTile {
+    int key;
+    BITMAP *bmp;
+} TransTile;
+
+/** \class TransTileCache transtilecache.h "src\editor\transtilecache.h"
+*** \brief This class keeps the translucent tiles, most recently drawn first
+**/
+class TransTileCache {
+public:
+    TransTileCache();
+    ~TransTileCache();
+
+    /** \name setBudget()
+    *** \brief How much memory the tiles may take, in MB
+    **/
+    void setBudget(int mb) { budget = (size_t)mb * 1024 * 1024; }
+
+    /** \name getTile()
+    *** \brief Returns the tile index of tileset over medium gray, ready to
+    ***        be drawn with draw_trans_sprite(). It's only good until the
+    ***        next call, which may reuse its BITMAP. NULL if the tileset
+    ***        isn't in the datafile
+    *** \param gfx The datafile holding the tilesets
+    **/
+    BITMAP *getTile(DATAFILE *gfx, int tileset, int index);
+
+    /** \name freeCache()
+    *** \brief Destroys every tile
+    **/
+    void freeCache();
+private:
+    list<TransTile> tiles;                       //!< Most recently drawn first
+    map<int, list<TransTile>::iterator> keys;   //!< The tiles by key
+    size_t budget;                               //!< Bytes the tiles may take
+    size_t memory;                               //!< Bytes they take
+    size_t tile_size;                            //!< Bytes one of them takes
+};
+
+#endif // TRANSTILECACHE_H
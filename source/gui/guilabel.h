@@ -94,6 +94,11 @@ public:
     string getLabelText(short label_id) {
         return getLabelByID(label_id)->label;
     }
+    void setLabelText(short label_id, string label) {
+        LABEL_MASK *thisLabel = getLabelByID(label_id);
+        thisLabel->label = label;
+        thisLabel->w = text_length(font, label.c_str())+10;
+    }
     short getLabelID(short label_id)     {
         return getLabelByID(label_id)->ID;
     }
@@ -33,7 +33,7 @@ GuiMain::GuiMain() {
     panelState = STATE_OPTIONS;
     currentLayer = LAYER_ONE;
 
-    grid = collision = quit = false;
+    grid = collision = changes = quit = false;
     layers = alpha = true;
 
     brush = BRUSH_DRAW;
@@ -229,6 +229,12 @@ void GuiMain::loadInterface() {
     checkbox.addCheckbox(check_x, TILESIZE*20+64, 20,18, "Enable alpha", 0, CHECKBOX_CHECKED);
     checkboxAlpha = checkbox.getLastCheckboxID();
 
+    // Outlines what changed since the map was last loaded or saved, on the
+    // current layer and in the collision
+    check_x += 35+text_length(font, "Changes");
+    checkbox.addCheckbox(check_x, TILESIZE*20+64, 20,18, "Changes", 0, CHECKBOX_UNCHECKED);
+    checkboxChanges = checkbox.getLastCheckboxID();
+
     // The brush type
     // Note: This will get a tab of it's own... soon
     label.addLabel(button.getButtonPosX(buttonNewMap), TILESIZE*20+94, makecol(0,0,0), "Brush type:");
@@ -292,6 +298,11 @@ void GuiMain::loadInterface() {
     button.addButton(button_x, TILESIZE * 20 + 4, "Quit");
     buttonQuit = button.getLastButtonID();
 
+    // Background save and load status, right after the tabs. Only shown once
+    // a map was saved or while one is loading
+    label.addLabel(button_x + button.getButtonSizeW(buttonQuit) + 10, TILESIZE * 20 + 4, makecol(0,0,0), "");
+    labelFileStatus = label.getLastLabelID();
+
     // Object selector option
     // Scroll up
     // Todo: Fix the scrollbar code, use that
@@ -331,6 +342,44 @@ void GuiMain::updateInterface() {
     button.showButton(buttonScrollDown);
     button.showButton(buttonScrollUp);
 
+    // The save runs in the background, keep its progress in sight
+    switch (editor.getSaveState()) {
+    case SAVE_RUNNING: {
+        label.setLabelText(labelFileStatus, "Saving " + editor.getSaveName() + "...");
+        label.showLabel(labelFileStatus);
+        break;
+    }
+    case SAVE_DONE: {
+        label.setLabelText(labelFileStatus, "Saved " + editor.getSaveName());
+        label.showLabel(labelFileStatus);
+        break;
+    }
+    case SAVE_FAILED: {
+        label.setLabelText(labelFileStatus, "Couldn't save " + editor.getSaveName());
+        label.showLabel(labelFileStatus);
+        break;
+    }
+    }
+
+    // Whatever was wrong with the map stays up until another one is loaded,
+    // unless there's a save going on or failing
+    if (!editor.getLoadWarning().empty() && editor.getSaveState() != SAVE_RUNNING && editor.getSaveState() != SAVE_FAILED) {
+        label.setLabelText(labelFileStatus, editor.getCurrentMap() + ": " + editor.getLoadWarning());
+        label.showLabel(labelFileStatus);
+    }
+
+    // Tiles the swap file lost stay lost, every save fails from then on
+    if (editor.Map.hasIOError()) {
+        label.setLabelText(labelFileStatus, "Can't read the swap file, " + editor.getCurrentMap() + " won't save");
+        label.showLabel(labelFileStatus);
+    }
+
+    // Same for a map coming in, drawInterface() adds a progress bar
+    if (editor.isLoading()) {
+        label.setLabelText(labelFileStatus, "Loading " + editor.getCurrentMap() + "...");
+        label.showLabel(labelFileStatus);
+    }
+
     // Decide what to show taking the panelState variable into account
     switch (panelState) {
     case STATE_OPTIONS: {
@@ -352,6 +401,7 @@ void GuiMain::updateInterface() {
         label.showLabel(labelDisplay);
 
         checkbox.showCheckbox(checkboxAlpha);
+        checkbox.showCheckbox(checkboxChanges);
         checkbox.showCheckbox(checkboxCollision);
         checkbox.showCheckbox(checkboxGrid);
         checkbox.showCheckbox(checkboxLayers);
@@ -540,7 +590,7 @@ void GuiMain::updateInterface() {
                 minimap.updateMiniMapCoords();
 
                 currentLayer = LAYER_ONE;
-                grid = collision = quit = false;
+                grid = collision = changes = quit = false;
                 layers = alpha = true;
                 brush = BRUSH_DRAW;
                 gui_x = gui_y = 0;
@@ -556,20 +606,18 @@ void GuiMain::updateInterface() {
 
         if ( button_pressed == buttonSaveMapOK ) {
             string tmp_name = field.getFieldText(fieldSaveName);
-            if (editor.saveMap(tmp_name) == -1) {
+            // The map is written in the background, the status label tells
+            // when it's done
+            if (editor.saveMapAsync(tmp_name) == -1) {
                 alert("It wasn't me!", "Just couldn't save the map", "Please try again", "#%@$%... OK", NULL, 0, 0);
-                field.clearFieldText(fieldSaveName);
-            } else {
-                editor.saveMap(tmp_name);
-                if (alert("Map saved!", "Do you want to edit this map", "or the newly saved one?", "Oldies but goldies", "Old out, new in!", 0, 0) == 2) {
-                    if (editor.loadMap(tmp_name) == -1) {
-                        alert("Unlucky guy you are...", "I couldn't load the newly saved map, you named it", tmp_name.c_str(), "Hmmm...", NULL, 0, 0);
-                    } else {
-                        minimap.updateMiniMapCoords();
-                    }
+            } else if (tmp_name != editor.getCurrentMap()) {
+                // The new file holds the very map in memory, so switching to
+                // it needs no loading
+                if (alert("Saving away!", "Do you want to edit this map", "or the newly saved one?", "Oldies but goldies", "Old out, new in!", 0, 0) == 2) {
+                    editor.setCurrentMap(tmp_name);
                 }
-                field.clearFieldText(fieldSaveName);
             }
+            field.clearFieldText(fieldSaveName);
         }
         if ( button_pressed == buttonPPause ) {
             editor.emitter_state = PAUSE_PARTICLES;
@@ -649,6 +697,7 @@ void GuiMain::updateInterface() {
     if (!preview) {
         grid = checkbox.getCheckboxState(checkboxGrid);
         collision = checkbox.getCheckboxState(checkboxCollision);
+        changes = checkbox.getCheckboxState(checkboxChanges);
     }
     preview = checkbox.getCheckboxState(checkboxPreview);
     layers = checkbox.getCheckboxState(checkboxLayers);
@@ -692,6 +741,18 @@ void GuiMain::drawInterface(BITMAP *bmp) {
 */
     minimap.drawMiniMap(bmp);
 
+    // How much of the map loading is in, along the bottom of the settings frame
+    if (editor.isLoading()) {
+        int bar_x1 = 128 + TILESIZE / 2 + 8, bar_x2 = 768 - 8;
+        int bar_y1 = TILESIZE * 19 + TILESIZE / 2 + 128 + TILESIZE / 2 - 14, bar_y2 = bar_y1 + 6;
+        int progress = editor.getLoadProgress();
+
+        rect(bmp, bar_x1, bar_y1, bar_x2, bar_y2, makecol(0,0,0));
+        if (progress > 0) {
+            rectfill(bmp, bar_x1 + 1, bar_y1 + 1, bar_x1 + 1 + (bar_x2 - bar_x1 - 2) * progress / 100, bar_y2 - 1, makecol(0,0,255));
+        }
+    }
+
     button.drawButtons(bmp);
     label.drawLabels(bmp);
     field.drawFields(bmp);
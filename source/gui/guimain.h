@@ -94,6 +94,7 @@ class GuiMain
         }
         bool getGrid() { return grid; }
         bool getOtherGrids() { return collision; }
+        bool getChanges() { return changes; }
         void setCollision(short state) { checkbox.setCheckboxState(checkboxCollision, state); }
         bool getLayers() { return layers; }
         bool getPreview() { return preview; }
@@ -108,7 +109,7 @@ class GuiMain
     private:
         short panelState;
         short currentLayer;
-        bool grid, collision, layers, quit;
+        bool grid, collision, changes, layers, quit;
         short brush;
         bool preview, alpha;
 
@@ -133,6 +134,7 @@ class GuiMain
               frameAll,
               checkboxPreview,
               checkboxAlpha,
+              checkboxChanges,
               buttonScrollUp,
               buttonScrollDown,
               buttonNext,
@@ -169,7 +171,9 @@ class GuiMain
               buttonPPlay,
               buttonPAdd,
               buttonFAdd,
-              labelPOptions
+              labelPOptions,
+
+              labelFileStatus
               ;
 
         short mouse_frame;
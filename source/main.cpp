@@ -35,6 +35,41 @@ DataFormat convert;
 
 volatile int allmap_exit = FALSE;
 
+/** \def How long an idle frame sleeps, in milliseconds
+**/
+#define IDLE_REST 10
+
+/** What the input looked like the frame before, see inputChanged() **/
+//@{
+int last_mouse_x = -1, last_mouse_y = -1, last_mouse_z = 0, last_mouse_b = 0;
+char last_key[KEY_MAX];
+//@}
+
+/** \name inputChanged()
+*** \brief Tells wheter the mouse or the keyboard did anything since the
+***        last call. held is set if a button or key is down
+**/
+bool inputChanged(bool &held) {
+    bool changed = keypressed();
+
+    if (mouse_x != last_mouse_x || mouse_y != last_mouse_y || mouse_z != last_mouse_z || mouse_b != last_mouse_b) {
+        changed = true;
+    }
+    held = (mouse_b != 0);
+
+    for (int k = 0; k < KEY_MAX; k++) {
+        if (key[k] != last_key[k]) changed = true;
+        if (key[k]) held = true;
+        last_key[k] = key[k];
+    }
+
+    last_mouse_x = mouse_x;
+    last_mouse_y = mouse_y;
+    last_mouse_z = mouse_z;
+    last_mouse_b = mouse_b;
+    return changed;
+}
+
 void close_button_handler(void) {
     allmap_exit = TRUE;
 
@@ -71,8 +106,18 @@ int main(void) {
     minimap.initMinimap();
     minimap.updateMiniMapCoords();
 
+    // The parts of the screen a frame changed, when only the canvas did
+    vector<CanvasRect> rects;
+    int last_frame = -1, cursor_x = 0, cursor_y = 0;
+    bool last_busy = true;
+
     while (!allmap_exit) {
         show_mouse(NULL);
+
+        int wheel = last_mouse_z;
+        bool held;
+        bool changed = inputChanged(held);
+
         gui.updateInterface();
         allmap_exit = gui.getQuit();
 
@@ -89,15 +134,47 @@ int main(void) {
             editor.drawEmitterGrid();
         }
 
+        if (gui.getChanges()) editor.drawChanges();
+
+        // An idle editor draws nothing and gives the processor away. The
+        // frame after a load or save draws once more, to show it's done
+        bool busy = editor.isBusy();
+        if (!changed && !busy && !last_busy && !editor.isCanvasDirty()) {
+            rest(IDLE_REST);
+            continue;
+        }
+
+        // If only the pointer moved over the canvas, or the canvas changed
+        // under it, the rest of the screen is the same as it was
+        int frame = gui.getMouseFrame();
+        bool partial = !held && !busy && !last_busy && frame == MAIN_FRAME && last_frame == MAIN_FRAME &&
+                       !gui.isFieldActive() && last_mouse_z == wheel;
+        last_frame = frame;
+        last_busy = busy;
+
         editor.renderMap(buffer);
         tileset.drawTileset(buffer, 768, 32, 256, TILESIZE*19+TILESIZE/2);
 
         gui.drawInterface(buffer);
 
         //show_mouse(buffer);
+        int last_cursor_x = cursor_x, last_cursor_y = cursor_y;
+        cursor_x = mouse_x;
+        cursor_y = mouse_y;
         mouse.draw(buffer);
         acquire_screen();
-        masked_blit(buffer, screen, 0, 0, 0, 0, SCREEN_W, SCREEN_H);
+        if (partial) {
+            rects.clear();
+            editor.getCanvasRects(rects);
+            for (unsigned int r = 0; r < rects.size(); r++) {
+                masked_blit(buffer, screen, rects[r].x1, rects[r].y1, rects[r].x1, rects[r].y1,
+                            rects[r].x2-rects[r].x1+1, rects[r].y2-rects[r].y1+1);
+            }
+            masked_blit(buffer, screen, last_cursor_x, last_cursor_y, last_cursor_x, last_cursor_y, 16, 16);
+            masked_blit(buffer, screen, cursor_x, cursor_y, cursor_x, cursor_y, 16, 16);
+        } else {
+            masked_blit(buffer, screen, 0, 0, 0, 0, SCREEN_W, SCREEN_H);
+        }
         release_screen();
 
         clear_to_color(buffer, makecol(255, 255, 255));
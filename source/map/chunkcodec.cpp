@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    chunkcodec.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the chunk codecs.
+******************************************************************************/
+
+#include "chunkcodec.h"
+
+#include <string.h>
+
+#define CHUNK_BYTES (CHUNK_TILES * sizeof(Tile))
+
+/** Stream helpers, variable length counts and little endian words **/
+//@{
+static void putCount(vector<unsigned char> &out, uint32_t n) {
+    while (n >= 0x80) {
+        out.push_back((unsigned char)(n | 0x80));
+        n >>= 7;
+    }
+    out.push_back((unsigned char)n);
+}
+
+static bool getCount(const unsigned char *&in, const unsigned char *end, uint32_t &n) {
+    n = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (in == end) return false;
+        unsigned char b = *in++;
+        n |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static void putWord(vector<unsigned char> &out, uint32_t w) {
+    out.push_back((unsigned char)w);
+    out.push_back((unsigned char)(w >> 8));
+    out.push_back((unsigned char)(w >> 16));
+    out.push_back((unsigned char)(w >> 24));
+}
+
+static bool getWord(const unsigned char *&in, const unsigned char *end, uint32_t &w) {
+    if (end - in < 4) return false;
+    w = (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+    in += 4;
+    return true;
+}
+//@}
+
+/** RAW, the tiles as they are **/
+//@{
+static void encodeRaw(const Tile *tiles, vector<unsigned char> &out) {
+    const unsigned char *p = (const unsigned char*)tiles;
+    out.insert(out.end(), p, p + CHUNK_BYTES);
+}
+
+static bool decodeRaw(const unsigned char *in, size_t size, Tile *tiles) {
+    if (size != CHUNK_BYTES) return false;
+    memcpy(tiles, in, CHUNK_BYTES);
+    return true;
+}
+//@}
+
+/** RLE and DELTA share the run coding, (count, word) pairs over a word
+*** stream. DELTA runs over the differences between neighbouring tiles.
+**/
+//@{
+static void encodeRuns(const uint32_t *words, vector<unsigned char> &out) {
+    int i = 0;
+    while (i < CHUNK_TILES) {
+        int run = 1;
+        while (i + run < CHUNK_TILES && words[i + run] == words[i]) run++;
+        putCount(out, run);
+        putWord(out, words[i]);
+        i += run;
+    }
+}
+
+static bool decodeRuns(const unsigned char *in, size_t size, uint32_t *words) {
+    const unsigned char *end = in + size;
+    int i = 0;
+    while (i < CHUNK_TILES) {
+        uint32_t run, word;
+        if (!getCount(in, end, run) || !getWord(in, end, word)) return false;
+        if (run == 0 || run > (uint32_t)(CHUNK_TILES - i)) return false;
+        while (run--) words[i++] = word;
+    }
+    return in == end;
+}
+
+static void encodeRle(const Tile *tiles, vector<unsigned char> &out) {
+    encodeRuns(&tiles[0].bits, out);
+}
+
+static bool decodeRle(const unsigned char *in, size_t size, Tile *tiles) {
+    return decodeRuns(in, size, &tiles[0].bits);
+}
+
+static void encodeDelta(const Tile *tiles, vector<unsigned char> &out) {
+    uint32_t deltas[CHUNK_TILES];
+    uint32_t prev = 0;
+    for (int i = 0; i < CHUNK_TILES; i++) {
+        deltas[i] = tiles[i].bits - prev;
+        prev = tiles[i].bits;
+    }
+    encodeRuns(deltas, out);
+}
+
+static bool decodeDelta(const unsigned char *in, size_t size, Tile *tiles) {
+    if (!decodeRuns(in, size, &tiles[0].bits)) return false;
+    uint32_t prev = 0;
+    for (int i = 0; i < CHUNK_TILES; i++) {
+        tiles[i].bits += prev;
+        prev = tiles[i].bits;
+    }
+    return true;
+}
+//@}
+
+/** LZ, byte oriented LZ77. Every sequence is a token (literal count in the
+*** high nibble, match length - LZ_MIN_MATCH in the low one, 15 meaning a
+*** count follows), the literals and a 16-bit match offset. The last
+*** sequence has literals only.
+**/
+//@{
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+static inline uint32_t lzHash(const unsigned char *p) {
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void putLength(vector<unsigned char> &out, uint32_t n) {
+    if (n >= 15) putCount(out, n - 15);
+}
+
+static void encodeLz(const Tile *tiles, vector<unsigned char> &out) {
+    const unsigned char *src = (const unsigned char*)tiles;
+    const int size = (int)CHUNK_BYTES;
+    int table[1 << LZ_HASH_BITS];
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+
+    int anchor = 0, pos = 0;
+    while (pos + LZ_MIN_MATCH <= size) {
+        uint32_t h = lzHash(src + pos);
+        int ref = table[h];
+        table[h] = pos;
+
+        if (ref < 0 || pos - ref > 0xFFFF || memcmp(src + ref, src + pos, LZ_MIN_MATCH) != 0) {
+            pos++;
+            continue;
+        }
+
+        int len = LZ_MIN_MATCH;
+        while (pos + len < size && src[ref + len] == src[pos + len]) len++;
+
+        uint32_t literals = pos - anchor;
+        uint32_t match = len - LZ_MIN_MATCH;
+        out.push_back((unsigned char)(((literals < 15 ? literals : 15) << 4) | (match < 15 ? match : 15)));
+        putLength(out, literals);
+        out.insert(out.end(), src + anchor, src + pos);
+        out.push_back((unsigned char)(pos - ref));
+        out.push_back((unsigned char)((pos - ref) >> 8));
+        putLength(out, match);
+
+        pos += len;
+        anchor = pos;
+    }
+
+    uint32_t literals = size - anchor;
+    out.push_back((unsigned char)((literals < 15 ? literals : 15) << 4));
+    putLength(out, literals);
+    out.insert(out.end(), src + anchor, src + size);
+}
+
+static bool decodeLz(const unsigned char *in, size_t size, Tile *tiles) {
+    unsigned char *dst = (unsigned char*)tiles;
+    const unsigned char *end = in + size;
+    size_t pos = 0;
+
+    while (in < end) {
+        unsigned char token = *in++;
+        uint32_t literals = token >> 4, match = token & 15, extra;
+
+        if (literals == 15) {
+            if (!getCount(in, end, extra)) return false;
+            literals += extra;
+        }
+        if (literals > (size_t)(end - in) || literals > CHUNK_BYTES - pos) return false;
+        memcpy(dst + pos, in, literals);
+        in += literals;
+        pos += literals;
+
+        // The last sequence ends the stream
+        if (in == end) break;
+
+        if (end - in < 2) return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (match == 15) {
+            if (!getCount(in, end, extra)) return false;
+            match += extra;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > pos || match > CHUNK_BYTES - pos) return false;
+
+        // Overlapping copies repeat the pattern, byte by byte on purpose
+        for (uint32_t i = 0; i < match; i++, pos++) dst[pos] = dst[pos - offset];
+    }
+    return pos == CHUNK_BYTES;
+}
+//@}
+
+static const ChunkCodec codecs[CODEC_COUNT] = {
+    { CODEC_RAW,   "raw",   encodeRaw,   decodeRaw },
+    { CODEC_RLE,   "rle",   encodeRle,   decodeRle },
+    { CODEC_DELTA, "delta", encodeDelta, decodeDelta },
+    { CODEC_LZ,    "lz",    encodeLz,    decodeLz }
+};
+
+const ChunkCodec *getCodec(int id) {
+    if (id < 0 || id >= CODEC_COUNT) return NULL;
+    return &codecs[id];
+} // const ChunkCodec *getCodec(int id)
+
+int encodeChunk(const Tile *tiles, vector<unsigned char> &out) {
+    vector<unsigned char> trial;
+    int best = CODEC_RAW;
+    size_t best_size = CHUNK_BYTES / 2 + 1;
+
+    out.clear();
+    for (int id = CODEC_RAW + 1; id < CODEC_COUNT; id++) {
+        trial.clear();
+        codecs[id].encode(tiles, trial);
+        if (trial.size() < best_size) {
+            best = id;
+            best_size = trial.size();
+            out.swap(trial);
+        }
+    }
+
+    if (best == CODEC_RAW) encodeRaw(tiles, out);
+    return best;
+} // int encodeChunk(const Tile *tiles, vector<unsigned char> &out)
+
+bool decodeChunk(int codec, const unsigned char *in, size_t size, Tile *tiles) {
+    const ChunkCodec *c = getCodec(codec);
+    if (c == NULL) return false;
+    return c->decode(in, size, tiles);
+} // bool decodeChunk(int codec, const unsigned char *in, size_t size, Tile *tiles)
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    chunkcodec.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the chunk codecs.
+***
+*** This code provides the encodings a map file chunk can be stored with.
+*** Every codec turns the CHUNK_TILES tiles of a chunk into a byte stream and
+*** back; the map writer tries them all and keeps the smallest.
+***   - RAW, the tiles as they are in memory, the only one that can be mapped
+***   - RLE, runs of the same tile
+***   - DELTA, runs of the same difference between neighbouring tiles, which
+***     catches objects, painted as rows of consecutive indexes
+***   - LZ, a small LZ77 for repeating patterns of tiles
+******************************************************************************/
+
+#ifndef CHUNKCODEC_H
+#define CHUNKCODEC_H
+
+#include <stddef.h>
+#include <vector>
+#include "tilemap.h"
+
+using namespace std;
+
+/** \def Codec identifiers, as stored in the chunk table
+**/
+//@{
+#define CODEC_RAW   0
+#define CODEC_RLE   1
+#define CODEC_DELTA 2
+#define CODEC_LZ    3
+#define CODEC_COUNT 4
+//@}
+
+/** \struct ChunkCodec chunkcodec.h "src\map\chunkcodec.h"
+*** \brief A codec: encode() appends the stream for a chunk's tiles to out,
+***        decode() rebuilds the tiles and fails on a malformed stream
+**/
+typedef struct ChunkCodec {
+    int id;
+    const char *name;
+    void (*encode)(const Tile *tiles, vector<unsigned char> &out);
+    bool (*decode)(const unsigned char *in, size_t size, Tile *tiles);
+} ChunkCodec;
+
+/** \name getCodec()
+*** \brief Returns the codec with the passed identifier, NULL if unknown
+**/
+const ChunkCodec *getCodec(int id);
+
+/** \name encodeChunk()
+*** \brief Encodes a chunk with every codec and keeps the smallest stream.
+***        A codec has to at least halve the chunk to be picked over RAW,
+***        less than that isn't worth losing the zero-copy mapping.
+*** \param out Receives the stream
+*** \return The codec used
+**/
+int encodeChunk(const Tile *tiles, vector<unsigned char> &out);
+
+/** \name decodeChunk()
+*** \brief Decodes a stream written by the passed codec
+*** \return false if the codec is unknown or the stream is malformed
+**/
+bool decodeChunk(int codec, const unsigned char *in, size_t size, Tile *tiles);
+
+#endif // CHUNKCODEC_H
@@ -0,0 +1,261 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    chunkpager.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the chunk pager.
+******************************************************************************/
+
+#include "chunkpager.h"
+#include "tilemap.h"
+
+#include <string.h>
+
+#define SLOT_BYTES (CHUNK_TILES * sizeof(Tile))
+
+// 64-bit seek, the swap file easily grows past 2GB
+static int seekSwap(FILE *file, int64_t pos) {
+#ifdef _WIN32
+    return fseeko64(file, pos, SEEK_SET);
+#else
+    return fseeko(file, (off_t)pos, SEEK_SET);
+#endif
+}
+
+ChunkPager::ChunkPager() {
+    lru_head = lru_tail = NULL;
+    resident = 0;
+    budget = 0;
+
+    swap = NULL;
+    next_slot = 0;
+    error = false;
+}
+
+ChunkPager::~ChunkPager() {
+    reset();
+    if (swap != NULL) {
+        fclose(swap);
+        remove(swap_path.c_str());
+    }
+}
+
+void ChunkPager::setBudget(size_t bytes, const string &swap_path) {
+    this->swap_path = swap_path;
+
+    if (bytes == 0) {
+        budget = 0;
+        return;
+    }
+
+    budget = (int)(bytes / SLOT_BYTES);
+    if (budget < PAGER_MIN_CHUNKS) budget = PAGER_MIN_CHUNKS;
+} // void ChunkPager::setBudget(size_t bytes, const string &swap_path)
+
+void ChunkPager::link(TileChunk *chunk) {
+    chunk->lru_prev = NULL;
+    chunk->lru_next = lru_head;
+    if (lru_head != NULL) lru_head->lru_prev = chunk;
+    lru_head = chunk;
+    if (lru_tail == NULL) lru_tail = chunk;
+} // void ChunkPager::link(TileChunk *chunk)
+
+void ChunkPager::unlink(TileChunk *chunk) {
+    if (chunk->lru_prev != NULL) chunk->lru_prev->lru_next = chunk->lru_next;
+    else lru_head = chunk->lru_next;
+    if (chunk->lru_next != NULL) chunk->lru_next->lru_prev = chunk->lru_prev;
+    else lru_tail = chunk->lru_prev;
+    chunk->lru_prev = chunk->lru_next = NULL;
+} // void ChunkPager::unlink(TileChunk *chunk)
+
+bool ChunkPager::openSwap() {
+    if (swap != NULL) return true;
+    if (swap_path.empty()) return false;
+
+    swap = fopen(swap_path.c_str(), "w+b");
+    return swap != NULL;
+} // bool ChunkPager::openSwap()
+
+// Write a chunk out if it changed since it was last read and free its tiles
+void ChunkPager::evict(TileChunk *chunk) {
+    // A save may be reading the old slot, write to a new one
+    if (chunk->shared && chunk->dirty && chunk->swap_slot >= 0) {
+        orphan_slots.push_back(chunk->swap_slot);
+        chunk->swap_slot = -1;
+    }
+
+    if (chunk->dirty || chunk->swap_slot < 0) {
+        if (chunk->swap_slot < 0) {
+            if (!free_slots.empty()) {
+                chunk->swap_slot = free_slots.back();
+                free_slots.pop_back();
+            } else chunk->swap_slot = next_slot++;
+        }
+
+        if (seekSwap(swap, chunk->swap_slot * (int64_t)SLOT_BYTES) != 0 ||
+            fwrite(chunk->tiles, SLOT_BYTES, 1, swap) != 1) {
+            // Keep the chunk rather than lose its tiles
+            link(chunk);
+            return;
+        }
+        chunk->dirty = false;
+    }
+
+    // The minimap plots paged out chunks in this tile's colour
+    chunk->summary = chunk->tiles[0];
+
+    if (chunk->shared) orphans.push_back(chunk->tiles);
+    else delete[] chunk->tiles;
+    chunk->tiles = NULL;
+    resident--;
+} // void ChunkPager::evict(TileChunk *chunk)
+
+// Page out the least recently used chunks until the budget is met again. The
+// chunk just touched is at the head, so it never goes itself
+void ChunkPager::trim(TileChunk *keep) {
+    while (budget > 0 && resident > budget && lru_tail != keep && openSwap()) {
+        TileChunk *victim = lru_tail;
+        unlink(victim);
+        evict(victim);
+
+        // A failed write leaves the victim resident, don't spin on it
+        if (victim->tiles != NULL) break;
+    }
+} // void ChunkPager::trim(TileChunk *keep)
+
+void ChunkPager::attach(TileChunk *chunk) {
+    chunk->tiles = new Tile[CHUNK_TILES];
+    chunk->mapped = false;
+    chunk->swap_slot = -1;
+    chunk->dirty = true;
+    resident++;
+    link(chunk);
+    trim(chunk);
+} // void ChunkPager::attach(TileChunk *chunk)
+
+void ChunkPager::attachMapped(TileChunk *chunk, Tile *tiles) {
+    chunk->tiles = tiles;
+    chunk->mapped = true;
+    chunk->swap_slot = -1;
+    chunk->dirty = false;
+    chunk->lru_prev = chunk->lru_next = NULL;
+} // void ChunkPager::attachMapped(TileChunk *chunk, Tile *tiles)
+
+// Copy on write, the mapping stays read-only
+void ChunkPager::promote(TileChunk *chunk) {
+    if (chunk->shared) {
+        // The save in flight keeps the old tiles and slot
+        Tile *tiles = new Tile[CHUNK_TILES];
+        memcpy(tiles, chunk->tiles, SLOT_BYTES);
+
+        orphans.push_back(chunk->tiles);
+        if (chunk->swap_slot >= 0) orphan_slots.push_back(chunk->swap_slot);
+
+        chunk->tiles = tiles;
+        chunk->swap_slot = -1;
+        chunk->shared = false;
+        chunk->dirty = true;
+        return;
+    }
+
+    if (!chunk->mapped) return;
+
+    Tile *tiles = new Tile[CHUNK_TILES];
+    memcpy(tiles, chunk->tiles, SLOT_BYTES);
+
+    chunk->tiles = tiles;
+    chunk->mapped = false;
+    chunk->dirty = true;
+    resident++;
+    link(chunk);
+    trim(chunk);
+} // void ChunkPager::promote(TileChunk *chunk)
+
+bool ChunkPager::touch(TileChunk *chunk) {
+    if (chunk->mapped) return true;
+
+    if (chunk->tiles != NULL) {
+        if (chunk != lru_head) {
+            unlink(chunk);
+            link(chunk);
+        }
+        return true;
+    }
+
+    // Page the chunk back in, it's clean until it's written to again. If the
+    // slot can't be read there's nothing to put in its place, the chunk stays
+    // out and keeps its slot for the next try
+    Tile *tiles = new Tile[CHUNK_TILES];
+    if (swap == NULL || seekSwap(swap, chunk->swap_slot * (int64_t)SLOT_BYTES) != 0 ||
+        fread(tiles, SLOT_BYTES, 1, swap) != 1) {
+        delete[] tiles;
+        error = true;
+        return false;
+    }
+    chunk->tiles = tiles;
+    chunk->dirty = false;
+
+    resident++;
+    link(chunk);
+    trim(chunk);
+    return true;
+} // bool ChunkPager::touch(TileChunk *chunk)
+
+void ChunkPager::release(TileChunk *chunk) {
+    if (chunk->mapped) {
+        // The tiles belong to the mapping
+        chunk->tiles = NULL;
+        chunk->mapped = false;
+    } else if (chunk->tiles != NULL) {
+        unlink(chunk);
+        if (chunk->shared) orphans.push_back(chunk->tiles);
+        else delete[] chunk->tiles;
+        chunk->tiles = NULL;
+        resident--;
+    }
+    if (chunk->swap_slot >= 0) {
+        if (chunk->shared) orphan_slots.push_back(chunk->swap_slot);
+        else free_slots.push_back(chunk->swap_slot);
+        chunk->swap_slot = -1;
+    }
+    chunk->shared = false;
+} // void ChunkPager::release(TileChunk *chunk)
+
+void ChunkPager::reset() {
+    lru_head = lru_tail = NULL;
+    resident = 0;
+    next_slot = 0;
+    free_slots.clear();
+    error = false;
+
+    for (size_t n = 0; n < orphans.size(); n++) delete[] orphans[n];
+    orphans.clear();
+    orphan_slots.clear();
+} // void ChunkPager::reset()
+
+void ChunkPager::flush() {
+    if (swap != NULL) fflush(swap);
+} // void ChunkPager::flush()
+
+void ChunkPager::dropOrphans() {
+    for (size_t n = 0; n < orphans.size(); n++) delete[] orphans[n];
+    orphans.clear();
+
+    free_slots.insert(free_slots.end(), orphan_slots.begin(), orphan_slots.end());
+    orphan_slots.clear();
+} // void ChunkPager::dropOrphans()
@@ -0,0 +1,139 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    chunkpager.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the chunk pager.
+***
+*** This code provides the ChunkPager class, which keeps at most a budgeted
+*** number of TileMap chunks in memory. The least recently used chunk is
+*** written to a swap file when the budget is exceeded and read back the next
+*** time it's needed.
+***
+*** Chunks flagged shared are being read by a save in flight (see
+*** MapSnapshot). Their tiles and swap slot are never freed, reused or written
+*** over until dropOrphans(): an edit copies the tiles first, eviction and
+*** release set the old ones aside.
+******************************************************************************/
+
+#ifndef CHUNKPAGER_H
+#define CHUNKPAGER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct TileChunk;
+struct Tile;
+
+/** \def The smallest budget the pager accepts, in chunks. Callers hold on to
+***      the last chunk they looked up, so it must never be the one evicted.
+**/
+#define PAGER_MIN_CHUNKS 64
+
+/** \class ChunkPager chunkpager.h "src\map\chunkpager.h"
+*** \brief LRU list of the resident chunks plus the swap file they're
+***        paged out to
+**/
+class ChunkPager {
+public:
+    ChunkPager();
+    ~ChunkPager();
+
+    /** \name setBudget()
+    *** \brief Sets how much memory the resident tiles may take and where the
+    ***        swap file goes. A budget of 0 keeps every chunk in memory.
+    *** \param bytes The budget, in bytes
+    *** \param swap_path The swap file, created on the first eviction
+    **/
+    void setBudget(size_t bytes, const string &swap_path);
+
+    /** \name Chunk life cycle
+    *** \brief attach() gives a new chunk its tiles, touch() makes sure a chunk
+    ***        is resident and marks it as the most recently used, release()
+    ***        frees a chunk's tiles and swap slot. A chunk that can't be read
+    ***        back from the swap file is left paged out, touch() returns
+    ***        false and hasError() stays true until reset().
+    ***
+    *** Mapped chunks read straight from a memory mapped map file. The OS
+    *** pages them, so they're kept off the LRU list and out of the budget
+    *** until promote() copies them to private memory for editing.
+    **/
+    //@{
+    void attach(TileChunk *chunk);
+    void attachMapped(TileChunk *chunk, Tile *tiles);
+    void promote(TileChunk *chunk);
+    bool touch(TileChunk *chunk);
+    void release(TileChunk *chunk);
+    //@}
+
+    /** \name reset()
+    *** \brief Forgets every chunk (which must have been released or freed by
+    ***        the caller) and rewinds the swap file
+    **/
+    void reset();
+
+    /** \name Saves in flight
+    *** \brief flush() pushes the swap file writes out so another handle can
+    ***        read the slots. dropOrphans() frees what the shared chunks left
+    ***        behind, once nothing reads them any more.
+    **/
+    //@{
+    void flush();
+    void dropOrphans();
+    const string &getSwapPath() { return swap_path; }
+    //@}
+
+    bool hasError() { return error; }
+    int getResident() { return resident; }
+    int getBudget() { return budget; }
+    int64_t getSwapped() { return next_slot - (int64_t)free_slots.size(); }
+private:
+    void link(TileChunk *chunk);
+    void unlink(TileChunk *chunk);
+    void evict(TileChunk *chunk);
+    void trim(TileChunk *keep);
+    bool openSwap();
+
+    /** The LRU list, most recently used first **/
+    //@{
+    TileChunk *lru_head, *lru_tail;
+    int resident;
+    int budget;                         //!< In chunks, 0 for unlimited
+    //@}
+
+    /** The swap file, one CHUNK_TILES slot per paged out chunk **/
+    //@{
+    string swap_path;
+    FILE *swap;
+    int64_t next_slot;
+    vector<int64_t> free_slots;
+    bool error;                         //!< A slot couldn't be read back
+    //@}
+
+    /** Tiles and slots of shared chunks that were replaced, freed by dropOrphans() **/
+    //@{
+    vector<Tile*> orphans;
+    vector<int64_t> orphan_slots;
+    //@}
+};
+
+#endif // CHUNKPAGER_H
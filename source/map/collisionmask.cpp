@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    collisionmask.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the collision layer.
+******************************************************************************/
+
+#include "collisionmask.h"
+
+#include <string.h>
+
+// A word with the bits first..last set, both included (0 <= first <= last < 64)
+static inline uint64_t bitRange(int first, int last) {
+    uint64_t upper = (last == 63) ? ~(uint64_t)0 : (((uint64_t)1 << (last + 1)) - 1);
+    return upper & ~(((uint64_t)1 << first) - 1);
+}
+
+CollisionMask::CollisionMask() {
+    width = height = 0;
+    modified = false;
+    last_key = 0;
+    last_chunk = NULL;
+}
+
+CollisionMask::~CollisionMask() {
+    destroy();
+}
+
+void CollisionMask::create(int width, int height) {
+    destroy();
+    this->width = width;
+    this->height = height;
+} // void CollisionMask::create(int width, int height)
+
+void CollisionMask::destroy() {
+    for (map<uint64_t, CollisionChunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        delete it->second;
+    }
+    chunks.clear();
+    width = height = 0;
+    modified = false;
+    last_chunk = NULL;
+} // void CollisionMask::destroy()
+
+CollisionChunk *CollisionMask::findChunk(int cx, int cy) {
+    uint64_t key = chunkKey(cx, cy);
+    if (last_chunk != NULL && key == last_key) return last_chunk;
+
+    map<uint64_t, CollisionChunk*>::iterator it = chunks.find(key);
+    if (it == chunks.end()) return NULL;
+
+    last_key = key;
+    last_chunk = it->second;
+    return last_chunk;
+} // CollisionChunk *CollisionMask::findChunk(int cx, int cy)
+
+CollisionChunk *CollisionMask::getChunk(int cx, int cy) {
+    CollisionChunk *chunk = findChunk(cx, cy);
+    if (chunk != NULL) return chunk;
+
+    chunk = new CollisionChunk;
+    chunk->cx = cx;
+    chunk->cy = cy;
+    memset(chunk->rows, 0, sizeof(chunk->rows));
+    chunks[chunkKey(cx, cy)] = chunk;
+    modified = true;
+
+    last_key = chunkKey(cx, cy);
+    last_chunk = chunk;
+    return chunk;
+} // CollisionChunk *CollisionMask::getChunk(int cx, int cy)
+
+bool CollisionMask::get(int x, int y) {
+    if (x < 0 || y < 0 || x >= width || y >= height) return false;
+
+    CollisionChunk *chunk = findChunk(x >> COLLISION_SHIFT, y >> COLLISION_SHIFT);
+    if (chunk == NULL) return false;
+    return (chunk->rows[y & COLLISION_MASK] >> (x & COLLISION_MASK)) & 1;
+} // bool CollisionMask::get(int x, int y)
+
+void CollisionMask::set(int x, int y, bool value) {
+    fillRect(x, y, x, y, value);
+} // void CollisionMask::set(int x, int y, bool value)
+
+void CollisionMask::fillRect(int x1, int y1, int x2, int y2, bool value) {
+
+    // Clip to the mask
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= width) x2 = width - 1;
+    if (y2 >= height) y2 = height - 1;
+    if (x1 > x2 || y1 > y2) return;
+
+    modified = true;
+
+    // Walk the chunks the rectangle overlaps, one word per row
+    for (int cy = y1 >> COLLISION_SHIFT; cy <= y2 >> COLLISION_SHIFT; cy++) {
+        int row1 = (cy == y1 >> COLLISION_SHIFT) ? (y1 & COLLISION_MASK) : 0;
+        int row2 = (cy == y2 >> COLLISION_SHIFT) ? (y2 & COLLISION_MASK) : COLLISION_MASK;
+
+        for (int cx = x1 >> COLLISION_SHIFT; cx <= x2 >> COLLISION_SHIFT; cx++) {
+            int bit1 = (cx == x1 >> COLLISION_SHIFT) ? (x1 & COLLISION_MASK) : 0;
+            int bit2 = (cx == x2 >> COLLISION_SHIFT) ? (x2 & COLLISION_MASK) : COLLISION_MASK;
+            uint64_t bits = bitRange(bit1, bit2);
+
+            if (value) {
+                CollisionChunk *chunk = getChunk(cx, cy);
+                for (int r = row1; r <= row2; r++) chunk->rows[r] |= bits;
+            } else {
+                // Nothing to clear on a chunk that was never set
+                CollisionChunk *chunk = findChunk(cx, cy);
+                if (chunk == NULL) continue;
+                for (int r = row1; r <= row2; r++) chunk->rows[r] &= ~bits;
+            }
+        }
+    }
+} // void CollisionMask::fillRect(int x1, int y1, int x2, int y2, bool value)
+
+uint64_t CollisionMask::getBits(int x, int y, int count) {
+    if (y < 0 || y >= height || count <= 0) return 0;
+    if (count > 64) count = 64;
+
+    uint64_t bits = 0;
+    int done = 0;
+
+    // At most two chunk words are needed for a 64-bit window
+    while (done < count) {
+        int cx = x + done;
+        if (cx >= width) break;
+
+        int shift = cx & COLLISION_MASK;
+        int take = COLLISION_SIZE - shift;
+        if (take > count - done) take = count - done;
+
+        if (cx >= 0) {
+            CollisionChunk *chunk = findChunk(cx >> COLLISION_SHIFT, y >> COLLISION_SHIFT);
+            if (chunk != NULL) {
+                uint64_t word = chunk->rows[y & COLLISION_MASK] >> shift;
+                if (take < 64) word &= ((uint64_t)1 << take) - 1;
+                bits |= word << done;
+            }
+        } else {
+            // Left of the map, never blocked; move up to the edge
+            take = -cx < take ? -cx : take;
+        }
+        done += take;
+    }
+
+    // Cut whatever spilled past the right edge of the map
+    if (x + count > width && width - x < 64) {
+        int valid = width - x;
+        bits = (valid <= 0) ? 0 : bits & (((uint64_t)1 << valid) - 1);
+    }
+    return bits;
+} // uint64_t CollisionMask::getBits(int x, int y, int count)
+
+void CollisionMask::compact() {
+    map<uint64_t, CollisionChunk*>::iterator it = chunks.begin();
+    while (it != chunks.end()) {
+        int r = 0;
+        while (r < COLLISION_SIZE && it->second->rows[r] == 0) r++;
+
+        if (r == COLLISION_SIZE) {
+            delete it->second;
+            chunks.erase(it++);
+        } else ++it;
+    }
+    last_chunk = NULL;
+} // void CollisionMask::compact()
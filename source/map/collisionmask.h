@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    collisionmask.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the collision layer.
+***
+*** This code provides the CollisionMask class, one bit per map cell telling
+*** wheter the cell is walkable. Bits are kept in sparse 64 x 64 chunks, one
+*** 64-bit word per chunk row, so brushes and the overlay work on whole words.
+******************************************************************************/
+
+#ifndef COLLISIONMASK_H
+#define COLLISIONMASK_H
+
+#include <stdint.h>
+#include <map>
+
+using namespace std;
+
+/** \def Collision chunk geometry, a chunk row is exactly one 64-bit word
+**/
+//@{
+#define COLLISION_SHIFT 6
+#define COLLISION_SIZE  (1 << COLLISION_SHIFT)
+#define COLLISION_MASK  (COLLISION_SIZE - 1)
+//@}
+
+/** \name lowestBit()
+*** \brief Position of the lowest set bit of a non-zero word
+**/
+inline int lowestBit(uint64_t bits) {
+    return __builtin_ctzll(bits);
+}
+
+/** \struct CollisionChunk collisionmask.h "src\map\collisionmask.h"
+*** \brief COLLISION_SIZE rows of COLLISION_SIZE bits, bit x of rows[y] is
+***        the cell (x, y) of the chunk
+**/
+typedef struct CollisionChunk {
+    int cx, cy;
+    uint64_t rows[COLLISION_SIZE];
+} CollisionChunk;
+
+/** \class CollisionMask collisionmask.h "src\map\collisionmask.h"
+*** \brief The collision bits of a whole map
+**/
+class CollisionMask {
+public:
+    CollisionMask();
+    ~CollisionMask();
+
+    /** \name create()
+    *** \brief Sets up an all-walkable width x height mask
+    **/
+    void create(int width, int height);
+
+    /** \name destroy()
+    *** \brief Releases every chunk
+    **/
+    void destroy();
+
+    /** \name Single cell access, coordinates outside the mask are ignored
+    **/
+    //@{
+    bool get(int x, int y);
+    void set(int x, int y, bool value);
+    //@}
+
+    /** \name fillRect()
+    *** \brief Sets or clears every cell of the rectangle (x1, y1) - (x2, y2),
+    ***        both corners included. The rectangle is clipped to the mask and
+    ***        written a word at a time.
+    **/
+    void fillRect(int x1, int y1, int x2, int y2, bool value);
+
+    /** \name getBits()
+    *** \brief Returns the collision bits of up to 64 cells of row y, starting
+    ***        at x. Bit k stands for the cell (x + k, y).
+    **/
+    uint64_t getBits(int x, int y, int count);
+
+    /** \name Chunk access, used by the file IO code
+    **/
+    //@{
+    CollisionChunk *findChunk(int cx, int cy);
+    CollisionChunk *getChunk(int cx, int cy);
+    map<uint64_t, CollisionChunk*> &getChunks() { return chunks; }
+    //@}
+
+    /** \name compact()
+    *** \brief Frees the chunks that have no collision bit left
+    **/
+    void compact();
+
+    /** \name Save state, set by any change to the bits
+    **/
+    //@{
+    bool isModified() { return modified; }
+    void setSaved() { modified = false; }
+    //@}
+
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+private:
+    static uint64_t chunkKey(int cx, int cy) {
+        return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+    }
+
+    map<uint64_t, CollisionChunk*> chunks;
+    int width, height;
+    bool modified;
+
+    /** The last chunk looked up **/
+    //@{
+    uint64_t last_key;
+    CollisionChunk *last_chunk;
+    //@}
+};
+
+#endif // COLLISIONMASK_H
@@ -0,0 +1,352 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    editjournal.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the edit journal.
+******************************************************************************/
+
+#include "editjournal.h"
+#include "..\utils\crc32.h"
+#include "..\utils\mappedfile.h"
+
+#include <string.h>
+#include <algorithm>
+
+// CRC of the first JOURNAL_BASE_BYTES of a file, which tells whether a map
+// file is still the one a journal was started on
+static bool baseCrc(const string &path, uint32_t &crc) {
+    static char data[JOURNAL_BASE_BYTES];
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) return false;
+
+    size_t read = fread(data, 1, JOURNAL_BASE_BYTES, file);
+    fclose(file);
+
+    crc = crc32(0, data, read);
+    return read > 0;
+}
+
+static uint32_t pathCrc(const string &path) {
+    return crc32(0, path.data(), path.size());
+}
+
+EditJournal::EditJournal() {
+    out = NULL;
+    size = 0;
+    edits = false;
+    mark_end = -1;
+    replay_from = 0;
+    keep_from = keep_to = 0;
+    memset(&header, 0, sizeof(header));
+}
+
+EditJournal::~EditJournal() {
+    close(false);
+}
+
+bool EditJournal::start(const string &journal, const string &base, const string &name, int layers, int width, int height) {
+    close(false);
+
+    path = journal;
+    size = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JOURNAL_MAGIC, 4);
+    header.version = JOURNAL_VERSION;
+    header.layers = layers;
+    header.width = width;
+    header.height = height;
+    strncpy(header.name, name.c_str(), JOURNAL_PATH - 1);
+
+    return rewrite(base, 0, 0);
+} // bool EditJournal::start(const string &journal, const string &base, const string &name, int layers, int width, int height)
+
+void EditJournal::close(bool discard) {
+    flush();
+    if (out != NULL) fclose(out);
+    out = NULL;
+
+    if (discard && !path.empty()) remove(path.c_str());
+
+    pending.clear();
+    edits = false;
+    mark_end = -1;
+} // void EditJournal::close(bool discard)
+
+void EditJournal::add(int type, int lay, int x, int y, uint32_t value) {
+    if (out == NULL) return;
+
+    JournalRecord record;
+    record.type = (uint16_t)type;
+    record.lay = (uint16_t)lay;
+    record.x = x;
+    record.y = y;
+    record.value = value;
+    pending.push_back(record);
+
+    if (type != JOURNAL_MARK) edits = true;
+    if (pending.size() >= JOURNAL_BATCH) flush();
+} // void EditJournal::add(int type, int lay, int x, int y, uint32_t value)
+
+void EditJournal::addTile(int lay, int x, int y, const Tile &tile) {
+    add(JOURNAL_TILE, lay, x, y, tile.bits);
+}
+
+void EditJournal::addCollision(int x, int y, bool blocked) {
+    add(JOURNAL_COLLISION, 0, x, y, blocked ? 1 : 0);
+}
+
+void EditJournal::addEmitter(int lay, int x, int y, short type) {
+    add(JOURNAL_EMITTER, lay, x, y, (uint32_t)(type > 0 ? type : 0));
+}
+
+void EditJournal::addReplace(int lay, int index, int tileset, const Tile &tile) {
+    add(JOURNAL_REPLACE, lay, index, tileset, tile.bits);
+}
+
+void EditJournal::flush() {
+    if (out == NULL || pending.empty()) {
+        pending.clear();
+        return;
+    }
+
+    JournalBatch batch;
+    batch.count = pending.size();
+    batch.crc = crc32(0, &pending[0], pending.size() * sizeof(JournalRecord));
+
+    // Handed to the OS in one go but not synced, the journal only has to
+    // outlive the editor. If it can't be written it's given up on
+    bool ok = fwrite(&batch, sizeof(batch), 1, out) == 1 &&
+              fwrite(&pending[0], sizeof(JournalRecord), pending.size(), out) == pending.size() &&
+              fflush(out) == 0;
+
+    size += sizeof(batch) + pending.size() * sizeof(JournalRecord);
+    pending.clear();
+
+    if (!ok) {
+        fclose(out);
+        out = NULL;
+    }
+} // void EditJournal::flush()
+
+void EditJournal::mark(const string &base) {
+    if (out == NULL) return;
+
+    // The mark goes in a batch of its own, the edits after it start right
+    // where it ends
+    flush();
+    add(JOURNAL_MARK, 0, 0, 0, pathCrc(base));
+    flush();
+
+    mark_base = base;
+    mark_end = size;
+} // void EditJournal::mark(const string &base)
+
+// The header is written again in front of every byte after it, so the
+// batches, and a mark waiting on its rebase(), stay where they are
+bool EditJournal::setName(const string &name) {
+    memset(header.name, 0, sizeof(header.name));
+    strncpy(header.name, name.c_str(), JOURNAL_PATH - 1);
+    if (out == NULL) return false;
+
+    flush();
+    return rewrite(header.base, sizeof(JournalHeader), size);
+} // bool EditJournal::setName(const string &name)
+
+bool EditJournal::rebase() {
+    if (out == NULL || mark_end < 0) return false;
+
+    flush();
+    long from = mark_end;
+    mark_end = -1;
+
+    if (!rewrite(mark_base, from, size)) return false;
+    edits = size > (long)sizeof(JournalHeader);
+    return true;
+} // bool EditJournal::rebase()
+
+bool EditJournal::rewrite(const string &base, long from, long to) {
+    flush();
+
+    JournalHeader next = header;
+    memset(next.base, 0, sizeof(next.base));
+    strncpy(next.base, base.c_str(), JOURNAL_PATH - 1);
+
+    // A base that can't be read gets a CRC it won't match later on
+    next.base_crc = 0;
+    baseCrc(base, next.base_crc);
+    next.header_crc = 0;
+    next.header_crc = crc32(0, &next, sizeof(next));
+
+    string temp = path + ".tmp";
+    FILE *file = fopen(temp.c_str(), "wb");
+    bool ok = file != NULL && fwrite(&next, sizeof(next), 1, file) == 1;
+
+    // The batches kept are copied straight from the current journal
+    if (ok && from < to) {
+        FILE *in = fopen(path.c_str(), "rb");
+        ok = in != NULL && fseek(in, from, SEEK_SET) == 0;
+
+        char buffer[4096];
+        for (long left = to - from; ok && left > 0; ) {
+            size_t count = (size_t)min(left, (long)sizeof(buffer));
+            ok = fread(buffer, 1, count, in) == count && fwrite(buffer, 1, count, file) == count;
+            left -= count;
+        }
+        if (in != NULL) fclose(in);
+    }
+    if (file != NULL && fclose(file) != 0) ok = false;
+
+    // The old journal can't be replaced while it's open, on Windows
+    bool existed = out != NULL || size > 0;
+    if (out != NULL) fclose(out);
+    out = NULL;
+
+    if (ok) ok = replaceFile(temp, path);
+    if (ok) {
+        header = next;
+        size = sizeof(next) + (to - from);
+    } else {
+        remove(temp.c_str());
+    }
+
+    // Carry on with whichever journal is in place
+    if (ok || existed) out = fopen(path.c_str(), "ab");
+    return ok && out != NULL;
+} // bool EditJournal::rewrite(const string &base, long from, long to)
+
+bool EditJournal::recover(const string &journal) {
+    close(false);
+
+    path = journal;
+    records.clear();
+    replay_from = 0;
+
+    FILE *in = fopen(path.c_str(), "rb");
+    if (in == NULL) return false;
+
+    JournalHeader check;
+    bool ok = fread(&header, sizeof(header), 1, in) == 1;
+    if (ok) {
+        check = header;
+        check.header_crc = 0;
+        ok = memcmp(header.magic, JOURNAL_MAGIC, 4) == 0 && header.version == JOURNAL_VERSION &&
+             header.header_crc == crc32(0, &check, sizeof(check));
+        header.base[JOURNAL_PATH - 1] = header.name[JOURNAL_PATH - 1] = 0;
+    }
+
+    // Every whole batch, up to the first one that didn't make it to disk
+    long offset = sizeof(JournalHeader), mark_offset = -1;
+    int last_mark = -1;
+    uint32_t mark_crc = 0;
+
+    JournalBatch batch;
+    vector<JournalRecord> read;
+    while (ok && fread(&batch, sizeof(batch), 1, in) == 1) {
+        if (batch.count == 0 || batch.count > JOURNAL_BATCH) break;
+
+        read.resize(batch.count);
+        if (fread(&read[0], sizeof(JournalRecord), batch.count, in) != batch.count ||
+            crc32(0, &read[0], batch.count * sizeof(JournalRecord)) != batch.crc) break;
+
+        offset += sizeof(batch) + batch.count * sizeof(JournalRecord);
+        for (size_t n = 0; n < read.size(); n++) {
+            if (read[n].type == JOURNAL_MARK) {
+                last_mark = (int)records.size();
+                mark_crc = read[n].value;
+                mark_offset = offset;
+            }
+            records.push_back(read[n]);
+        }
+    }
+    fclose(in);
+
+    if (!ok) {
+        records.clear();
+        return false;
+    }
+
+    // Either the base is as the journal found it, or the last save the
+    // journal saw started was to the base and got done; the edits up to
+    // its mark are in there already
+    uint32_t crc = 0;
+    bool found = baseCrc(header.base, crc);
+
+    if (found && crc == header.base_crc) {
+        replay_from = 0;
+        keep_from = sizeof(JournalHeader);
+    } else if (found && last_mark >= 0 && mark_crc == pathCrc(header.base)) {
+        replay_from = last_mark + 1;
+        keep_from = mark_offset;
+    } else {
+        records.clear();
+        return false;
+    }
+
+    keep_to = offset;
+    return true;
+} // bool EditJournal::recover(const string &journal)
+
+void EditJournal::replay(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters) {
+    for (size_t n = replay_from; n < records.size(); n++) {
+        const JournalRecord &record = records[n];
+        Tile tile;
+        tile.bits = record.value;
+
+        switch (record.type) {
+        case JOURNAL_TILE: {
+            if (tilemap.contains(record.lay, record.x, record.y)) tilemap.set(record.lay, record.x, record.y, tile);
+            break;
+        }
+        case JOURNAL_COLLISION: {
+            collision.set(record.x, record.y, record.value != 0);
+            break;
+        }
+        case JOURNAL_EMITTER: {
+            if (tilemap.contains(record.lay, record.x, record.y)) {
+                tile = tilemap.get(record.lay, record.x, record.y);
+                tile.setEmitter(record.value);
+                tilemap.set(record.lay, record.x, record.y, tile);
+                emitters.set(record.lay, record.x, record.y, tile.getEmitter());
+            }
+            break;
+        }
+        case JOURNAL_REPLACE: {
+            if (record.lay < tilemap.getLayers()) {
+                tilemap.replace(record.lay, record.x, record.y, tile.getIndex(), tile.getTileset());
+            }
+            break;
+        }
+        }
+    }
+    records.clear();
+} // void EditJournal::replay(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters)
+
+bool EditJournal::resume() {
+    pending.clear();
+    mark_end = -1;
+
+    // Whatever came after the last whole batch is dropped
+    size = keep_to;
+    if (!rewrite(header.base, keep_from, keep_to)) return false;
+
+    edits = size > (long)sizeof(JournalHeader);
+    return true;
+} // bool EditJournal::resume()
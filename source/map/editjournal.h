@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    editjournal.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the edit journal.
+***
+*** This code provides the EditJournal class, an append-only log of the edits
+*** made on top of a map file, so they outlive a crash of the editor.
+***
+*** Layout, all fields native (little) endian:
+***   -# JournalHeader, naming the base map file and the CRC of its first
+***      JOURNAL_BASE_BYTES
+***   -# batches: a JournalBatch followed by count JournalRecord entries
+***
+*** Edits are buffered and written a batch at a time by flush(), without
+*** waiting for the disk. A batch that didn't make it whole fails its CRC and
+*** ends the journal. Whenever the map is written somewhere, a mark batch
+*** goes in first and once the file is complete the journal is written anew
+*** on top of it, next to the old one and moved over it. If the editor dies
+*** before that, the mark tells which edits the new file already holds.
+******************************************************************************/
+
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "tilemap.h"
+#include "collisionmask.h"
+#include "emitterindex.h"
+
+using namespace std;
+
+/** \def Journal format constants
+**/
+//@{
+#define JOURNAL_MAGIC       "AJRN"
+#define JOURNAL_VERSION     1
+//! Room for a path in the header, the terminating 0 included
+#define JOURNAL_PATH        260
+//! Bytes of the base file its CRC is taken over, a v2 map's header page
+#define JOURNAL_BASE_BYTES  4096
+//! Edits buffered before flush() writes them anyway
+#define JOURNAL_BATCH       4096
+//@}
+
+/** \def Journal record types
+**/
+//@{
+//! value holds the tile's bits
+#define JOURNAL_TILE        1
+//! value is 1 for a blocked cell, layer is unused
+#define JOURNAL_COLLISION   2
+//! value holds the emitter type
+#define JOURNAL_EMITTER     3
+//! x and y are the index and tileset replaced all over the layer, value the new tile's bits
+#define JOURNAL_REPLACE     4
+//! The map started being written to a file, value is the CRC of its path
+#define JOURNAL_MARK        5
+//@}
+
+/** \struct JournalHeader editjournal.h "src\map\editjournal.h"
+*** \brief The first bytes of a journal
+**/
+typedef struct JournalHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t layers, width, height;
+    uint32_t base_crc;                  //!< CRC of the base file's first JOURNAL_BASE_BYTES
+    uint32_t header_crc;                //!< CRC of the header, taken with this field at 0
+    char base[JOURNAL_PATH];            //!< The map file the edits go on top of
+    char name[JOURNAL_PATH];            //!< What the editor calls the map
+} JournalHeader;
+
+/** \struct JournalBatch editjournal.h "src\map\editjournal.h"
+*** \brief Leads count records, crc is taken over them
+**/
+typedef struct JournalBatch {
+    uint32_t count;
+    uint32_t crc;
+} JournalBatch;
+
+/** \struct JournalRecord editjournal.h "src\map\editjournal.h"
+*** \brief One edit, see the JOURNAL_ record types
+**/
+typedef struct JournalRecord {
+    uint16_t type;
+    uint16_t lay;
+    int32_t x, y;
+    uint32_t value;
+} JournalRecord;
+
+/** \class EditJournal editjournal.h "src\map\editjournal.h"
+*** \brief Logs the edits of a map to disk as they're made
+**/
+class EditJournal {
+public:
+    EditJournal();
+    //! Closes the journal, leaving the file
+    ~EditJournal();
+
+    /** \name start()
+    *** \brief Starts an empty journal file for the edits made on top of
+    ***        the map file base, which the editor calls name
+    *** \return false if the journal couldn't be written
+    **/
+    bool start(const string &journal, const string &base, const string &name, int layers, int width, int height);
+
+    /** \name close()
+    *** \brief Writes what's buffered and closes the journal, removing the
+    ***        file if discard is set
+    **/
+    void close(bool discard);
+
+    bool isOpen() { return out != NULL; }
+
+    /** \name Recording
+    *** \brief The edits are buffered, flush() writes them as one batch
+    **/
+    //@{
+    void addTile(int lay, int x, int y, const Tile &tile);
+    void addCollision(int x, int y, bool blocked);
+    void addEmitter(int lay, int x, int y, short type);
+    void addReplace(int lay, int index, int tileset, const Tile &tile);
+    void flush();
+    //! Wheter there are edits on top of the base
+    bool hasEdits() { return edits; }
+    //@}
+
+    /** \name setName()
+    *** \brief The editor calls the map something else now, recover() hands
+    ***        out the new name
+    *** \return false if the journal couldn't be written
+    **/
+    bool setName(const string &name);
+
+    /** \name Rebasing
+    *** \brief mark() is called right before the map, as it is, starts being
+    ***        written to base. Once the file is complete, rebase() starts the
+    ***        journal over on top of it, keeping the edits made since mark().
+    *** \return false if the journal couldn't be written, it's left as it was
+    **/
+    //@{
+    void mark(const string &base);
+    bool rebase();
+    //@}
+
+    /** \name Recovery
+    *** \brief recover() reads the journal file a session left behind. It
+    ***        returns false if there's none, it's damaged, or its base file
+    ***        changed in a way the journal doesn't account for. Otherwise
+    ***        the editor loads getBase(), replay() applies the edits and
+    ***        resume() carries on with the journal.
+    **/
+    //@{
+    bool recover(const string &journal);
+    string getBase() { return header.base; }
+    string getName() { return header.name; }
+    int getLayers() { return header.layers; }
+    int getWidth() { return header.width; }
+    int getHeight() { return header.height; }
+    void replay(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters);
+    bool resume();
+    //@}
+private:
+    void add(int type, int lay, int x, int y, uint32_t value);
+
+    /** \name rewrite()
+    *** \brief Writes a new journal on top of base next to path, with the
+    ***        bytes [from, to) of the current one as its batches, and moves
+    ***        it over path
+    **/
+    bool rewrite(const string &base, long from, long to);
+
+    FILE *out;
+    string path;
+    JournalHeader header;
+    vector<JournalRecord> pending;
+    long size;                          //!< Bytes written to the file so far
+    bool edits;
+
+    /** The last mark() **/
+    //@{
+    string mark_base;
+    long mark_end;                      //!< Where the edits after it start, -1 if none
+    //@}
+
+    /** What recover() read **/
+    //@{
+    vector<JournalRecord> records;
+    size_t replay_from;                 //!< The first record the base doesn't hold
+    long keep_from, keep_to;            //!< The bytes resume() keeps
+    //@}
+};
+
+#endif // EDITJOURNAL_H
@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    emitterindex.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the emitter lookup.
+******************************************************************************/
+
+#include "emitterindex.h"
+
+EmitterIndex::EmitterIndex() {
+    count = 0;
+    modified = false;
+}
+
+EmitterIndex::~EmitterIndex() {
+}
+
+void EmitterIndex::clear() {
+    buckets.clear();
+    count = 0;
+    modified = true;
+} // void EmitterIndex::clear()
+
+void EmitterIndex::set(int lay, int x, int y, short type) {
+    uint64_t key = chunkKey(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    map<uint64_t, vector<EmitterCell> >::iterator it = buckets.find(key);
+
+    // Look for the cell in its chunk's bucket, they only hold a handful
+    if (it != buckets.end()) {
+        vector<EmitterCell> &cells = it->second;
+        for (unsigned int i = 0; i < cells.size(); i++) {
+            if (cells[i].lay != lay || cells[i].x != x || cells[i].y != y) continue;
+
+            modified = true;
+            if (type > 0) {
+                cells[i].type = type;
+            } else {
+                cells[i] = cells.back();
+                cells.pop_back();
+                count--;
+                if (cells.empty()) buckets.erase(it);
+            }
+            return;
+        }
+    }
+
+    if (type <= 0) return;
+
+    EmitterCell cell;
+    cell.lay = lay;
+    cell.x = x;
+    cell.y = y;
+    cell.type = type;
+    buckets[key].push_back(cell);
+    count++;
+    modified = true;
+} // void EmitterIndex::set(int lay, int x, int y, short type)
+
+int EmitterIndex::query(int lay, int x1, int y1, int x2, int y2, vector<EmitterCell> &out) {
+    int found = 0;
+    if (count == 0 || x1 > x2 || y1 > y2) return 0;
+
+    for (int cy = y1 >> CHUNK_SHIFT; cy <= y2 >> CHUNK_SHIFT; cy++) {
+        for (int cx = x1 >> CHUNK_SHIFT; cx <= x2 >> CHUNK_SHIFT; cx++) {
+            map<uint64_t, vector<EmitterCell> >::iterator it = buckets.find(chunkKey(cx, cy));
+            if (it == buckets.end()) continue;
+
+            vector<EmitterCell> &cells = it->second;
+            for (unsigned int i = 0; i < cells.size(); i++) {
+                const EmitterCell &cell = cells[i];
+                if (lay >= 0 && cell.lay != lay) continue;
+                if (cell.x < x1 || cell.x > x2 || cell.y < y1 || cell.y > y2) continue;
+
+                out.push_back(cell);
+                found++;
+            }
+        }
+    }
+    return found;
+} // int EmitterIndex::query(int lay, int x1, int y1, int x2, int y2, vector<EmitterCell> &out)
+
+void EmitterIndex::getAll(vector<EmitterCell> &out) {
+    for (map<uint64_t, vector<EmitterCell> >::iterator it = buckets.begin(); it != buckets.end(); ++it) {
+        out.insert(out.end(), it->second.begin(), it->second.end());
+    }
+} // void EmitterIndex::getAll(vector<EmitterCell> &out)
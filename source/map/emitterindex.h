@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    emitterindex.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the emitter lookup.
+***
+*** This code provides the EmitterIndex class, a list of the emitter cells of
+*** every layer bucketed by map chunk, so the particle code only looks at the
+*** chunks on screen instead of every tile of the viewport.
+******************************************************************************/
+
+#ifndef EMITTERINDEX_H
+#define EMITTERINDEX_H
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "tilemap.h"
+
+using namespace std;
+
+/** \struct EmitterCell emitterindex.h "src\map\emitterindex.h"
+*** \brief One emitter placed on the map
+**/
+typedef struct EmitterCell {
+    int lay;
+    int x, y;
+    short type;
+} EmitterCell;
+
+/** \class EmitterIndex emitterindex.h "src\map\emitterindex.h"
+*** \brief The emitters of a map, bucketed by CHUNK_SIZE x CHUNK_SIZE cells
+***        across all the layers
+**/
+class EmitterIndex {
+public:
+    EmitterIndex();
+    ~EmitterIndex();
+
+    /** \name clear()
+    *** \brief Forgets every emitter
+    **/
+    void clear();
+
+    /** \name set()
+    *** \brief Places, changes or (type <= 0) removes the emitter of a cell
+    **/
+    void set(int lay, int x, int y, short type);
+
+    /** \name query()
+    *** \brief Appends to out the emitters of the cells (x1, y1) - (x2, y2),
+    ***        both corners included. lay -1 matches every layer.
+    *** \return The number of emitters appended
+    **/
+    int query(int lay, int x1, int y1, int x2, int y2, vector<EmitterCell> &out);
+
+    /** \name getAll()
+    *** \brief Appends every emitter of the map to out
+    **/
+    void getAll(vector<EmitterCell> &out);
+
+    int getCount() { return count; }
+
+    /** \name Save state, set by any emitter placed, changed or removed
+    **/
+    //@{
+    bool isModified() { return modified; }
+    void setSaved() { modified = false; }
+    //@}
+private:
+    static uint64_t chunkKey(int cx, int cy) {
+        return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+    }
+
+    map<uint64_t, vector<EmitterCell> > buckets;
+    int count;
+    bool modified;
+};
+
+#endif // EMITTERINDEX_H
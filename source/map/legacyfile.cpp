@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    legacyfile.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the old .dat map format.
+******************************************************************************/
+
+#include "legacyfile.h"
+
+#include <string.h>
+#include <vector>
+
+// Bytes taken by a tile in the file: index, tileset, collision and emitter
+#define LEGACY_TILE_BYTES 16
+
+// pack_igetl()/pack_iputl() byte order, little endian
+static inline int getLong(const unsigned char *p) {
+    return (int)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+// Wheter the fields of a tile as the file holds them fit a Tile and pick one of
+// the tilesets in mapData.dat. Negative emitters are the old "no emitter", the
+// index keeps emitters to a short
+static inline bool isTileValid(int index, int tileset, int emitter) {
+    return index >= 0 && index <= (int)(TILE_INDEX_MASK >> TILE_INDEX_SHIFT) &&
+           tileset >= 0 && tileset < TILE_TILESETS &&
+           emitter <= 0x7FFF;
+}
+
+static inline void putLong(unsigned char *p, int value) {
+    uint32_t v = (uint32_t)value;
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+LegacyMapFile::LegacyMapFile() {
+    pfile = NULL;
+    layers = width = height = 0;
+    strips_read = 0;
+    bad_tiles = 0;
+    complete = false;
+}
+
+LegacyMapFile::~LegacyMapFile() {
+    if (pfile != NULL) pack_fclose(pfile);
+}
+
+bool LegacyMapFile::open(const string &path) {
+    if (pfile != NULL) pack_fclose(pfile);
+    strips_read = 0;
+    bad_tiles = 0;
+    complete = false;
+
+    pfile = pack_fopen(path.c_str(), "rp");
+    if (pfile == NULL) return false;
+
+    layers = pack_igetl(pfile);
+    width = pack_igetl(pfile);
+    height = pack_igetl(pfile);
+
+    if (layers <= 0 || width <= 0 || height <= 0) {
+        pack_fclose(pfile);
+        pfile = NULL;
+        return false;
+    }
+    return true;
+} // bool LegacyMapFile::open(const string &path)
+
+bool LegacyMapFile::load(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters) {
+    while (loadStrips(tilemap, collision, emitters, getStripCount()) > 0) {}
+    return complete;
+} // bool LegacyMapFile::load(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters)
+
+int LegacyMapFile::loadStrips(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, int count) {
+    if (pfile == NULL) return 0;
+
+    // The file runs column by column. A strip of CHUNK_SIZE columns is read
+    // one column per pack_fread() and handed to the map a chunk row at a time
+    column.resize((size_t)height * LEGACY_TILE_BYTES);
+    strip.resize((size_t)height * CHUNK_SIZE);
+
+    int strips_x = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int read = 0;
+    bool ok = true;
+
+    for (; read < count && strips_read < getStripCount(); read++, strips_read++) {
+        int l = strips_read / strips_x;
+        int x0 = (strips_read % strips_x) * CHUNK_SIZE;
+        int cols = (width - x0 < CHUNK_SIZE) ? width - x0 : CHUNK_SIZE;
+
+        for (int i = 0; i < cols && ok; i++) {
+            if (pack_fread(&column[0], (long)column.size(), pfile) != (long)column.size()) {
+                ok = false;
+                break;
+            }
+
+            const unsigned char *p = &column[0];
+            for (int j = 0; j < height; j++, p += LEGACY_TILE_BYTES) {
+                // makeTile() would mask a field that's out of range into
+                // another valid looking tile, those are counted instead
+                int index = getLong(p), tileset = getLong(p + 4), emitter = getLong(p + 12);
+                if (!isTileValid(index, tileset, emitter)) {
+                    index = tileset = emitter = 0;
+                    bad_tiles++;
+                }
+                Tile tile = makeTile(index, tileset, emitter);
+
+                // Collision is per map, a cell blocked on any layer stays blocked
+                if (getLong(p + 8) > 0) collision.set(x0 + i, j, true);
+                if (tile.getEmitter() > 0) emitters.set(l, x0 + i, j, tile.getEmitter());
+
+                strip[(size_t)j * CHUNK_SIZE + i] = tile;
+            }
+
+            // Whatever the layer starts with is most likely what it's
+            // filled with; chunks made only of it are never allocated.
+            // The fill never carries an emitter, those stay on their cell
+            if (x0 == 0 && i == 0) {
+                tilemap.setFill(l, makeTile(strip[0].getIndex(), strip[0].getTileset(), 0));
+            }
+        }
+
+        if (!ok) break;
+        for (int j = 0; j < height; j++) {
+            tilemap.setSpan(l, x0, j, &strip[(size_t)j * CHUNK_SIZE], cols);
+        }
+    }
+
+    // Done with the file, whether it was all there or not
+    if (!ok || strips_read == getStripCount()) {
+        complete = ok && !pack_ferror(pfile) && bad_tiles == 0;
+        pack_fclose(pfile);
+        pfile = NULL;
+    }
+    return read;
+} // int LegacyMapFile::loadStrips(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, int count)
+
+bool LegacyMapFile::save(const string &path, TileMap &tilemap, CollisionMask &collision) {
+    PACKFILE *out = pack_fopen(path.c_str(), "wp");
+    if (out == NULL) return false;
+
+    int layers = tilemap.getLayers(), width = tilemap.getWidth(), height = tilemap.getHeight();
+
+    pack_iputl(layers, out);
+    pack_iputl(width, out);
+    pack_iputl(height, out);
+
+    // The same strips as load(), gathered from the map a row span at a time
+    // and written out a whole column per pack_fwrite()
+    vector<unsigned char> column((size_t)height * LEGACY_TILE_BYTES);
+    vector<Tile> strip((size_t)height * CHUNK_SIZE);
+    vector<uint64_t> blocked(height);
+    bool ok = true;
+
+    for (int l = 0; l < layers && ok; l++) {
+        for (int x0 = 0; x0 < width && ok; x0 += CHUNK_SIZE) {
+            int cols = (width - x0 < CHUNK_SIZE) ? width - x0 : CHUNK_SIZE;
+
+            for (int j = 0; j < height; j++) {
+                const Tile *span;
+                tilemap.getSpan(l, x0, j, span);
+                memcpy(&strip[(size_t)j * CHUNK_SIZE], span, cols * sizeof(Tile));
+                blocked[j] = collision.getBits(x0, j, cols);
+            }
+
+            for (int i = 0; i < cols && ok; i++) {
+                unsigned char *p = &column[0];
+                for (int j = 0; j < height; j++, p += LEGACY_TILE_BYTES) {
+                    const Tile &tile = strip[(size_t)j * CHUNK_SIZE + i];
+                    putLong(p, tile.getIndex());
+                    putLong(p + 4, tile.getTileset());
+                    putLong(p + 8, (int)((blocked[j] >> i) & 1));
+                    putLong(p + 12, tile.getEmitter() > 0 ? tile.getEmitter() : -1);
+                }
+                ok = pack_fwrite(&column[0], (long)column.size(), out) == (long)column.size();
+            }
+        }
+    }
+
+    // A chunk the swap file lost went out as its summary tile
+    if (pack_ferror(out) || tilemap.hasIOError()) ok = false;
+    pack_fclose(out);
+    return ok;
+} // bool LegacyMapFile::save(const string &path, TileMap &tilemap, CollisionMask &collision)
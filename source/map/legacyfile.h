@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    legacyfile.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the old .dat map format.
+***
+*** This code provides the LegacyMapFile class, which reads and writes the
+*** version 1 map files: a compressed Allegro packfile holding the layers,
+*** width and height followed by index, tileset, collision and emitter for
+*** every tile, layer by layer, column by column.
+***
+*** \note This code uses the following libraries:
+***   -# Allegro 4.2.2, http://www.allegro.cc/
+******************************************************************************/
+
+#ifndef LEGACYFILE_H
+#define LEGACYFILE_H
+
+#include <allegro.h>
+
+#include <string>
+#include <vector>
+#include "tilemap.h"
+#include "collisionmask.h"
+#include "emitterindex.h"
+
+using namespace std;
+
+/** \class LegacyMapFile legacyfile.h "src\map\legacyfile.h"
+*** \brief Reads and writes the version 1 (.dat) map files
+**/
+class LegacyMapFile {
+public:
+    LegacyMapFile();
+    ~LegacyMapFile();
+
+    /** \name open()
+    *** \brief Opens a v1 map and reads its sizes
+    *** \return false if the file can't be opened or the sizes make no sense
+    **/
+    bool open(const string &path);
+
+    /** \name Map sizes, valid after open()
+    **/
+    //@{
+    int getLayers() { return layers; }
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+    //@}
+
+    /** \name load()
+    *** \brief Reads the tiles of the opened file and closes it. tilemap and
+    ***        collision have to be created with the file's sizes beforehand.
+    *** \return false if the file ended early or held tiles out of range
+    **/
+    bool load(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters);
+
+    /** \name Progressive loads
+    *** \brief load() a few strips at a time, so the map can be drawn while
+    ***        it's read. The file only reads front to back, so the strips of
+    ***        CHUNK_SIZE columns come in file order, layer by layer.
+    ***        loadStrips() reads up to count of them and returns how many it
+    ***        did; once the file is closed isDone() is true and load() would
+    ***        have returned isComplete(). getBadTiles() counts the cells so far
+    ***        whose index, tileset or emitter doesn't fit a Tile; they're read
+    ***        as tile 0 of tileset 0 with no emitter.
+    **/
+    //@{
+    int loadStrips(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, int count);
+    int getStripCount() { return layers * ((width + CHUNK_SIZE - 1) / CHUNK_SIZE); }
+    int getStripsRead() { return strips_read; }
+    bool isDone() { return pfile == NULL; }
+    bool isComplete() { return complete; }
+    int getBadTiles() { return bad_tiles; }
+    //@}
+
+    /** \name save()
+    *** \brief Writes a map in the v1 layout. Collision is written on every
+    ***        layer, -1 stands for no emitter.
+    *** \return false if the file couldn't be written
+    **/
+    bool save(const string &path, TileMap &tilemap, CollisionMask &collision);
+private:
+    PACKFILE *pfile;
+    int layers, width, height;
+
+    /** Where a load is at, the buffers of the strip being read **/
+    //@{
+    int strips_read;
+    int bad_tiles;
+    bool complete;
+    vector<unsigned char> column;
+    vector<Tile> strip;
+    //@}
+};
+
+#endif // LEGACYFILE_H
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapdocument.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the map document.
+******************************************************************************/
+
+#include "mapdocument.h"
+#include "mapfile.h"
+#include "legacyfile.h"
+#include "mapview.h"
+
+#include <algorithm>
+
+MapDocument::MapDocument() {
+    load_damaged = load_bad_tiles = 0;
+} // MapDocument::MapDocument()
+
+MapDocument::~MapDocument() {
+} // MapDocument::~MapDocument()
+
+bool MapDocument::create(int layers, int width, int height) {
+    if (!tiles.create(layers, width, height)) return false;
+    collision.create(width, height);
+    emitters.clear();
+    return true;
+} // bool MapDocument::create(int layers, int width, int height)
+
+void MapDocument::destroy() {
+    tiles.destroy();
+    collision.destroy();
+    emitters.clear();
+} // void MapDocument::destroy()
+
+void MapDocument::setTile(int lay, int x, int y, int index, int tileset) {
+    // The brushes reach past the edges of the map, those cells are dropped
+    if (!tiles.contains(lay, x, y)) return;
+
+    Tile tile = tiles.get(lay, x, y);
+    Tile old = tile;
+    tile.setIndex(index);
+    tile.setTileset(tileset);
+
+    // Holding the button over the same tile doesn't fill the journal
+    if (tile.bits != old.bits) {
+        tiles.set(lay, x, y, tile);
+        journal.addTile(lay, x, y, tile);
+    }
+} // void MapDocument::setTile(int lay, int x, int y, int index, int tileset)
+
+void MapDocument::setTiles(int lay, int x, int y, const Tile *row, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!tiles.contains(lay, x+i, y)) continue;
+
+        Tile old = tiles.get(lay, x+i, y);
+        if (row[i].bits == old.bits) continue;
+
+        tiles.set(lay, x+i, y, row[i]);
+        journal.addTile(lay, x+i, y, row[i]);
+
+        // The journal replays tiles as they are, the index has to be told
+        if (row[i].getEmitter() != old.getEmitter()) {
+            emitters.set(lay, x+i, y, row[i].getEmitter());
+            journal.addEmitter(lay, x+i, y, row[i].getEmitter());
+        }
+    }
+} // void MapDocument::setTiles(int lay, int x, int y, const Tile *row, int count)
+
+void MapDocument::setObject(int lay, int x, int y, int x1, int y1, int x2, int y2, int tileset) {
+    for (int i = 0; i <= x2-x1; i++) {
+        for (int j = 0; j <= y2-y1; j++) {
+            setTile(lay, x+i, y+j, (i+x1)*TILESIZE+j+y1, tileset);
+        }
+    }
+} // void MapDocument::setObject(int lay, int x, int y, int x1, int y1, int x2, int y2, int tileset)
+
+void MapDocument::floodFill(int lay, int x, int y, int index, int tileset) {
+    if (!tiles.contains(lay, x, y)) return;
+
+    short flooded_tile = tiles.get(lay, x, y).getIndex();
+    short flooded_tset = tiles.get(lay, x, y).getTileset();
+
+    // Only the painted chunks are scanned, the rest of the layer is
+    // repainted by changing its fill tile
+    tiles.replace(lay, flooded_tile, flooded_tset, index, tileset);
+    journal.addReplace(lay, flooded_tile, flooded_tset, makeTile(index, tileset, 0));
+} // void MapDocument::floodFill(int lay, int x, int y, int index, int tileset)
+
+// The mask is written a word at a time, the cells are only looked at one by
+// one for the journal
+void MapDocument::setCollision(int x1, int y1, int x2, int y2, bool value) {
+    if (journal.isOpen()) {
+        for (int j = max(y1, 0); j <= min(y2, getHeight()-1); j++) {
+            for (int i = max(x1, 0); i <= min(x2, getWidth()-1); i++) {
+                if (collision.get(i, j) != value) journal.addCollision(i, j, value);
+            }
+        }
+    }
+    collision.fillRect(x1, y1, x2, y2, value);
+} // void MapDocument::setCollision(int x1, int y1, int x2, int y2, bool value)
+
+void MapDocument::setEmitter(int lay, int x, int y, short value) {
+    if (!tiles.contains(lay, x, y)) return;
+
+    Tile tile = tiles.get(lay, x, y);
+    Tile old = tile;
+    tile.setEmitter(value);
+
+    // The brush goes over the same cells every frame it's held down
+    if (tile.bits == old.bits) return;
+
+    tiles.set(lay, x, y, tile);
+    emitters.set(lay, x, y, tile.getEmitter());
+    journal.addEmitter(lay, x, y, tile.getEmitter());
+} // void MapDocument::setEmitter(int lay, int x, int y, short value)
+
+bool MapDocument::load(const string &path, int threads) {
+    MapFile mapFile;
+    mapFile.setThreads(threads);
+    load_damaged = load_bad_tiles = 0;
+
+    // The damaged chunks read as the fill and the bad tiles as blanks, it's
+    // up to the caller to go on
+    if (mapFile.open(path)) {
+        if (!create(mapFile.getLayers(), mapFile.getWidth(), mapFile.getHeight())) return false;
+        bool ok = mapFile.load(tiles, collision, emitters);
+        load_damaged = mapFile.getLoadDamaged();
+        return ok;
+    }
+
+    LegacyMapFile legacyFile;
+    if (!legacyFile.open(path)) return false;
+    if (!create(legacyFile.getLayers(), legacyFile.getWidth(), legacyFile.getHeight())) return false;
+    bool ok = legacyFile.load(tiles, collision, emitters);
+    load_bad_tiles = legacyFile.getBadTiles();
+    return ok;
+} // bool MapDocument::load(const string &path, int threads)
+
+bool MapDocument::save(const string &path, int threads) {
+    MapFile mapFile;
+    mapFile.setThreads(threads);
+
+    journal.mark(path);
+    if (!mapFile.save(path, tiles, collision, emitters)) return false;
+    journal.rebase();
+    return true;
+} // bool MapDocument::save(const string &path, int threads)
+
+bool MapDocument::exportMap(const string &path) {
+    LegacyMapFile legacyFile;
+    return legacyFile.save(path, tiles, collision);
+} // bool MapDocument::exportMap(const string &path)
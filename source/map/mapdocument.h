@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapdocument.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the map document.
+***
+*** This code provides the MapDocument class: the tiles, collision and
+*** emitters of a map together with its edit journal, the edit operations
+*** the editor's brushes boil down to and blocking loads and saves. It needs
+*** neither a display nor the editor, so batch tools can work on maps the
+*** same way the editor does.
+******************************************************************************/
+
+#ifndef MAPDOCUMENT_H
+#define MAPDOCUMENT_H
+
+#include <string>
+#include "tilemap.h"
+#include "collisionmask.h"
+#include "emitterindex.h"
+#include "editjournal.h"
+
+using namespace std;
+
+/** \class MapDocument mapdocument.h "src\map\mapdocument.h"
+*** \brief A map and the operations that edit it
+**/
+class MapDocument {
+public:
+    MapDocument();
+    ~MapDocument();
+
+    /** \name create()
+    *** \brief Sets up an empty map, dropping the previous one
+    *** \return false if the sizes are invalid
+    **/
+    bool create(int layers, int width, int height);
+
+    /** \name destroy()
+    *** \brief Releases the map, the journal is left alone
+    **/
+    void destroy();
+
+    /** \name Map sizes
+    **/
+    //@{
+    int getLayers() { return tiles.getLayers(); }
+    int getWidth() { return tiles.getWidth(); }
+    int getHeight() { return tiles.getHeight(); }
+    //@}
+
+    /** \name Map data
+    *** \brief Edits made straight on these bypass the journal
+    **/
+    //@{
+    TileMap &getTiles() { return tiles; }
+    CollisionMask &getCollision() { return collision; }
+    EmitterIndex &getEmitters() { return emitters; }
+    EditJournal &getJournal() { return journal; }
+    //@}
+
+    /** \name Edit operations
+    *** \brief Cells outside the map are ignored and only what changes goes
+    ***        in the journal, if it's open.
+    ***        setObject() paints the x1, y1 - x2, y2 area of a tileset, in
+    ***        tiles, with its top left corner at x, y; the tilesets are
+    ***        TILESIZE tiles tall. floodFill() replaces every tile of the
+    ***        layer that looks like the one at x, y. setTiles() pastes
+    ***        count tiles of row y from x on, emitters included.
+    **/
+    //@{
+    void setTile(int lay, int x, int y, int index, int tileset);
+    void setTiles(int lay, int x, int y, const Tile *row, int count);
+    void setObject(int lay, int x, int y, int x1, int y1, int x2, int y2, int tileset);
+    void floodFill(int lay, int x, int y, int index, int tileset);
+    void setCollision(int x1, int y1, int x2, int y2, bool value);
+    void setEmitter(int lay, int x, int y, short value);
+    //@}
+
+    /** \name File IO
+    *** \brief load() reads a v2 or an old .dat map whole, save() writes the
+    ***        v2 format and exportMap() the old layout. Saves are marked in
+    ***        the journal, which starts over on top of the file once it's
+    ***        written.
+    *** \param threads Threads the chunks are encoded and decoded on, 0 for
+    ***        one per processor
+    *** \return false if the file couldn't be read or written, or a load
+    ***         found damaged chunks or .dat tiles that don't fit a Tile;
+    ***         getLoadDamaged() and getLoadBadTiles() tell how many
+    **/
+    //@{
+    bool load(const string &path, int threads = 0);
+    int getLoadDamaged() { return load_damaged; }
+    int getLoadBadTiles() { return load_bad_tiles; }
+    bool save(const string &path, int threads = 0);
+    bool exportMap(const string &path);
+    //@}
+private:
+    TileMap tiles;
+    CollisionMask collision;
+    EmitterIndex emitters;
+    EditJournal journal;
+    int load_damaged, load_bad_tiles;   //!< See load()
+};
+
+#endif // MAPDOCUMENT_H
@@ -0,0 +1,696 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapfile.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the map file format, version 2.
+******************************************************************************/
+
+#include "mapfile.h"
+#include "..\utils\mappedfile.h"
+#include "..\utils\crc32.h"
+#include "chunkcodec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+static const char zeros[MAPFILE_PAGE] = { 0 };
+
+static inline uint64_t chunkKey(int cx, int cy) {
+    return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+}
+
+static int seekFile(FILE *file, uint64_t pos) {
+#ifdef _WIN32
+    return fseeko64(file, (int64_t)pos, SEEK_SET);
+#else
+    return fseeko(file, (off_t)pos, SEEK_SET);
+#endif
+}
+
+// One chunk on its way through the workers
+typedef struct ChunkJob {
+    Tile tiles[CHUNK_TILES];
+    vector<unsigned char> payload;
+    const MapFileChunk *entry;          //!< Being loaded, NULL when saving
+    int lay;
+    int codec;
+    uint32_t crc;
+    bool ok;
+} ChunkJob;
+
+// What the decode jobs of a batch share
+typedef struct DecodeBatch {
+    MapFile *file;
+    ChunkJob **jobs;
+} DecodeBatch;
+
+// Orders a load's chunks farthest from the focus chunk first, the lower
+// layers last among the same distance
+struct LoadDistance {
+    const vector<const MapFileChunk*> *entries;
+    int cx, cy;
+
+    LoadDistance(const vector<const MapFileChunk*> &list, int x, int y) :
+        entries(&list), cx(x), cy(y) {}
+
+    int distance(int n) const {
+        int dx = abs((*entries)[n]->cx - cx), dy = abs((*entries)[n]->cy - cy);
+        return max(dx, dy);
+    }
+
+    bool operator()(int a, int b) const {
+        int da = distance(a), db = distance(b);
+        return (da != db) ? da > db : a > b;
+    }
+};
+
+static void encodeJob(void *context, int index) {
+    ChunkJob &job = ((ChunkJob*)context)[index];
+    job.codec = encodeChunk(job.tiles, job.payload);
+    job.crc = crc32(0, &job.payload[0], job.payload.size());
+}
+
+static void decodeJob(void *context, int index) {
+    DecodeBatch *batch = (DecodeBatch*)context;
+    ChunkJob &job = *batch->jobs[index];
+    job.ok = batch->file->readChunk(*job.entry, job.tiles);
+}
+
+MapFile::MapFile() {
+    file = NULL;
+    save_changes = false;
+    save_copy = false;
+    memset(&header, 0, sizeof(header));
+
+    load_total = load_done = load_damaged = 0;
+    load_sorted = -1;
+    load_focus_x = load_focus_y = load_serial = 0;
+    load_stop = false;
+}
+
+MapFile::~MapFile() {
+    for (size_t n = 0; n < load_jobs.size(); n++) delete load_jobs[n];
+    delete file;
+}
+
+bool MapFile::inFile(uint64_t offset, uint64_t size) {
+    return offset <= file->getSize() && size <= file->getSize() - offset;
+} // bool MapFile::inFile(uint64_t offset, uint64_t size)
+
+bool MapFile::open(const string &path) {
+    delete file;
+    file = new MappedFile;
+    memset(&header, 0, sizeof(header));
+    layer.clear();
+    table.clear();
+    table_index.clear();
+
+    if (!file->open(path) || file->getSize() < sizeof(MapFileHeader)) {
+        delete file;
+        file = NULL;
+        return false;
+    }
+
+    const char *data = file->getData();
+    memcpy(&header, data, sizeof(header));
+
+    MapFileHeader check = header;
+    check.header_crc = 0;
+
+    bool valid = memcmp(header.magic, MAPFILE_MAGIC, 4) == 0 && header.version == MAPFILE_VERSION &&
+                 header.header_crc == crc32(0, &check, sizeof(check)) &&
+                 header.chunk_size == CHUNK_SIZE && header.layers > 0 &&
+                 header.width > 0 && header.height > 0 &&
+                 header.width <= 0x7FFFFFFF && header.height <= 0x7FFFFFFF &&
+                 inFile(header.layer_table, header.dir_size) &&
+                 crc32(0, data + header.layer_table, header.dir_size) == header.dir_crc &&
+                 inFile(header.layer_table, (uint64_t)header.layers * sizeof(MapFileLayer)) &&
+                 inFile(header.emitter_table, (uint64_t)header.emitter_count * sizeof(MapFileEmitter)) &&
+                 inFile(header.collision_table, (uint64_t)header.collision_count * sizeof(MapFileCollision));
+
+    // Copy the tables out, the directory has no alignment guarantees
+    if (valid) {
+        layer.resize(header.layers);
+        memcpy(&layer[0], data + header.layer_table, header.layers * sizeof(MapFileLayer));
+
+        table.resize(header.layers);
+        for (uint32_t l = 0; l < header.layers && valid; l++) {
+            valid = inFile(layer[l].chunk_table, (uint64_t)layer[l].chunk_count * sizeof(MapFileChunk));
+            if (!valid || layer[l].chunk_count == 0) continue;
+
+            table[l].resize(layer[l].chunk_count);
+            memcpy(&table[l][0], data + layer[l].chunk_table, layer[l].chunk_count * sizeof(MapFileChunk));
+        }
+    }
+
+    if (!valid) {
+        delete file;
+        file = NULL;
+        layer.clear();
+        table.clear();
+        return false;
+    }
+
+    return true;
+} // bool MapFile::open(const string &path)
+
+const MapFileChunk *MapFile::findChunk(int lay, int cx, int cy) {
+    if (table_index.size() != table.size()) {
+        table_index.resize(table.size());
+        for (size_t l = 0; l < table.size(); l++) {
+            table_index[l].clear();
+            for (size_t n = 0; n < table[l].size(); n++) {
+                table_index[l].push_back(make_pair(chunkKey(table[l][n].cx, table[l][n].cy), (int)n));
+            }
+            sort(table_index[l].begin(), table_index[l].end());
+        }
+    }
+
+    uint64_t key = chunkKey(cx, cy);
+    vector< pair<uint64_t, int> >::iterator it;
+    it = lower_bound(table_index[lay].begin(), table_index[lay].end(), make_pair(key, -1));
+    if (it == table_index[lay].end() || it->first != key) return NULL;
+    return &table[lay][it->second];
+} // const MapFileChunk *MapFile::findChunk(int lay, int cx, int cy)
+
+bool MapFile::readChunk(const MapFileChunk &entry, Tile *out) {
+    if (file == NULL || !inFile(entry.offset, entry.size)) return false;
+
+    const char *payload = file->getData() + entry.offset;
+    if (crc32(0, payload, entry.size) != entry.crc) return false;
+
+    if (entry.raw_size != MAPFILE_CHUNK_RAW) return false;
+    return decodeChunk(entry.codec, (const unsigned char*)payload, entry.size, out);
+} // bool MapFile::readChunk(const MapFileChunk &entry, Tile *out)
+
+void MapFile::loadCollision(CollisionMask &collision) {
+    if (file == NULL) return;
+
+    const char *pos = file->getData() + header.collision_table;
+    for (uint32_t n = 0; n < header.collision_count; n++, pos += sizeof(MapFileCollision)) {
+        MapFileCollision entry;
+        memcpy(&entry, pos, sizeof(entry));
+        if (entry.cx < 0 || entry.cy < 0) continue;
+
+        CollisionChunk *chunk = collision.getChunk(entry.cx, entry.cy);
+        memcpy(chunk->rows, entry.rows, sizeof(chunk->rows));
+    }
+} // void MapFile::loadCollision(CollisionMask &collision)
+
+int MapFile::verify() {
+    int damaged = 0;
+    for (size_t l = 0; l < table.size(); l++) {
+        for (size_t n = 0; n < table[l].size(); n++) {
+            const MapFileChunk &entry = table[l][n];
+            if (!inFile(entry.offset, entry.size) ||
+                crc32(0, file->getData() + entry.offset, entry.size) != entry.crc) damaged++;
+        }
+    }
+    return damaged;
+} // int MapFile::verify()
+
+bool MapFile::load(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters) {
+    beginLoad(tilemap, collision, emitters);
+    finishLoad(tilemap);
+    endLoad(tilemap);
+    return load_damaged == 0;
+} // bool MapFile::load(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters)
+
+void MapFile::beginLoad(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters) {
+    load_entries.clear();
+    load_lays.clear();
+    load_order.clear();
+    load_total = load_done = load_damaged = 0;
+    if (file == NULL) return;
+
+    const char *data = file->getData();
+    int chunks_x = tilemap.getChunksX(), chunks_y = tilemap.getChunksY();
+
+    for (uint32_t l = 0; l < header.layers; l++) {
+        Tile fill;
+        fill.bits = layer[l].fill;
+        tilemap.setFill(l, fill);
+
+        for (size_t n = 0; n < table[l].size(); n++) {
+            const MapFileChunk &entry = table[l][n];
+            if (entry.cx < 0 || entry.cx >= chunks_x || entry.cy < 0 || entry.cy >= chunks_y) continue;
+
+            // Raw chunks stay in the file, the chunk just points at their page.
+            // Their CRC is left to verify(), checking it would read the whole map
+            if (entry.codec == CODEC_RAW && entry.size == MAPFILE_CHUNK_RAW &&
+                entry.offset % sizeof(Tile) == 0 && inFile(entry.offset, entry.size)) {
+                tilemap.attachMapped(l, entry.cx, entry.cy, (Tile*)(data + entry.offset));
+                continue;
+            }
+
+            // Compressed chunks are left to the workers
+            load_order.push_back((int)load_entries.size());
+            load_entries.push_back(&entry);
+            load_lays.push_back(l);
+        }
+    }
+
+    const char *pos = data + header.emitter_table;
+    for (uint32_t n = 0; n < header.emitter_count; n++, pos += sizeof(MapFileEmitter)) {
+        MapFileEmitter entry;
+        memcpy(&entry, pos, sizeof(entry));
+        if (tilemap.contains(entry.lay, entry.x, entry.y)) {
+            emitters.set(entry.lay, entry.x, entry.y, (short)entry.type);
+        }
+    }
+
+    loadCollision(collision);
+
+    // Everything matches the file now, the compressed chunks are flagged as
+    // they're installed
+    tilemap.setSaved(file->getPath());
+    collision.setSaved();
+    emitters.setSaved();
+
+    load_total = (int)load_entries.size();
+    load_jobs.resize(min(load_total, MAPFILE_LOAD_JOBS));
+    for (size_t n = 0; n < load_jobs.size(); n++) load_jobs[n] = new ChunkJob;
+
+    load_free = load_jobs;
+    load_ready.clear();
+    load_focus_x = load_focus_y = 0;
+    load_serial = 0;
+    load_sorted = -1;
+    load_stop = false;
+} // void MapFile::beginLoad(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters)
+
+void MapFile::setLoadFocus(int x, int y) {
+    x >>= CHUNK_SHIFT;
+    y >>= CHUNK_SHIFT;
+
+    // Only a new chunk is worth sorting the queue again
+    load_lock.lock();
+    if (x != load_focus_x || y != load_focus_y) {
+        load_focus_x = x;
+        load_focus_y = y;
+        load_serial++;
+    }
+    load_lock.unlock();
+} // void MapFile::setLoadFocus(int x, int y)
+
+void MapFile::stopLoad() {
+    load_lock.lock();
+    load_stop = true;
+    load_lock.unlock();
+    load_freed.wake();
+} // void MapFile::stopLoad()
+
+void MapFile::decodeLoad() {
+    for (;;) {
+        load_lock.lock();
+        bool stop = load_stop;
+        load_lock.unlock();
+
+        if (stop || !decodeBatch()) break;
+    }
+} // void MapFile::decodeLoad()
+
+bool MapFile::decodeBatch() {
+    if (load_order.empty()) return false;
+
+    // Wait for the editing thread to install some if it's behind
+    load_lock.lock();
+    while (load_free.empty() && !load_stop) load_freed.wait(load_lock);
+
+    int count = (int)min(min(load_free.size(), load_order.size()), (size_t)MAPFILE_BATCH);
+    vector<ChunkJob*> jobs(load_free.end() - count, load_free.end());
+    load_free.resize(load_free.size() - count);
+
+    int serial = load_serial;
+    LoadDistance distance(load_entries, load_focus_x, load_focus_y);
+    load_lock.unlock();
+
+    if (count == 0) return false;
+
+    // The view moved on, the nearest chunks go to the back again
+    if (serial != load_sorted) {
+        sort(load_order.begin(), load_order.end(), distance);
+        load_sorted = serial;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int n = load_order.back();
+        load_order.pop_back();
+        jobs[i]->entry = load_entries[n];
+        jobs[i]->lay = load_lays[n];
+    }
+
+    DecodeBatch batch;
+    batch.file = this;
+    batch.jobs = &jobs[0];
+    pool.run(count, decodeJob, &batch);
+
+    load_lock.lock();
+    for (int i = 0; i < count; i++) load_ready.push_back(jobs[i]);
+    load_lock.unlock();
+    return true;
+} // bool MapFile::decodeBatch()
+
+int MapFile::installLoad(TileMap &tilemap, int count) {
+    int installed = 0;
+    load_installed.clear();
+
+    // The chunks are allocated and filled in here since getChunk() may page
+    // others out, the workers only ever see their own buffers
+    while (installed < count) {
+        load_lock.lock();
+        ChunkJob *job = NULL;
+        if (!load_ready.empty()) {
+            job = load_ready.front();
+            load_ready.pop_front();
+        }
+        load_lock.unlock();
+        if (job == NULL) break;
+
+        // A damaged chunk reads as the fill but isn't flagged unsaved, so a
+        // save that appends keeps the old payload rather than the fill
+        TileChunk *chunk = tilemap.getChunk(job->lay, job->entry->cx, job->entry->cy);
+        if (chunk->tiles == NULL) {
+            // Listed twice and the swap file lost it since, see hasIOError()
+        } else if (job->ok) {
+            memcpy(chunk->tiles, job->tiles, MAPFILE_CHUNK_RAW);
+        } else {
+            Tile fill = tilemap.getFill(job->lay);
+            for (int t = 0; t < CHUNK_TILES; t++) chunk->tiles[t] = fill;
+            load_damaged++;
+        }
+        chunk->unsaved = false;
+        load_installed.push_back(make_pair(job->lay, job->entry));
+
+        load_lock.lock();
+        load_free.push_back(job);
+        load_lock.unlock();
+        installed++;
+    }
+
+    // Once for the lot, the decoding thread takes them in one batch
+    if (installed > 0) load_freed.wake();
+
+    load_done += installed;
+    return installed;
+} // int MapFile::installLoad(TileMap &tilemap, int count)
+
+void MapFile::finishLoad(TileMap &tilemap) {
+    do {
+        installLoad(tilemap, load_total);
+    } while (decodeBatch());
+} // void MapFile::finishLoad(TileMap &tilemap)
+
+void MapFile::endLoad(TileMap &tilemap) {
+    for (size_t n = 0; n < load_jobs.size(); n++) delete load_jobs[n];
+    load_jobs.clear();
+    load_free.clear();
+    load_ready.clear();
+    load_entries.clear();
+    load_lays.clear();
+    load_order.clear();
+    load_installed.clear();
+    if (file == NULL) return;
+
+    // The TileMap keeps the mapping alive from now on
+    tilemap.setBacking(file);
+    file = NULL;
+} // void MapFile::endLoad(TileMap &tilemap)
+
+bool MapFile::save(const string &path, TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters) {
+    beginSave(path, tilemap, collision, emitters);
+    bool ok = writeSave();
+    endSave(ok);
+    return ok;
+} // bool MapFile::save(const string &path, TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters)
+
+void MapFile::beginSave(const string &path, TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, bool copy) {
+    save_path = path;
+    save_copy = copy;
+
+    // A chunk the swap file lost can't be written, no snapshot fails the save
+    if (tilemap.hasIOError()) return;
+
+    // A map saved to the file it came from only appends what changed, unless
+    // the file is mostly dead space by now and is better written anew
+    save_changes = !copy && tilemap.getSource() == path && open(path) && (int)header.layers == tilemap.getLayers() &&
+                   (int)header.width == tilemap.getWidth() && (int)header.height == tilemap.getHeight() &&
+                   getDeadSpace() <= max(getLiveSpace(), (uint64_t)MAPFILE_SLACK);
+
+    // Only the tables are needed from here on
+    delete file;
+    file = NULL;
+
+    // Don't write over the pages the map is reading from
+    if (!save_changes && tilemap.getBacking() != NULL && tilemap.getBacking()->getPath() == path) {
+        tilemap.detachBacking();
+    }
+
+    // Edits made from now on are the next save's
+    snapshot.take(tilemap, collision, emitters, save_changes);
+    if (copy) return;
+
+    tilemap.setSaved(path);
+    collision.setSaved();
+    emitters.setSaved();
+} // void MapFile::beginSave(const string &path, TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, bool copy)
+
+bool MapFile::writeSave() {
+    if (!snapshot.isTaken()) return false;
+    if (save_changes && !snapshot.isModified()) return true;
+
+    return save_changes ? writeChanges() : writeAll();
+} // bool MapFile::writeSave()
+
+void MapFile::endSave(bool ok) {
+    // A copy never marked the map saved, there's nothing to take back
+    snapshot.release(ok || save_copy);
+} // void MapFile::endSave(bool ok)
+
+uint64_t MapFile::getLiveSpace() {
+    uint64_t live = 0;
+    for (size_t l = 0; l < table.size(); l++) {
+        for (size_t n = 0; n < table[l].size(); n++) live += table[l][n].size;
+    }
+    return live;
+} // uint64_t MapFile::getLiveSpace()
+
+uint64_t MapFile::getDeadSpace() {
+    // Everything past the header page that isn't a chunk: replaced chunks,
+    // old directories, the current one and the page padding
+    uint64_t used = MAPFILE_PAGE + getLiveSpace();
+    return (header.file_size > used) ? header.file_size - used : 0;
+} // uint64_t MapFile::getDeadSpace()
+
+bool MapFile::writeAll() {
+    // Written next to the old file and moved over it once it's whole, so the
+    // old one is there to fall back on until the very end
+    string temp = save_path + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (out == NULL) return false;
+
+    vector<SnapshotChunk> &chunks = snapshot.getChunks();
+    vector<MapFileChunk> entries(chunks.size());
+    vector<int> order;
+    for (size_t n = 0; n < chunks.size(); n++) order.push_back(n);
+
+    // The header goes in last, keep its page for now
+    bool ok = fwrite(zeros, MAPFILE_PAGE, 1, out) == 1;
+    uint64_t offset = MAPFILE_PAGE;
+
+    if (ok) ok = writeChunks(out, offset, order, entries);
+    if (ok) ok = writeDirectory(out, offset, entries);
+
+    if (fclose(out) != 0) ok = false;
+    if (ok) ok = replaceFile(temp, save_path);
+    if (!ok) remove(temp.c_str());
+    return ok;
+} // bool MapFile::writeAll()
+
+bool MapFile::writeChanges() {
+
+    // The chunks already in the file, by layer and coordinates
+    vector< map<uint64_t, MapFileChunk> > saved(table.size());
+    for (size_t l = 0; l < table.size(); l++) {
+        for (size_t n = 0; n < table[l].size(); n++) {
+            saved[l][chunkKey(table[l][n].cx, table[l][n].cy)] = table[l][n];
+        }
+    }
+
+    // Unchanged chunks keep their old entry, the others are appended. The
+    // mapped ones are never written over, new data only goes past the end
+    vector<SnapshotChunk> &chunks = snapshot.getChunks();
+    vector<MapFileChunk> entries(chunks.size());
+    vector<int> order;
+    for (size_t n = 0; n < chunks.size(); n++) {
+        if (chunks[n].changed) {
+            order.push_back(n);
+            continue;
+        }
+
+        map<uint64_t, MapFileChunk>::iterator it = saved[chunks[n].lay].find(chunkKey(chunks[n].cx, chunks[n].cy));
+        if (it == saved[chunks[n].lay].end()) return false;
+        entries[n] = it->second;
+    }
+
+    FILE *out = fopen(save_path.c_str(), "r+b");
+    if (out == NULL) return false;
+
+    // Until the header is rewritten the file still reads as the old map
+    uint64_t offset = header.file_size;
+    bool ok = seekFile(out, offset) == 0;
+    if (ok) ok = writeChunks(out, offset, order, entries);
+    if (ok) ok = writeDirectory(out, offset, entries);
+
+    if (fclose(out) != 0) ok = false;
+    return ok;
+} // bool MapFile::writeChanges()
+
+bool MapFile::writeChunks(FILE *out, uint64_t &offset, const vector<int> &order, vector<MapFileChunk> &entries) {
+    vector<SnapshotChunk> &chunks = snapshot.getChunks();
+
+    // Payloads, each encoded with whichever codec makes it smallest. Raw
+    // chunks start on a page so the file can be mapped, the others are
+    // packed tight. They are gathered in a staging buffer and written
+    // MAPFILE_STAGE bytes at once
+    vector<unsigned char> stage;
+    stage.reserve(MAPFILE_STAGE + 2 * MAPFILE_PAGE);
+    bool ok = true;
+    FILE *swap = NULL;
+
+    // Chunks go to the workers a batch at a time and the payloads are
+    // written back in chunk order, whichever job finished first
+    vector<ChunkJob> jobs(MAPFILE_BATCH);
+    for (size_t first = 0; first < order.size() && ok; first += MAPFILE_BATCH) {
+        int count = (int)min((size_t)MAPFILE_BATCH, order.size() - first);
+        for (int i = 0; i < count && ok; i++) {
+            ok = snapshot.readTiles(chunks[order[first + i]], jobs[i].tiles, swap);
+        }
+        if (!ok) break;
+
+        pool.run(count, encodeJob, &jobs[0]);
+
+        for (int i = 0; i < count && ok; i++) {
+            const ChunkJob &job = jobs[i];
+            const SnapshotChunk &chunk = chunks[order[first + i]];
+
+            if (job.codec == CODEC_RAW) {
+                size_t pad = (size_t)((MAPFILE_PAGE - offset % MAPFILE_PAGE) % MAPFILE_PAGE);
+                stage.insert(stage.end(), zeros, zeros + pad);
+                offset += pad;
+            }
+
+            MapFileChunk &entry = entries[order[first + i]];
+            memset(&entry, 0, sizeof(entry));
+            entry.cx = chunk.cx;
+            entry.cy = chunk.cy;
+            entry.offset = offset;
+            entry.size = job.payload.size();
+            entry.raw_size = MAPFILE_CHUNK_RAW;
+            entry.crc = job.crc;
+            entry.codec = job.codec;
+
+            stage.insert(stage.end(), job.payload.begin(), job.payload.end());
+            offset += job.payload.size();
+
+            if (stage.size() >= MAPFILE_STAGE) {
+                ok = fwrite(&stage[0], stage.size(), 1, out) == 1;
+                stage.clear();
+            }
+        }
+    }
+    if (ok && !stage.empty()) ok = fwrite(&stage[0], stage.size(), 1, out) == 1;
+
+    if (swap != NULL) fclose(swap);
+    return ok;
+} // bool MapFile::writeChunks(FILE *out, uint64_t &offset, const vector<int> &order, vector<MapFileChunk> &entries)
+
+bool MapFile::writeDirectory(FILE *out, uint64_t offset, const vector<MapFileChunk> &entries) {
+    vector<SnapshotChunk> &chunks = snapshot.getChunks();
+    vector<CollisionChunk> &blocks = snapshot.getCollision();
+    vector<EmitterCell> &cells = snapshot.getEmitters();
+    int layers = snapshot.getLayers();
+
+    // The directory is put together in memory and written in one go
+    MapFileHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, MAPFILE_MAGIC, 4);
+    head.version = MAPFILE_VERSION;
+    head.layers = layers;
+    head.width = snapshot.getWidth();
+    head.height = snapshot.getHeight();
+    head.chunk_size = CHUNK_SIZE;
+    head.emitter_count = cells.size();
+    head.collision_count = blocks.size();
+
+    vector<char> dir;
+    head.layer_table = offset;
+    dir.resize(layers * sizeof(MapFileLayer));
+
+    // The snapshot's chunks are sorted by layer, so each table is one run
+    size_t n = 0;
+    for (int l = 0; l < layers; l++) {
+        size_t first = n;
+        while (n < chunks.size() && chunks[n].lay == l) n++;
+
+        MapFileLayer entry;
+        entry.fill = snapshot.getFill(l).bits;
+        entry.chunk_count = n - first;
+        entry.chunk_table = offset + dir.size();
+        memcpy(&dir[l * sizeof(MapFileLayer)], &entry, sizeof(entry));
+
+        if (n > first) {
+            const char *p = (const char*)&entries[first];
+            dir.insert(dir.end(), p, p + (n - first) * sizeof(MapFileChunk));
+        }
+    }
+
+    head.emitter_table = offset + dir.size();
+    for (size_t i = 0; i < cells.size(); i++) {
+        MapFileEmitter entry;
+        entry.lay = cells[i].lay;
+        entry.x = cells[i].x;
+        entry.y = cells[i].y;
+        entry.type = cells[i].type;
+        const char *p = (const char*)&entry;
+        dir.insert(dir.end(), p, p + sizeof(entry));
+    }
+
+    head.collision_table = offset + dir.size();
+    for (size_t i = 0; i < blocks.size(); i++) {
+        MapFileCollision entry;
+        entry.cx = blocks[i].cx;
+        entry.cy = blocks[i].cy;
+        memcpy(entry.rows, blocks[i].rows, sizeof(entry.rows));
+        const char *p = (const char*)&entry;
+        dir.insert(dir.end(), p, p + sizeof(entry));
+    }
+
+    head.dir_size = dir.size();
+    head.dir_crc = crc32(0, &dir[0], dir.size());
+    head.file_size = offset + dir.size();
+    head.header_crc = crc32(0, &head, sizeof(head));
+
+    bool ok = fwrite(&dir[0], dir.size(), 1, out) == 1;
+    if (ok) ok = fseek(out, 0, SEEK_SET) == 0 && fwrite(&head, sizeof(head), 1, out) == 1;
+    return ok;
+} // bool MapFile::writeDirectory(FILE *out, uint64_t offset, const vector<MapFileChunk> &entries)
@@ -0,0 +1,327 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapfile.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the map file format, version 2.
+***
+*** This code provides the MapFile class, which reads and writes the v2 map
+*** container. The old .dat layout (version 1) is handled by LegacyMapFile.
+***
+*** Layout, all fields native (little) endian:
+***   -# MapFileHeader, padded to MAPFILE_PAGE
+***   -# the chunk payloads, see chunkcodec.h. Raw ones start on a page
+***   -# the directory: layers MapFileLayer entries, every layer's
+***      MapFileChunk table, the MapFileEmitter cells and the
+***      MapFileCollision chunks
+***
+*** The header is written last and points at the directory, which holds the
+*** offset, sizes and CRC of every chunk, so any chunk can be read on its
+*** own. Saving over the file a map came from appends the changed chunks and
+*** a new directory, then rewrites the header; the old payloads and
+*** directories are left as dead space until the file is written anew.
+***
+*** Raw chunks are byte for byte the same as a TileChunk's tiles, so opening
+*** a map maps the file and points the chunks at it; no tile is read or
+*** copied until it's edited.
+******************************************************************************/
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "tilemap.h"
+#include "collisionmask.h"
+#include "emitterindex.h"
+#include "mapsnapshot.h"
+#include "..\utils\workerpool.h"
+
+using namespace std;
+
+class MappedFile;
+struct ChunkJob;
+
+/** \def File format constants
+**/
+//@{
+#define MAPFILE_MAGIC       "AMAP"
+#define MAPFILE_VERSION     2
+#define MAPFILE_PAGE        4096
+//! The bytes taken by one chunk's tiles
+#define MAPFILE_CHUNK_RAW   (CHUNK_TILES * sizeof(Tile))
+//! Payloads are written in blocks of about this size
+#define MAPFILE_STAGE       (1024 * 1024)
+//! Chunks handed to the workers at once, each takes MAPFILE_CHUNK_RAW
+#define MAPFILE_BATCH       256
+//! Decoded chunks a progressive load may hold before they're installed
+#define MAPFILE_LOAD_JOBS   (4 * MAPFILE_BATCH)
+//! Dead bytes a file may gather before it's compacted, whatever its size
+#define MAPFILE_SLACK       (4 * 1024 * 1024)
+//@}
+
+/** \struct MapFileHeader mapfile.h "src\map\mapfile.h"
+*** \brief The first bytes of a map file
+**/
+typedef struct MapFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t layers, width, height;
+    uint32_t chunk_size;                //!< CHUNK_SIZE the file was written with
+    uint32_t emitter_count;
+    uint32_t collision_count;
+    uint32_t dir_size;                  //!< Size of the directory, in bytes
+    uint32_t dir_crc;                   //!< CRC of the whole directory
+    uint32_t header_crc;                //!< CRC of the header, taken with this field at 0
+    uint32_t flags;                     //!< Reserved, 0
+    uint64_t layer_table;               //!< Where the directory starts
+    uint64_t emitter_table;
+    uint64_t collision_table;
+    uint64_t file_size;                 //!< End of the directory and of the file
+} MapFileHeader;
+
+/** \struct MapFileLayer mapfile.h "src\map\mapfile.h"
+*** \brief A layer: its fill tile and chunk table
+**/
+typedef struct MapFileLayer {
+    uint32_t fill;
+    uint32_t chunk_count;
+    uint64_t chunk_table;
+} MapFileLayer;
+
+/** \struct MapFileChunk mapfile.h "src\map\mapfile.h"
+*** \brief Chunk table entry, the payload is size bytes at offset and
+***        decodes to raw_size bytes of tiles
+**/
+typedef struct MapFileChunk {
+    int32_t cx, cy;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t raw_size;
+    uint32_t crc;                       //!< CRC of the payload as stored
+    uint16_t codec;                     //!< One of the CODEC_ identifiers
+    uint16_t flags;                     //!< Reserved, 0
+} MapFileChunk;
+
+/** \struct MapFileEmitter mapfile.h "src\map\mapfile.h"
+*** \brief An emitter cell, so the index is rebuilt without touching the tiles
+**/
+typedef struct MapFileEmitter {
+    int32_t lay, x, y, type;
+} MapFileEmitter;
+
+/** \struct MapFileCollision mapfile.h "src\map\mapfile.h"
+*** \brief A collision chunk, stored inline in the directory
+**/
+typedef struct MapFileCollision {
+    int32_t cx, cy;
+    uint64_t rows[COLLISION_SIZE];
+} MapFileCollision;
+
+/** \class MapFile mapfile.h "src\map\mapfile.h"
+*** \brief Reads and writes the v2 map container
+***
+*** Chunks are encoded and decoded on a WorkerPool, MAPFILE_BATCH at a time.
+*** The TileMap and its pager are only ever touched from the calling thread.
+**/
+class MapFile {
+public:
+    MapFile();
+    ~MapFile();
+
+    /** \name open()
+    *** \brief Maps a map file and checks its header and directory
+    *** \return false if the file can't be mapped or isn't a valid v2 map
+    **/
+    bool open(const string &path);
+
+    /** \name Map sizes, valid after open()
+    **/
+    //@{
+    int getLayers() { return header.layers; }
+    int getWidth() { return header.width; }
+    int getHeight() { return header.height; }
+    //@}
+
+    /** \name Chunk table, valid after open()
+    **/
+    //@{
+    Tile getFill(int lay) { Tile fill; fill.bits = layer[lay].fill; return fill; }
+    int getChunkCount(int lay) { return (int)table[lay].size(); }
+    const MapFileChunk &getChunk(int lay, int n) { return table[lay][n]; }
+    //! The entry of chunk cx, cy, NULL if the layer leaves it to the fill
+    const MapFileChunk *findChunk(int lay, int cx, int cy);
+    //@}
+
+    /** \name readChunk()
+    *** \brief Decodes one chunk's tiles into out, checking its CRC
+    *** \return false if the chunk is damaged
+    **/
+    bool readChunk(const MapFileChunk &entry, Tile *out);
+
+    /** \name loadCollision()
+    *** \brief Fills in collision from the opened file, which keeps it in
+    ***        the directory. collision has to be created beforehand.
+    **/
+    void loadCollision(CollisionMask &collision);
+
+    /** \name verify()
+    *** \brief Checks the CRC of every chunk payload
+    *** \return The number of damaged chunks
+    **/
+    int verify();
+
+    /** \name load()
+    *** \brief Fills in tilemap, collision and emitters from the opened file.
+    ***        tilemap has to be created with the file's sizes beforehand.
+    ***        Raw chunks are mapped rather than read and the mapping is
+    ***        handed over to tilemap.
+    *** \return false if any compressed chunk was damaged, getLoadDamaged()
+    ***         tells how many
+    **/
+    bool load(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters);
+
+    /** \name Progressive loads
+    *** \brief load() split up so the map can be drawn while it's read.
+    ***        beginLoad() does everything but the compressed chunks, which
+    ***        read as the fill until they're in. decodeLoad() decodes them on
+    ***        any thread, the ones nearest to the setLoadFocus() tile first,
+    ***        until they're all done or stopLoad() is called. installLoad()
+    ***        copies up to count of the decoded chunks into tilemap, and once
+    ***        decodeLoad() returned finishLoad() decodes and installs the rest.
+    ***        endLoad() hands the mapping over. Everything but decodeLoad()
+    ***        runs on the thread that edits the map, which mustn't change,
+    ***        save or destroy it until endLoad().
+    ***
+    ***        getLoadDamaged() counts the installed chunks that failed their
+    ***        CRC or wouldn't decode. They read as the fill and aren't
+    ***        flagged unsaved, a save that appends keeps their payload.
+    **/
+    //@{
+    void beginLoad(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters);
+    void setLoadFocus(int x, int y);
+    void decodeLoad();
+    void stopLoad();
+    int installLoad(TileMap &tilemap, int count);
+    void finishLoad(TileMap &tilemap);
+    void endLoad(TileMap &tilemap);
+    int getLoadTotal() { return load_total; }
+    int getLoadDone() { return load_done; }
+    int getLoadDamaged() { return load_damaged; }
+    //! The layer and entry of every chunk the last installLoad() put in
+    const vector< pair<int, const MapFileChunk*> > &getInstalled() { return load_installed; }
+    //@}
+
+    /** \name save()
+    *** \brief Writes a map. If path is the file tilemap was last loaded from
+    ***        or saved to, only the chunks changed since are appended, unless
+    ***        more than half the file (and over MAPFILE_SLACK) is dead space.
+    ***        Otherwise the whole file is written next to path and moved over
+    ***        it once complete; if tilemap is backed by it, its chunks are
+    ***        copied to memory first.
+    *** \return false if the file couldn't be written
+    **/
+    bool save(const string &path, TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters);
+
+    /** \name Background saves
+    *** \brief save() split in three. beginSave() takes a MapSnapshot on the
+    ***        thread that edits the map and returns at once; writeSave() does
+    ***        the writing on any thread while the map keeps being edited;
+    ***        endSave() runs back on the editing thread with its result. The
+    ***        map mustn't be destroyed, loaded into or saved again until then.
+    ***        A copy is written whole and doesn't count as saving the map,
+    ***        what it was last loaded from or saved to is left alone.
+    **/
+    //@{
+    void beginSave(const string &path, TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, bool copy = false);
+    bool writeSave();
+    void endSave(bool ok);
+    //@}
+
+    /** \name setThreads()
+    *** \brief Sets how many threads load() and save() use, 0 for one per processor
+    **/
+    void setThreads(int threads) { pool.setThreads(threads); }
+private:
+    bool inFile(uint64_t offset, uint64_t size);
+
+    //! Decodes the next MAPFILE_BATCH chunks of a load, false once there are none
+    bool decodeBatch();
+
+    /** Payload bytes the opened file's chunks take, and every other byte
+    *** past the header page
+    **/
+    //@{
+    uint64_t getLiveSpace();
+    uint64_t getDeadSpace();
+    //@}
+
+    /** writeSave() helpers, they write what the snapshot holds. writeChanges()
+    *** uses the chunk tables beginSave() read from the old file
+    **/
+    //@{
+    bool writeAll();
+    bool writeChanges();
+    bool writeChunks(FILE *out, uint64_t &offset, const vector<int> &order, vector<MapFileChunk> &entries);
+    bool writeDirectory(FILE *out, uint64_t offset, const vector<MapFileChunk> &entries);
+    //@}
+
+    MappedFile *file;
+    MapFileHeader header;
+    vector<MapFileLayer> layer;
+    vector< vector<MapFileChunk> > table;
+    //! Each layer's table by chunk key, sorted; built by the first findChunk()
+    vector< vector< pair<uint64_t, int> > > table_index;
+
+    WorkerPool pool;
+
+    /** The load in flight. load_order holds the chunks still to decode,
+    *** nearest to the focus last; it and load_sorted are the decoding
+    *** thread's. Jobs go from load_free to load_ready and back, those and
+    *** the focus are shared under load_lock
+    **/
+    //@{
+    vector<const MapFileChunk*> load_entries;
+    vector<int> load_lays;
+    vector<int> load_order;
+    vector<ChunkJob*> load_jobs;
+    int load_total, load_done, load_damaged;
+    vector< pair<int, const MapFileChunk*> > load_installed;
+    int load_sorted;                    //!< The load_serial load_order is sorted for
+
+    Mutex load_lock;
+    Signal load_freed;                  //!< Jobs went back to load_free, or the load stopped
+    vector<ChunkJob*> load_free;
+    deque<ChunkJob*> load_ready;
+    int load_focus_x, load_focus_y, load_serial;
+    bool load_stop;
+    //@}
+
+    /** The save in flight **/
+    //@{
+    MapSnapshot snapshot;
+    string save_path;
+    bool save_changes;                  //!< Appending to the file the map came from
+    bool save_copy;                     //!< See beginSave()
+    //@}
+};
+
+#endif // MAPFILE_H
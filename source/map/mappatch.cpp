@@ -0,0 +1,450 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mappatch.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for map diffs and patches.
+******************************************************************************/
+
+#include "mappatch.h"
+#include "mapfile.h"
+#include "..\utils\crc32.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+//! Chunks are sorted and looked up by this, the way CollisionMask keys them
+static uint64_t chunkKey(int cx, int cy) {
+    return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+}
+
+MapPatch::MapPatch() {
+    layers = width = height = 0;
+} // MapPatch::MapPatch()
+
+MapPatch::~MapPatch() {
+} // MapPatch::~MapPatch()
+
+void MapPatch::clear(int lays, int w, int h) {
+    layers = lays;
+    width = w;
+    height = h;
+    runs.clear();
+    values.clear();
+    offsets.clear();
+    error.clear();
+} // void MapPatch::clear(int lays, int w, int h)
+
+bool MapPatch::fail(const string &why) {
+    if (error.empty()) error = why;
+    return false;
+} // bool MapPatch::fail(const string &why)
+
+void MapPatch::addRuns(int lay, int x, int y, const uint32_t *from, const uint32_t *to, int count) {
+    int i = 0;
+    while (i < count) {
+        if (from[i] == to[i]) {
+            i++;
+            continue;
+        }
+
+        // Stretch the run over short gaps of unchanged cells
+        int end = i + 1;
+        for (int j = end; j < count && j - end < MAPPATCH_GAP; j++) {
+            if (from[j] != to[j]) end = j + 1;
+        }
+
+        MapPatchRun run;
+        run.lay = lay;
+        run.x = x + i;
+        run.y = y;
+        run.count = end - i;
+        runs.push_back(run);
+        offsets.push_back(values.size());
+        values.insert(values.end(), to + i, to + end);
+        i = end;
+    }
+} // void MapPatch::addRuns(int lay, int x, int y, const uint32_t *from, const uint32_t *to, int count)
+
+void MapPatch::compareChunk(int lay, int cx, int cy, const Tile *from, const Tile *to) {
+    int x = cx << CHUNK_SHIFT, y = cy << CHUNK_SHIFT;
+    int w = min(CHUNK_SIZE, width - x), h = min(CHUNK_SIZE, height - y);
+
+    for (int j = 0; j < h; j++) {
+        const Tile *a = from + (j << CHUNK_SHIFT), *b = to + (j << CHUNK_SHIFT);
+        if (memcmp(a, b, w * sizeof(Tile)) != 0) addRuns(lay, x, y + j, (const uint32_t*)a, (const uint32_t*)b, w);
+    }
+} // void MapPatch::compareChunk(int lay, int cx, int cy, const Tile *from, const Tile *to)
+
+// Two maps in memory: comparing two chunks costs what hashing them would, so
+// the chunks are compared straight away and only the rows that differ are
+// looked into
+void MapPatch::compareLayer(TileMap &from, TileMap &to, int lay, bool all, int cx1, int cy1, int cx2, int cy2) {
+    fill_from.assign(CHUNK_TILES, from.getFill(lay));
+    fill_to.assign(CHUNK_TILES, to.getFill(lay));
+
+    // With the same fill on both sides, the chunks stored on neither are
+    // the same
+    vector<uint64_t> keys;
+    if (all && from.getFill(lay) == to.getFill(lay)) {
+        for (int n = 0; n < from.getChunkCount(lay); n++) keys.push_back(chunkKey(from.getChunkAt(lay, n)->cx, from.getChunkAt(lay, n)->cy));
+        for (int n = 0; n < to.getChunkCount(lay); n++) keys.push_back(chunkKey(to.getChunkAt(lay, n)->cx, to.getChunkAt(lay, n)->cy));
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    } else {
+        if (all) {
+            cx1 = cy1 = 0;
+            cx2 = from.getChunksX() - 1;
+            cy2 = from.getChunksY() - 1;
+        }
+        for (int cy = cy1; cy <= cy2; cy++) {
+            for (int cx = cx1; cx <= cx2; cx++) keys.push_back(chunkKey(cx, cy));
+        }
+    }
+
+    for (size_t k = 0; k < keys.size(); k++) {
+        int cx = (int32_t)(uint32_t)keys[k], cy = (int32_t)(keys[k] >> 32);
+
+        // Each map pages its own chunks, one lookup doesn't move the other's
+        TileChunk *a = from.findChunk(lay, cx, cy);
+        TileChunk *b = to.findChunk(lay, cx, cy);
+
+        // A chunk the swap file lost can't be compared, hasIOError() tells
+        if ((a != NULL && a->tiles == NULL) || (b != NULL && b->tiles == NULL)) continue;
+        const Tile *a_tiles = (a != NULL) ? a->tiles : &fill_from[0];
+        const Tile *b_tiles = (b != NULL) ? b->tiles : &fill_to[0];
+
+        if (a_tiles != b_tiles && memcmp(a_tiles, b_tiles, CHUNK_TILES * sizeof(Tile)) != 0) {
+            compareChunk(lay, cx, cy, a_tiles, b_tiles);
+        }
+    }
+} // void MapPatch::compareLayer(TileMap &from, TileMap &to, int lay, bool all, int cx1, int cy1, int cx2, int cy2)
+
+void MapPatch::compareCollision(CollisionMask &from, CollisionMask &to, bool all, int cx1, int cy1, int cx2, int cy2) {
+    vector<uint64_t> keys;
+    if (all) {
+        map<uint64_t, CollisionChunk*>::iterator it;
+        for (it = from.getChunks().begin(); it != from.getChunks().end(); ++it) keys.push_back(chunkKey(it->second->cx, it->second->cy));
+        for (it = to.getChunks().begin(); it != to.getChunks().end(); ++it) keys.push_back(chunkKey(it->second->cx, it->second->cy));
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    } else {
+        for (int cy = cy1; cy <= cy2; cy++) {
+            for (int cx = cx1; cx <= cx2; cx++) keys.push_back(chunkKey(cx, cy));
+        }
+    }
+
+    uint32_t a[COLLISION_SIZE], b[COLLISION_SIZE];
+    for (size_t k = 0; k < keys.size(); k++) {
+        int cx = (int32_t)(uint32_t)keys[k], cy = (int32_t)(keys[k] >> 32);
+        int x = cx << COLLISION_SHIFT;
+        if (cx < 0 || cy < 0 || x >= width) continue;
+
+        CollisionChunk *ca = from.findChunk(cx, cy);
+        CollisionChunk *cb = to.findChunk(cx, cy);
+        int count = min(COLLISION_SIZE, width - x);
+
+        for (int r = 0; r < COLLISION_SIZE && (cy << COLLISION_SHIFT) + r < height; r++) {
+            uint64_t ra = (ca != NULL) ? ca->rows[r] : 0;
+            uint64_t rb = (cb != NULL) ? cb->rows[r] : 0;
+            if (ra == rb) continue;
+
+            for (int i = 0; i < count; i++) {
+                a[i] = (uint32_t)(ra >> i) & 1;
+                b[i] = (uint32_t)(rb >> i) & 1;
+            }
+            addRuns(MAPPATCH_COLLISION, x, (cy << COLLISION_SHIFT) + r, a, b, count);
+        }
+    }
+} // void MapPatch::compareCollision(CollisionMask &from, CollisionMask &to, bool all, int cx1, int cy1, int cx2, int cy2)
+
+bool MapPatch::compare(MapDocument &from, MapDocument &to) {
+    clear(to.getLayers(), to.getWidth(), to.getHeight());
+    if (from.getLayers() != layers || from.getWidth() != width || from.getHeight() != height) {
+        return fail("the maps have different sizes");
+    }
+
+    for (int l = 0; l < layers; l++) compareLayer(from.getTiles(), to.getTiles(), l, true, 0, 0, 0, 0);
+    compareCollision(from.getCollision(), to.getCollision(), true, 0, 0, 0, 0);
+    return true;
+} // bool MapPatch::compare(MapDocument &from, MapDocument &to)
+
+bool MapPatch::compare(MapDocument &from, MapDocument &to, int lay, int x1, int y1, int x2, int y2) {
+    clear(to.getLayers(), to.getWidth(), to.getHeight());
+    if (from.getLayers() != layers || from.getWidth() != width || from.getHeight() != height) {
+        return fail("the maps have different sizes");
+    }
+    if (lay < 0 || lay >= layers) return fail("no such layer");
+
+    x1 = max(x1, 0);
+    y1 = max(y1, 0);
+    x2 = min(x2, width - 1);
+    y2 = min(y2, height - 1);
+    if (x1 > x2 || y1 > y2) return true;
+
+    compareLayer(from.getTiles(), to.getTiles(), lay, false,
+                 x1 >> CHUNK_SHIFT, y1 >> CHUNK_SHIFT, x2 >> CHUNK_SHIFT, y2 >> CHUNK_SHIFT);
+    compareCollision(from.getCollision(), to.getCollision(), false,
+                     x1 >> COLLISION_SHIFT, y1 >> COLLISION_SHIFT, x2 >> COLLISION_SHIFT, y2 >> COLLISION_SHIFT);
+    return true;
+} // bool MapPatch::compare(MapDocument &from, MapDocument &to, int lay, int x1, int y1, int x2, int y2)
+
+// The map against the file it came from: only the chunks edited since are
+// decoded, the rest are what the file holds
+bool MapPatch::compare(MapFile &from, CollisionMask &from_collision, MapDocument &to, int lay, int x1, int y1, int x2, int y2) {
+    clear(to.getLayers(), to.getWidth(), to.getHeight());
+    if (from.getLayers() != layers || from.getWidth() != width || from.getHeight() != height) {
+        return fail("the maps have different sizes");
+    }
+    if (lay < 0 || lay >= layers) return fail("no such layer");
+
+    x1 = max(x1, 0);
+    y1 = max(y1, 0);
+    x2 = min(x2, width - 1);
+    y2 = min(y2, height - 1);
+    if (x1 > x2 || y1 > y2) return true;
+
+    TileMap &tiles = to.getTiles();
+    Tile from_fill = from.getFill(lay), to_fill = tiles.getFill(lay);
+    fill_from.assign(CHUNK_TILES, from_fill);
+    fill_to.assign(CHUNK_TILES, to_fill);
+
+    vector<Tile> from_tiles(CHUNK_TILES);
+    for (int cy = y1 >> CHUNK_SHIFT; cy <= y2 >> CHUNK_SHIFT; cy++) {
+        for (int cx = x1 >> CHUNK_SHIFT; cx <= x2 >> CHUNK_SHIFT; cx++) {
+            const MapFileChunk *entry = from.findChunk(lay, cx, cy);
+            TileChunk *chunk = tiles.findChunk(lay, cx, cy);
+
+            // Chunks untouched since the last load or save are what the file
+            // holds, and those the swap file lost can't be compared
+            if (chunk != NULL && (!chunk->unsaved || chunk->tiles == NULL)) continue;
+            if (chunk == NULL && entry == NULL && from_fill == to_fill) continue;
+
+            // Nor can the damaged ones
+            const Tile *a_tiles = &fill_from[0];
+            if (entry != NULL) {
+                if (!from.readChunk(*entry, &from_tiles[0])) continue;
+                a_tiles = &from_tiles[0];
+            }
+            compareChunk(lay, cx, cy, a_tiles, (chunk != NULL) ? chunk->tiles : &fill_to[0]);
+        }
+    }
+
+    compareCollision(from_collision, to.getCollision(), false,
+                     x1 >> COLLISION_SHIFT, y1 >> COLLISION_SHIFT, x2 >> COLLISION_SHIFT, y2 >> COLLISION_SHIFT);
+    return true;
+} // bool MapPatch::compare(MapFile &from, CollisionMask &from_collision, MapDocument &to, int lay, int x1, int y1, int x2, int y2)
+
+// Two v2 files: a chunk stored alike in both tables holds the same tiles,
+// only the others are decoded
+bool MapPatch::compareLayerFiles(MapFile &from, MapFile &to, int lay) {
+    Tile from_fill = from.getFill(lay), to_fill = to.getFill(lay);
+    fill_from.assign(CHUNK_TILES, from_fill);
+    fill_to.assign(CHUNK_TILES, to_fill);
+
+    vector< pair<uint64_t, int> > from_index, to_index;
+    for (int n = 0; n < from.getChunkCount(lay); n++) from_index.push_back(make_pair(chunkKey(from.getChunk(lay, n).cx, from.getChunk(lay, n).cy), n));
+    for (int n = 0; n < to.getChunkCount(lay); n++) to_index.push_back(make_pair(chunkKey(to.getChunk(lay, n).cx, to.getChunk(lay, n).cy), n));
+    sort(from_index.begin(), from_index.end());
+    sort(to_index.begin(), to_index.end());
+
+    int chunks_x = (width + CHUNK_MASK) >> CHUNK_SHIFT, chunks_y = (height + CHUNK_MASK) >> CHUNK_SHIFT;
+    vector<uint64_t> keys;
+    if (from_fill == to_fill) {
+        for (size_t n = 0; n < from_index.size(); n++) keys.push_back(from_index[n].first);
+        for (size_t n = 0; n < to_index.size(); n++) keys.push_back(to_index[n].first);
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    } else {
+        for (int cy = 0; cy < chunks_y; cy++) {
+            for (int cx = 0; cx < chunks_x; cx++) keys.push_back(chunkKey(cx, cy));
+        }
+    }
+
+    vector<Tile> from_tiles(CHUNK_TILES), to_tiles(CHUNK_TILES);
+    for (size_t k = 0; k < keys.size(); k++) {
+        int cx = (int32_t)(uint32_t)keys[k], cy = (int32_t)(keys[k] >> 32);
+        if (cx < 0 || cx >= chunks_x || cy < 0 || cy >= chunks_y) continue;
+
+        vector< pair<uint64_t, int> >::iterator a, b;
+        a = lower_bound(from_index.begin(), from_index.end(), make_pair(keys[k], -1));
+        b = lower_bound(to_index.begin(), to_index.end(), make_pair(keys[k], -1));
+        const MapFileChunk *from_entry = (a != from_index.end() && a->first == keys[k]) ? &from.getChunk(lay, a->second) : NULL;
+        const MapFileChunk *to_entry = (b != to_index.end() && b->first == keys[k]) ? &to.getChunk(lay, b->second) : NULL;
+
+        if (from_entry != NULL && to_entry != NULL && from_entry->crc == to_entry->crc &&
+            from_entry->codec == to_entry->codec && from_entry->size == to_entry->size &&
+            from_entry->raw_size == to_entry->raw_size) continue;
+        if (from_entry == NULL && to_entry == NULL && from_fill == to_fill) continue;
+
+        const Tile *a_tiles = &fill_from[0], *b_tiles = &fill_to[0];
+        if (from_entry != NULL) {
+            if (!from.readChunk(*from_entry, &from_tiles[0])) return fail("damaged chunk in the first map");
+            a_tiles = &from_tiles[0];
+        }
+        if (to_entry != NULL) {
+            if (!to.readChunk(*to_entry, &to_tiles[0])) return fail("damaged chunk in the second map");
+            b_tiles = &to_tiles[0];
+        }
+        compareChunk(lay, cx, cy, a_tiles, b_tiles);
+    }
+    return true;
+} // bool MapPatch::compareLayerFiles(MapFile &from, MapFile &to, int lay)
+
+bool MapPatch::compareFiles(const string &from_path, const string &to_path) {
+    clear(0, 0, 0);
+
+    MapFile from_file, to_file;
+    if (from_file.open(from_path) && to_file.open(to_path)) {
+        clear(to_file.getLayers(), to_file.getWidth(), to_file.getHeight());
+        if (from_file.getLayers() != layers || from_file.getWidth() != width || from_file.getHeight() != height) {
+            return fail("the maps have different sizes");
+        }
+
+        for (int l = 0; l < layers; l++) {
+            if (!compareLayerFiles(from_file, to_file, l)) return false;
+        }
+
+        CollisionMask from_collision, to_collision;
+        from_collision.create(width, height);
+        to_collision.create(width, height);
+        from_file.loadCollision(from_collision);
+        to_file.loadCollision(to_collision);
+        compareCollision(from_collision, to_collision, true, 0, 0, 0, 0);
+        return true;
+    }
+
+    // Old maps don't keep a chunk table, read them whole
+    MapDocument from, to;
+    if (!from.load(from_path)) return fail("can't read " + from_path);
+    if (!to.load(to_path)) return fail("can't read " + to_path);
+    return compare(from, to);
+} // bool MapPatch::compareFiles(const string &from_path, const string &to_path)
+
+bool MapPatch::apply(MapDocument &document) {
+    error.clear();
+    if (document.getLayers() != layers || document.getWidth() != width || document.getHeight() != height) {
+        return fail("the map has other sizes than the patch");
+    }
+
+    // Every run is checked before the first one goes in
+    for (size_t r = 0; r < runs.size(); r++) {
+        const MapPatchRun &run = runs[r];
+        if ((run.lay != MAPPATCH_COLLISION && (run.lay < 0 || run.lay >= layers)) ||
+            run.count <= 0 || run.x < 0 || run.x > width - run.count || run.y < 0 || run.y >= height) {
+            return fail("the patch doesn't fit the map");
+        }
+    }
+
+    vector<Tile> row;
+    for (size_t r = 0; r < runs.size(); r++) {
+        const MapPatchRun &run = runs[r];
+        const uint32_t *value = &values[offsets[r]];
+
+        if (run.lay == MAPPATCH_COLLISION) {
+            for (int i = 0; i < run.count; i++) {
+                document.setCollision(run.x + i, run.y, run.x + i, run.y, value[i] != 0);
+            }
+        } else {
+            row.resize(run.count);
+            for (int i = 0; i < run.count; i++) row[i].bits = value[i];
+            document.setTiles(run.lay, run.x, run.y, &row[0], run.count);
+        }
+    }
+    return true;
+} // bool MapPatch::apply(MapDocument &document)
+
+bool MapPatch::save(const string &path) {
+    error.clear();
+
+    MapPatchHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, MAPPATCH_MAGIC, 4);
+    head.version = MAPPATCH_VERSION;
+    head.layers = layers;
+    head.width = width;
+    head.height = height;
+    head.run_count = runs.size();
+    head.value_count = values.size();
+    if (!runs.empty()) head.crc = crc32(head.crc, &runs[0], runs.size() * sizeof(MapPatchRun));
+    if (!values.empty()) head.crc = crc32(head.crc, &values[0], values.size() * sizeof(uint32_t));
+
+    FILE *out = fopen(path.c_str(), "wb");
+    if (out == NULL) return fail("can't write " + path);
+
+    bool ok = fwrite(&head, sizeof(head), 1, out) == 1 &&
+              (runs.empty() || fwrite(&runs[0], sizeof(MapPatchRun), runs.size(), out) == runs.size()) &&
+              (values.empty() || fwrite(&values[0], sizeof(uint32_t), values.size(), out) == values.size());
+    if (fclose(out) != 0) ok = false;
+
+    if (!ok) {
+        remove(path.c_str());
+        return fail("can't write " + path);
+    }
+    return true;
+} // bool MapPatch::save(const string &path)
+
+bool MapPatch::load(const string &path) {
+    clear(0, 0, 0);
+
+    FILE *in = fopen(path.c_str(), "rb");
+    if (in == NULL) return fail("can't read " + path);
+
+    MapPatchHeader head;
+    long size = 0;
+    bool ok = fread(&head, sizeof(head), 1, in) == 1 && fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0;
+
+    // The counts have to add up to the file before anything is allocated
+    ok = ok && memcmp(head.magic, MAPPATCH_MAGIC, 4) == 0 && head.version == MAPPATCH_VERSION &&
+         (uint64_t)size == sizeof(head) + (uint64_t)head.run_count * sizeof(MapPatchRun) + (uint64_t)head.value_count * sizeof(uint32_t);
+
+    if (ok) {
+        runs.resize(head.run_count);
+        values.resize(head.value_count);
+        ok = fseek(in, sizeof(head), SEEK_SET) == 0 &&
+             (runs.empty() || fread(&runs[0], sizeof(MapPatchRun), runs.size(), in) == runs.size()) &&
+             (values.empty() || fread(&values[0], sizeof(uint32_t), values.size(), in) == values.size());
+    }
+    fclose(in);
+
+    uint32_t crc = 0;
+    if (ok && !runs.empty()) crc = crc32(crc, &runs[0], runs.size() * sizeof(MapPatchRun));
+    if (ok && !values.empty()) crc = crc32(crc, &values[0], values.size() * sizeof(uint32_t));
+    ok = ok && crc == head.crc;
+
+    // The values have to be just enough for the runs
+    uint64_t total = 0;
+    for (size_t r = 0; ok && r < runs.size(); r++) {
+        offsets.push_back((size_t)total);
+        if (runs[r].count <= 0) ok = false;
+        total += (uint32_t)runs[r].count;
+    }
+    ok = ok && total == values.size();
+
+    if (!ok) {
+        clear(0, 0, 0);
+        return fail(path + " isn't a map patch or is damaged");
+    }
+
+    layers = head.layers;
+    width = head.width;
+    height = head.height;
+    return true;
+} // bool MapPatch::load(const string &path)
@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mappatch.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for map diffs and patches.
+***
+*** This code provides the MapPatch class, which finds what changed between
+*** two versions of a map and carries the changes over to another copy.
+***
+*** Maps are compared a chunk at a time and only the chunks that differ are
+*** looked into. Two v2 files are compared on their chunk tables first: a
+*** chunk with the same CRC, codec and size in both is taken to be the same
+*** and never decoded, so maps that hardly changed diff at the speed of
+*** their directories. A patch holds the runs of changed tiles of each row,
+*** with their new values, and the changed collision cells.
+***
+*** Patch file layout, native (little) endian: a MapPatchHeader, run_count
+*** MapPatchRun entries, then value_count 32-bit values, the tiles of every
+*** run one after the other.
+******************************************************************************/
+
+#ifndef MAPPATCH_H
+#define MAPPATCH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mapdocument.h"
+
+using namespace std;
+
+class MapFile;
+
+/** \def Patch file constants
+**/
+//@{
+#define MAPPATCH_MAGIC     "MPAT"
+#define MAPPATCH_VERSION   1
+//! Layer of the collision runs, their values are 0 or 1
+#define MAPPATCH_COLLISION -1
+//! Unchanged tiles fewer than this between two changes are taken in the
+//! same run, a run entry costs as much as that many values
+#define MAPPATCH_GAP       4
+//@}
+
+/** \struct MapPatchHeader mappatch.h "src\map\mappatch.h"
+*** \brief The first bytes of a patch file, the map sizes are those of both
+***        versions
+**/
+typedef struct MapPatchHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t layers, width, height;
+    uint32_t run_count;
+    uint32_t value_count;
+    uint32_t crc;                       //!< CRC of the runs and the values
+} MapPatchHeader;
+
+/** \struct MapPatchRun mappatch.h "src\map\mappatch.h"
+*** \brief count cells of row y from x on, never past a chunk
+**/
+typedef struct MapPatchRun {
+    int32_t lay, x, y, count;
+} MapPatchRun;
+
+/** \class MapPatch mappatch.h "src\map\mappatch.h"
+*** \brief The changes that turn one version of a map into another
+**/
+class MapPatch {
+public:
+    MapPatch();
+    ~MapPatch();
+
+    /** \name compare()
+    *** \brief Takes the changes from one map to the other. The rectangle
+    ***        overload only looks at the tiles of lay and the collision in
+    ***        the chunks under x1, y1 - x2, y2, for an overlay of what's on
+    ***        screen. compareFiles() takes the chunk table shortcut when both
+    ***        files are v2 maps and loads them whole otherwise.
+    ***
+    ***        The MapFile overload compares to the opened v2 file to was last
+    ***        read from or saved to, and from_collision its collision. Chunks
+    ***        not flagged unsaved still match their table entry and are
+    ***        skipped, only the others are decoded from the file.
+    *** \return false if the maps have different sizes or can't be read
+    **/
+    //@{
+    bool compare(MapDocument &from, MapDocument &to);
+    bool compare(MapDocument &from, MapDocument &to, int lay, int x1, int y1, int x2, int y2);
+    bool compare(MapFile &from, CollisionMask &from_collision, MapDocument &to, int lay, int x1, int y1, int x2, int y2);
+    bool compareFiles(const string &from_path, const string &to_path);
+    //@}
+
+    /** \name apply()
+    *** \brief Carries the changes over to document, through its edit
+    ***        operations so they're journaled. The patch is checked against
+    ***        the map first, so a patch that doesn't fit changes nothing.
+    *** \return false if the map has other sizes or a run falls outside it
+    **/
+    bool apply(MapDocument &document);
+
+    /** \name File IO
+    *** \return false if the file couldn't be written, or isn't a patch
+    **/
+    //@{
+    bool save(const string &path);
+    bool load(const string &path);
+    //@}
+
+    /** \name The changes
+    *** \brief getValue() is the index in getValues() of the first value of
+    ***        a run
+    **/
+    //@{
+    bool isEmpty() { return runs.empty(); }
+    const vector<MapPatchRun> &getRuns() { return runs; }
+    const vector<uint32_t> &getValues() { return values; }
+    size_t getValue(int run) { return offsets[run]; }
+    int getLayers() { return layers; }
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+    //@}
+
+    const string &getError() { return error; }
+private:
+    void clear(int lays, int w, int h);
+    bool fail(const string &why);
+
+    /** Adds the runs of the cells of a row that differ between from and to,
+    *** count cells from x on
+    **/
+    void addRuns(int lay, int x, int y, const uint32_t *from, const uint32_t *to, int count);
+    //! Compares two chunks' tiles, cells outside the map are left out
+    void compareChunk(int lay, int cx, int cy, const Tile *from, const Tile *to);
+
+    /** Compare one layer or the collision. The chunks looked at are those
+    *** in cx1, cy1 - cx2, cy2, or every chunk stored on either side if
+    *** all is set
+    **/
+    //@{
+    void compareLayer(TileMap &from, TileMap &to, int lay, bool all, int cx1, int cy1, int cx2, int cy2);
+    void compareCollision(CollisionMask &from, CollisionMask &to, bool all, int cx1, int cy1, int cx2, int cy2);
+    bool compareLayerFiles(MapFile &from, MapFile &to, int lay);
+    //@}
+
+    int layers, width, height;
+    vector<MapPatchRun> runs;
+    vector<uint32_t> values;
+    vector<size_t> offsets;             //!< Where each run's values start
+
+    vector<Tile> fill_from, fill_to;    //!< A chunk of fill tiles for elided chunks
+    string error;
+};
+
+#endif // MAPPATCH_H
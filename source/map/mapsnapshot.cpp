@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapsnapshot.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the map snapshots taken by the saves.
+******************************************************************************/
+
+#include "mapsnapshot.h"
+
+#include <string.h>
+
+// Same layout as the ChunkPager slots
+#define SLOT_BYTES (CHUNK_TILES * sizeof(Tile))
+
+static int seekSwap(FILE *file, int64_t pos) {
+#ifdef _WIN32
+    return fseeko64(file, pos, SEEK_SET);
+#else
+    return fseeko(file, (off_t)pos, SEEK_SET);
+#endif
+}
+
+MapSnapshot::MapSnapshot() {
+    tilemap = NULL;
+    width = height = 0;
+    modified = false;
+}
+
+MapSnapshot::~MapSnapshot() {
+    release(false);
+}
+
+void MapSnapshot::take(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, bool changes_only) {
+    release(true);
+
+    this->tilemap = &tilemap;
+    width = tilemap.getWidth();
+    height = tilemap.getHeight();
+    modified = tilemap.isModified() || collision.isModified() || emitters.isModified();
+
+    fills.resize(tilemap.getLayers());
+    chunks.clear();
+
+    for (int l = 0; l < tilemap.getLayers(); l++) {
+        fills[l] = tilemap.getFill(l);
+
+        for (int n = 0; n < tilemap.getChunkCount(l); n++) {
+            TileChunk *chunk = tilemap.getChunkAt(l, n);
+
+            SnapshotChunk entry;
+            entry.lay = l;
+            entry.cx = chunk->cx;
+            entry.cy = chunk->cy;
+            entry.tiles = NULL;
+            entry.swap_slot = -1;
+            entry.changed = !changes_only || chunk->unsaved;
+
+            if (entry.changed) {
+                entry.tiles = chunk->tiles;
+                entry.swap_slot = chunk->swap_slot;
+                tilemap.share(chunk);
+            }
+            chunks.push_back(entry);
+        }
+    }
+
+    // The slots of the paged out chunks may still sit in the pager's buffer
+    tilemap.flushSwap();
+    swap_path = tilemap.getSwapPath();
+
+    // The collision and emitters are small next to the tiles, they're copied
+    this->collision.clear();
+    map<uint64_t, CollisionChunk*> &blocks = collision.getChunks();
+    for (map<uint64_t, CollisionChunk*>::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        this->collision.push_back(*it->second);
+    }
+
+    this->emitters.clear();
+    emitters.getAll(this->emitters);
+} // void MapSnapshot::take(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, bool changes_only)
+
+bool MapSnapshot::readTiles(const SnapshotChunk &chunk, Tile *out, FILE *&swap) {
+    if (chunk.tiles != NULL) {
+        memcpy(out, chunk.tiles, SLOT_BYTES);
+        return true;
+    }
+    if (chunk.swap_slot < 0) return false;
+
+    if (swap == NULL) swap = fopen(swap_path.c_str(), "rb");
+    if (swap == NULL) return false;
+
+    return seekSwap(swap, chunk.swap_slot * (int64_t)SLOT_BYTES) == 0 &&
+           fread(out, SLOT_BYTES, 1, swap) == 1;
+} // bool MapSnapshot::readTiles(const SnapshotChunk &chunk, Tile *out, FILE *&swap)
+
+void MapSnapshot::release(bool saved) {
+    if (tilemap == NULL) return;
+
+    tilemap->endShare();
+    if (!saved) tilemap->setSource("");
+    tilemap = NULL;
+
+    chunks.clear();
+    collision.clear();
+    emitters.clear();
+} // void MapSnapshot::release(bool saved)
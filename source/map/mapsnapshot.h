@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapsnapshot.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the map snapshots taken by the saves.
+***
+*** This code provides the MapSnapshot class, a frozen view of a map that a
+*** save can write from another thread while the map keeps being edited.
+*** Taking one copies the collision and emitters but no tiles: the chunks
+*** are shared with the TileMap, which copies them on the next edit instead.
+******************************************************************************/
+
+#ifndef MAPSNAPSHOT_H
+#define MAPSNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "tilemap.h"
+#include "collisionmask.h"
+#include "emitterindex.h"
+
+using namespace std;
+
+/** \struct SnapshotChunk mapsnapshot.h "src\map\mapsnapshot.h"
+*** \brief A chunk as it was when the snapshot was taken
+**/
+typedef struct SnapshotChunk {
+    int lay;
+    int cx, cy;
+    const Tile *tiles;                  //!< The tiles, NULL while they're in the swap file
+    int64_t swap_slot;                  //!< Their swap file slot in that case
+    bool changed;                       //!< false if the file being saved to already holds them
+} SnapshotChunk;
+
+/** \class MapSnapshot mapsnapshot.h "src\map\mapsnapshot.h"
+*** \brief The state of a map at one point, for a save in flight
+***
+*** take() and release() run on the thread that edits the map, everything
+*** in between can run on any thread.
+**/
+class MapSnapshot {
+public:
+    MapSnapshot();
+    ~MapSnapshot();
+
+    /** \name take()
+    *** \brief Records the map as it is now. With changes_only only the chunks
+    ***        flagged unsaved are marked changed, and only those are shared.
+    **/
+    void take(TileMap &tilemap, CollisionMask &collision, EmitterIndex &emitters, bool changes_only);
+
+    /** \name readTiles()
+    *** \brief Copies the tiles of a changed chunk to out. swap is the
+    ***        caller's own handle on the swap file, opened on the first paged
+    ***        out chunk; the caller closes it.
+    *** \return false if the tiles couldn't be read back
+    **/
+    bool readTiles(const SnapshotChunk &chunk, Tile *out, FILE *&swap);
+
+    /** \name release()
+    *** \brief Stops sharing the chunks. If the save failed the map forgets
+    ***        where it was saved, so the next save writes it whole.
+    **/
+    void release(bool saved);
+
+    bool isTaken() { return tilemap != NULL; }
+    //! Wheter anything changed since the last save, at take() time
+    bool isModified() { return modified; }
+
+    int getLayers() { return (int)fills.size(); }
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+    const Tile &getFill(int lay) { return fills[lay]; }
+
+    /** \name Contents, the chunks are sorted by layer
+    **/
+    //@{
+    vector<SnapshotChunk> &getChunks() { return chunks; }
+    vector<CollisionChunk> &getCollision() { return collision; }
+    vector<EmitterCell> &getEmitters() { return emitters; }
+    //@}
+private:
+    TileMap *tilemap;
+    int width, height;
+    bool modified;
+
+    vector<Tile> fills;
+    vector<SnapshotChunk> chunks;
+    vector<CollisionChunk> collision;
+    vector<EmitterCell> emitters;
+    string swap_path;
+};
+
+#endif // MAPSNAPSHOT_H
@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapview.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the viewport math.
+******************************************************************************/
+
+#include "mapview.h"
+
+void initCamera(Camera &view, int px, int py, int w, int h) {
+
+    view.tile_x = 0;
+    view.tile_y = 0;
+    view.tile_w = view.init_w = w;
+    view.tile_h = view.init_h = h;
+
+    view.pos_x = px;
+    view.pos_y = py;
+
+    view.scroll_x = view.scroll_y = 0;
+} // void initCamera(Camera &view, int px, int py, int w, int h)
+
+// TODO: fitCamera() Add SCREEN_H and SCREEN_W for comparison
+void fitCamera(Camera &view, int map_w, int map_h) {
+    if (view.tile_w > map_w) view.tile_w = map_w-1;
+    else if (view.tile_w != view.init_w) view.tile_w = view.init_w;
+    if (view.tile_h > map_h) view.tile_h = map_h-1;
+    else if (view.tile_h != view.init_h) view.tile_h = view.init_h;
+} // void fitCamera(Camera &view, int map_w, int map_h)
+
+void scrollCamera(Camera &view, int dx, int dy, int map_w, int map_h) {
+    view.scroll_x += dx;
+    view.scroll_y += dy;
+
+    if (view.scroll_x > map_w - view.tile_w) view.scroll_x = map_w - view.tile_w;
+    if (view.scroll_x < 0) view.scroll_x = 0;
+    if (view.scroll_y > map_h - view.tile_h) view.scroll_y = map_h - view.tile_h;
+    if (view.scroll_y < 0) view.scroll_y = 0;
+} // void scrollCamera(Camera &view, int dx, int dy, int map_w, int map_h)
+
+void getCameraCell(const Camera &view, int px, int py, int &x, int &y) {
+    x = px/TILESIZE+view.scroll_x;
+    y = py/TILESIZE+view.scroll_y-2;
+} // void getCameraCell(const Camera &view, int px, int py, int &x, int &y)
+
+// The brush is plotted from four quadrants in half-tile steps around the
+// cursor, which always adds up to one solid rectangle; its corners are the
+// outermost quadrant offsets
+void getCameraBrush(const Camera &view, int px, int py, int brush_size, int &x1, int &y1, int &x2, int &y2) {
+    int reach = ((brush_size - 1)*TILESIZE)/2;
+
+    x1 = (px - reach)/TILESIZE+view.scroll_x;
+    y1 = (py - reach - TILESIZE)/TILESIZE+view.scroll_y-1;
+    x2 = (px + reach + TILESIZE)/TILESIZE+view.scroll_x;
+    y2 = (py + reach)/TILESIZE+view.scroll_y-1;
+} // void getCameraBrush(const Camera &view, int px, int py, int brush_size, int &x1, int &y1, int &x2, int &y2)
+
+void markViewAll(ViewDirty &dirty) {
+    dirty.any = dirty.all = true;
+} // void markViewAll(ViewDirty &dirty)
+
+// The map cells are moved into the view and clipped to it, each row of them
+// is a run of bits
+void markViewTiles(ViewDirty &dirty, const Camera &view, int x1, int y1, int x2, int y2) {
+    if (dirty.all) return;
+    if (view.tile_w > VIEW_DIRTY_W) {
+        markViewAll(dirty);
+        return;
+    }
+
+    int i1 = x1-view.scroll_x, j1 = y1-view.scroll_y;
+    int i2 = x2-view.scroll_x, j2 = y2-view.scroll_y;
+
+    if (i1 < view.tile_x) i1 = view.tile_x;
+    if (j1 < view.tile_y) j1 = view.tile_y;
+    if (i2 > view.tile_w-1) i2 = view.tile_w-1;
+    if (j2 > view.tile_h-1) j2 = view.tile_h-1;
+    if (i1 > i2 || j1 > j2) return;
+
+    if ((int)dirty.rows.size() < view.tile_h) dirty.rows.resize(view.tile_h, 0);
+
+    // Bits i1 to i2, i2-i1+1 may be a whole word
+    uint64_t run = ((i2-i1+1 == 64) ? ~(uint64_t)0 : (((uint64_t)1 << (i2-i1+1)) - 1)) << i1;
+    for (int j = j1; j <= j2; j++) dirty.rows[j] |= run;
+    dirty.any = true;
+} // void markViewTiles(ViewDirty &dirty, const Camera &view, int x1, int y1, int x2, int y2)
+
+void clearView(ViewDirty &dirty) {
+    for (unsigned int j = 0; j < dirty.rows.size(); j++) dirty.rows[j] = 0;
+    dirty.any = dirty.all = false;
+} // void clearView(ViewDirty &dirty)
+
+int nextViewRun(const ViewDirty &dirty, const Camera &view, int j, int &i) {
+    while (i < view.tile_w && !isViewDirty(dirty, i, j)) i++;
+
+    int n = 0;
+    while (i+n < view.tile_w && isViewDirty(dirty, i+n, j)) n++;
+    return n;
+} // int nextViewRun(const ViewDirty &dirty, const Camera &view, int j, int &i)
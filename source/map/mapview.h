@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapview.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the viewport math.
+***
+*** This code provides the Camera structure and the functions that place it
+*** over the map: sizing it, scrolling it and turning pointer positions into
+*** map cells, and the ViewDirty sets that keep track of the cells of the
+*** view that have to be drawn again. None of it needs a display.
+******************************************************************************/
+
+#ifndef MAPVIEW_H
+#define MAPVIEW_H
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+/** \def This defines the tilesize used through-out the editor
+*** \todo Make the TILESIZE a member of Tile so the editor can use more
+****      tilesizes
+**/
+#define TILESIZE 32
+
+/** \struct Camera mapview.h "src\map\mapview.h"
+*** \brief The Camera structure defines the EditorMain#viewport
+***
+*** This is used in order to save memory and CPU usage by only
+*** rendering the area of the map that we're currently looking at.
+*** It also offers flexibility by defining the position and size of
+*** the viewport, both in pixels or TILESIZE
+**/
+typedef struct Camera {
+    /** The position variables **/
+    //@{
+    short tile_x, tile_y;
+    short pixel_x, pixel_y;
+    //@}
+
+    /** The size variables **/
+    //@{
+    int tile_w, tile_h;
+    int pixel_w, pixel_h;
+    //@}
+
+    /** Size variables used in EditorMain#resetViewport **/
+    //@{
+    int init_w, init_h;
+    //@}
+
+    /** Viewport position on screen **/
+    //@{
+    int pos_x, pos_y;
+    //@}
+
+    /** Scroll variables used with EditorMain#scrollMap() **/
+    //@{
+    int scroll_x, scroll_y;
+    //@}
+} Camera;
+
+/** \name initCamera()
+*** \brief Sets up a viewport of w x h tiles at px, py on screen, scrolled
+***        to the top left corner of the map
+**/
+void initCamera(Camera &view, int px, int py, int w, int h);
+
+/** \name fitCamera()
+*** \brief Shrinks the viewport if the map is smaller than it, or brings
+***        back the size it was created with
+**/
+void fitCamera(Camera &view, int map_w, int map_h);
+
+/** \name scrollCamera()
+*** \brief Scrolls by dx, dy tiles, keeping the viewport over the map
+**/
+void scrollCamera(Camera &view, int dx, int dy, int map_w, int map_h);
+
+/** \name Pointer positions
+*** \brief The positions are in pixels, x from the left of the canvas and y
+***        from two rows above its first row, the way the editor measures
+***        them. getCameraCell() returns the cell under the pointer,
+***        getCameraBrush() the corners of the cells a brush of brush_size
+***        covers around it. Neither is clipped to the map.
+**/
+//@{
+void getCameraCell(const Camera &view, int px, int py, int &x, int &y);
+void getCameraBrush(const Camera &view, int px, int py, int brush_size, int &x1, int &y1, int &x2, int &y2);
+//@}
+
+/** \def The widest view a ViewDirty tracks cell by cell, one word per row.
+***      Anything marked on a wider view marks all of it
+**/
+#define VIEW_DIRTY_W 64
+
+/** \struct ViewDirty mapview.h "src\map\mapview.h"
+*** \brief The cells of a Camera's view that have to be drawn again
+***
+*** Cells are counted the way the view draws them, (i, j) with tile_x <= i
+*** < tile_w and tile_y <= j < tile_h; bit i of rows[j] stands for one.
+*** Cells outside the rows are only dirty when all of them are.
+**/
+typedef struct ViewDirty {
+    vector<uint64_t> rows;
+    bool any;   //!< Some cell is dirty
+    bool all;   //!< Every cell is, the view is drawn anew
+} ViewDirty;
+
+/** \name View dirty cells
+*** \brief markViewAll() marks the whole view, markViewTiles() the map cells
+***        x1, y1 to x2, y2 as far as they're in it. clearView() starts over
+**/
+//@{
+void markViewAll(ViewDirty &dirty);
+void markViewTiles(ViewDirty &dirty, const Camera &view, int x1, int y1, int x2, int y2);
+void clearView(ViewDirty &dirty);
+
+//! Moves i to the next dirty cell of row j from i on, returns how many follow it, 0 if none do
+int nextViewRun(const ViewDirty &dirty, const Camera &view, int j, int &i);
+
+inline bool isViewRowDirty(const ViewDirty &dirty, int j) {
+    if (dirty.all) return true;
+    return j >= 0 && j < (int)dirty.rows.size() && dirty.rows[j] != 0;
+}
+
+inline bool isViewDirty(const ViewDirty &dirty, int i, int j) {
+    if (dirty.all) return true;
+    if (j < 0 || j >= (int)dirty.rows.size() || i < 0 || i >= VIEW_DIRTY_W) return false;
+    return (dirty.rows[j] >> i) & 1;
+}
+//@}
+
+#endif // MAPVIEW_H
@@ -0,0 +1,850 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    textmapfile.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the text map formats.
+******************************************************************************/
+
+#include "textmapfile.h"
+
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+
+//! Tiled keeps the flip flags in the top bits of a gid
+#define GID_FLAGS 0xE0000000u
+
+TextMapFile::TextMapFile() {
+    file = NULL;
+    out_size = 0;
+    out_failed = false;
+    in_pos = in_end = 0;
+    in_eof = true;
+    number = 0;
+    gid = 0;
+    tag_closing = tag_empty = false;
+    map_width = map_height = 0;
+    layer_count = next_layer = 0;
+    current = NULL;
+    put_x = put_y = 0;
+    row_x = row_y = row_count = 0;
+} // TextMapFile::TextMapFile()
+
+TextMapFile::~TextMapFile() {
+    if (file != NULL) fclose(file);
+} // TextMapFile::~TextMapFile()
+
+int TextMapFile::getFormat(const string &path) {
+    size_t dot = path.rfind('.');
+    if (dot == string::npos) return -1;
+
+    string ext = path.substr(dot + 1);
+    for (size_t i = 0; i < ext.size(); i++) ext[i] = tolower(ext[i]);
+
+    if (ext == "tmx") return TEXTMAP_TMX;
+    if (ext == "json") return TEXTMAP_JSON;
+    if (ext == "csv") return TEXTMAP_CSV;
+    return -1;
+} // int TextMapFile::getFormat(const string &path)
+
+uint32_t TextMapFile::tileToGid(const Tile &tile) {
+    int index = tile.getIndex();
+    return tile.getTileset() * TEXTMAP_TILESET_TILES + (index % TILESIZE) * TEXTMAP_COLUMNS + index / TILESIZE + 1;
+} // uint32_t TextMapFile::tileToGid(const Tile &tile)
+
+bool TextMapFile::gidToTile(uint32_t gid, Tile &tile) {
+    gid &= ~GID_FLAGS;
+    if (gid == 0) {
+        tile = makeTile(1, 0, 0);
+        return true;
+    }
+
+    uint32_t local = gid - 1;
+    uint32_t tileset = local / TEXTMAP_TILESET_TILES;
+    if (tileset >= TEXTMAP_TILESETS) return false;
+
+    local %= TEXTMAP_TILESET_TILES;
+    tile = makeTile((local % TEXTMAP_COLUMNS) * TILESIZE + local / TEXTMAP_COLUMNS, tileset, 0);
+    return true;
+} // bool TextMapFile::gidToTile(uint32_t gid, Tile &tile)
+
+/******************************************************************************
+*** Writing
+******************************************************************************/
+
+bool TextMapFile::openWrite(const string &path) {
+    error.clear();
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) return fail("can't write " + path);
+
+    out_buffer.resize(TEXTMAP_BUFFER);
+    out_size = 0;
+    out_failed = false;
+    return true;
+} // bool TextMapFile::openWrite(const string &path)
+
+bool TextMapFile::closeWrite() {
+    if (out_size > 0 && fwrite(&out_buffer[0], 1, out_size, file) != out_size) out_failed = true;
+    out_size = 0;
+    if (fclose(file) != 0) out_failed = true;
+    file = NULL;
+    if (out_failed) return fail("write error");
+    return true;
+} // bool TextMapFile::closeWrite()
+
+void TextMapFile::write(const char *text, size_t size) {
+    if (out_size + size > out_buffer.size()) {
+        if (fwrite(&out_buffer[0], 1, out_size, file) != out_size) out_failed = true;
+        out_size = 0;
+    }
+    if (size > out_buffer.size()) {
+        if (fwrite(text, 1, size, file) != size) out_failed = true;
+        return;
+    }
+    memcpy(&out_buffer[out_size], text, size);
+    out_size += size;
+} // void TextMapFile::write(const char *text, size_t size)
+
+void TextMapFile::write(const char *text) {
+    write(text, strlen(text));
+} // void TextMapFile::write(const char *text)
+
+void TextMapFile::writeInt(uint32_t value) {
+    char digits[12];
+    int n = sizeof(digits);
+    do {
+        digits[--n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    write(digits + n, sizeof(digits) - n);
+} // void TextMapFile::writeInt(uint32_t value)
+
+// One layer's gids, the collision mask or a layer's emitter types, a row at
+// a time, values separated by commas
+void TextMapFile::writeLayerRows(MapDocument &document, int layer, bool emitters, const char *row_end, const char *last_end) {
+    TileMap &tiles = document.getTiles();
+    CollisionMask &collision = document.getCollision();
+    int width = document.getWidth(), height = document.getHeight();
+
+    for (int y = 0; y < height; y++) {
+        if (layer == TEXTMAP_COLLISION) {
+            for (int x = 0; x < width; x++) {
+                if (x > 0) write(",", 1);
+                write(collision.get(x, y) ? "1" : "0", 1);
+            }
+        } else {
+            for (int x = 0; x < width; ) {
+                const Tile *span;
+                int count = tiles.getSpan(layer, x, y, span);
+                for (int i = 0; i < count; i++) {
+                    if (x + i > 0) write(",", 1);
+                    writeInt(emitters ? (uint32_t)span[i].getEmitter() : tileToGid(span[i]));
+                }
+                x += count;
+            }
+        }
+        write(y + 1 < height ? row_end : last_end);
+    }
+} // void TextMapFile::writeLayerRows(MapDocument &document, int layer, bool emitters, const char *row_end, const char *last_end)
+
+bool TextMapFile::hasEmitters(MapDocument &document, int layer) {
+    TileMap &tiles = document.getTiles();
+    for (int y = 0; y < document.getHeight(); y++) {
+        for (int x = 0; x < document.getWidth(); ) {
+            const Tile *span;
+            int count = tiles.getSpan(layer, x, y, span);
+            for (int i = 0; i < count; i++) {
+                if (span[i].getEmitter() != 0) return true;
+            }
+            x += count;
+        }
+    }
+    return false;
+} // bool TextMapFile::hasEmitters(MapDocument &document, int layer)
+
+// The images are named after the mapData.dat objects, TILES1 and on
+void TextMapFile::writeTilesets(int format) {
+    char text[512];
+    for (int t = 0; t < TEXTMAP_TILESETS; t++) {
+        if (format == TEXTMAP_TMX) {
+            snprintf(text, sizeof(text),
+                     " <tileset firstgid=\"%d\" name=\"TILES%d\" tilewidth=\"%d\" tileheight=\"%d\" tilecount=\"%d\" columns=\"%d\">\n"
+                     "  <image source=\"TILES%d.bmp\" width=\"%d\" height=\"%d\"/>\n"
+                     " </tileset>\n",
+                     t * TEXTMAP_TILESET_TILES + 1, t + 1, TILESIZE, TILESIZE, TEXTMAP_TILESET_TILES, TEXTMAP_COLUMNS,
+                     t + 1, TEXTMAP_COLUMNS * TILESIZE, TILESIZE * TILESIZE);
+        } else {
+            snprintf(text, sizeof(text),
+                     "%s\n  {\"firstgid\": %d, \"name\": \"TILES%d\", \"tilewidth\": %d, \"tileheight\": %d, \"tilecount\": %d, "
+                     "\"columns\": %d, \"image\": \"TILES%d.bmp\", \"imagewidth\": %d, \"imageheight\": %d}",
+                     t > 0 ? "," : "", t * TEXTMAP_TILESET_TILES + 1, t + 1, TILESIZE, TILESIZE, TEXTMAP_TILESET_TILES,
+                     TEXTMAP_COLUMNS, t + 1, TEXTMAP_COLUMNS * TILESIZE, TILESIZE * TILESIZE);
+        }
+        write(text);
+    }
+} // void TextMapFile::writeTilesets(int format)
+
+bool TextMapFile::save(const string &path, MapDocument &document, int format) {
+    if (!openWrite(path)) return false;
+
+    char text[512];
+    int width = document.getWidth(), height = document.getHeight();
+
+    if (format == TEXTMAP_TMX) {
+        snprintf(text, sizeof(text),
+                 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                 "<map version=\"1.2\" orientation=\"orthogonal\" renderorder=\"right-down\" width=\"%d\" height=\"%d\" "
+                 "tilewidth=\"%d\" tileheight=\"%d\" infinite=\"0\">\n", width, height, TILESIZE, TILESIZE);
+    } else {
+        snprintf(text, sizeof(text),
+                 "{\"type\": \"map\", \"version\": \"1.2\", \"orientation\": \"orthogonal\", \"renderorder\": \"right-down\",\n"
+                 " \"width\": %d, \"height\": %d, \"tilewidth\": %d, \"tileheight\": %d, \"infinite\": false,\n"
+                 " \"tilesets\": [", width, height, TILESIZE, TILESIZE);
+    }
+    write(text);
+    writeTilesets(format);
+    if (format == TEXTMAP_JSON) write("],\n \"layers\": [");
+
+    // The tiles of every layer, then the collision mask, then the emitters
+    // of the layers that have any
+    int count = 0;
+    for (int l = -1; l < 2 * document.getLayers(); l++) {
+        int layer = (l < 0) ? TEXTMAP_COLLISION : l % document.getLayers();
+        bool emitters = l >= document.getLayers();
+
+        if (emitters && !hasEmitters(document, layer)) continue;
+
+        string name = (layer == TEXTMAP_COLLISION) ? string("collision") : string(emitters ? "emitters " : "layer ");
+        if (layer != TEXTMAP_COLLISION) {
+            snprintf(text, sizeof(text), "%d", layer);
+            name += text;
+        }
+
+        if (format == TEXTMAP_TMX) {
+            snprintf(text, sizeof(text), " <layer name=\"%s\" width=\"%d\" height=\"%d\">\n  <data encoding=\"csv\">\n",
+                     name.c_str(), width, height);
+            write(text);
+            writeLayerRows(document, layer, emitters, ",\n", "\n");
+            write("</data>\n </layer>\n");
+        } else {
+            snprintf(text, sizeof(text), "%s\n  {\"type\": \"tilelayer\", \"name\": \"%s\", \"x\": 0, \"y\": 0, \"width\": %d, "
+                     "\"height\": %d, \"opacity\": 1, \"visible\": %s,\n   \"data\": [", count > 0 ? "," : "",
+                     name.c_str(), width, height, (l < 0 || emitters) ? "false" : "true");
+            write(text);
+            writeLayerRows(document, layer, emitters, ",\n", "");
+            write("]}");
+        }
+        count++;
+    }
+
+    write(format == TEXTMAP_TMX ? "</map>\n" : "\n ]\n}\n");
+
+    // A chunk the swap file lost went out as its summary tile
+    bool ok = closeWrite();
+    if (ok && document.getTiles().hasIOError()) ok = fail("paged out tiles can't be read");
+    if (!ok) {
+        remove(path.c_str());
+        return false;
+    }
+    return true;
+} // bool TextMapFile::save(const string &path, MapDocument &document, int format)
+
+bool TextMapFile::saveCsv(const string &path, MapDocument &document, int layer) {
+    if (layer != TEXTMAP_COLLISION && (layer < 0 || layer >= document.getLayers())) return fail("no such layer");
+    if (!openWrite(path)) return false;
+
+    writeLayerRows(document, layer, false, "\n", "\n");
+
+    bool ok = closeWrite();
+    if (ok && document.getTiles().hasIOError()) ok = fail("paged out tiles can't be read");
+    if (!ok) {
+        remove(path.c_str());
+        return false;
+    }
+    return true;
+} // bool TextMapFile::saveCsv(const string &path, MapDocument &document, int layer)
+
+/******************************************************************************
+*** Reading
+******************************************************************************/
+
+bool TextMapFile::openRead(const string &path) {
+    error.clear();
+    file = fopen(path.c_str(), "rb");
+    if (file == NULL) return fail("can't read " + path);
+
+    in_buffer.resize(TEXTMAP_BUFFER);
+    return rewind();
+} // bool TextMapFile::openRead(const string &path)
+
+void TextMapFile::closeRead() {
+    if (file != NULL) fclose(file);
+    file = NULL;
+} // void TextMapFile::closeRead()
+
+bool TextMapFile::rewind() {
+    in_pos = in_end = 0;
+    in_eof = false;
+    return fseek(file, 0, SEEK_SET) == 0;
+} // bool TextMapFile::rewind()
+
+// Tops the window up whenever a token might not fit in what's left of it
+bool TextMapFile::fill() {
+    if (in_end - in_pos >= TEXTMAP_TOKEN || in_eof) return in_pos < in_end;
+
+    size_t left = in_end - in_pos;
+    memmove(&in_buffer[0], &in_buffer[in_pos], left);
+    in_pos = 0;
+    in_end = left;
+
+    size_t got = fread(&in_buffer[in_end], 1, in_buffer.size() - in_end, file);
+    if (got < in_buffer.size() - in_end) in_eof = true;
+    in_end += got;
+    return in_pos < in_end;
+} // bool TextMapFile::fill()
+
+int TextMapFile::peek() {
+    if (in_pos == in_end && !fill()) return -1;
+    return (unsigned char)in_buffer[in_pos];
+} // int TextMapFile::peek()
+
+int TextMapFile::get() {
+    int c = peek();
+    if (c >= 0) in_pos++;
+    return c;
+} // int TextMapFile::get()
+
+void TextMapFile::skipBlanks() {
+    int c = peek();
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        in_pos++;
+        c = peek();
+    }
+} // void TextMapFile::skipBlanks()
+
+bool TextMapFile::readInt(int &value) {
+    skipBlanks();
+    fill();
+
+    const char *start = &in_buffer[0] + in_pos;
+    const char *text = start;
+    if (!convert.parseInt(text, &in_buffer[0] + in_end, value)) return false;
+    in_pos += text - start;
+    return true;
+} // bool TextMapFile::readInt(int &value)
+
+bool TextMapFile::readGid(uint32_t &value) {
+    skipBlanks();
+    fill();
+
+    const char *start = &in_buffer[0] + in_pos;
+    const char *text = start;
+    if (!convert.parseUint(text, &in_buffer[0] + in_end, value)) return false;
+    in_pos += text - start;
+    return true;
+} // bool TextMapFile::readGid(uint32_t &value)
+
+bool TextMapFile::fail(const string &why) {
+    if (error.empty()) error = why;
+    return false;
+} // bool TextMapFile::fail(const string &why)
+
+// After the first reading: every tile layer goes to the next map layer,
+// except the collision and emitter ones. The map is created from what's left
+bool TextMapFile::assignLayers(MapDocument &document) {
+    layer_count = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        TextLayer &layer = layers[i];
+        if (layer.target == -2) continue;
+        if (layer.width <= 0) layer.width = map_width;
+
+        int emitter_layer;
+        const char *number_text = layer.name.c_str() + std::min<size_t>(9, layer.name.size());
+        if (layer.name == "collision") {
+            layer.target = TEXTMAP_COLLISION;
+        } else if (layer.name.compare(0, 9, "emitters ") == 0
+                   && convert.parseInt(number_text, number_text + strlen(number_text), emitter_layer)) {
+            layer.target = emitter_layer;
+            layer.emitters = true;
+        } else {
+            layer.target = layer_count++;
+        }
+    }
+
+    // Emitters of a layer that isn't there have nowhere to go
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i].emitters && (layers[i].target < 0 || layers[i].target >= layer_count)) layers[i].target = -2;
+    }
+
+    if (map_width <= 0 || map_height <= 0 || layer_count == 0) return fail("no map sizes or tile layers");
+    if (!document.create(layer_count, map_width, map_height)) return fail("map sizes out of range");
+    return true;
+} // bool TextMapFile::assignLayers(MapDocument &document)
+
+void TextMapFile::beginLayer(TextLayer *layer) {
+    current = layer;
+    put_x = put_y = 0;
+    row_count = 0;
+} // void TextMapFile::beginLayer(TextLayer *layer)
+
+// Tiles are collected a chunk row at a time, the emitters already on the
+// map are kept
+void TextMapFile::flushRow(MapDocument &document) {
+    if (row_count == 0) return;
+
+    TileMap &tiles = document.getTiles();
+    const Tile *old;
+    tiles.getSpan(current->target, row_x, row_y, old);
+    for (int i = 0; i < row_count; i++) {
+        row[i].bits = (row[i].bits & ~TILE_EMITTER_MASK) | (old[i].bits & TILE_EMITTER_MASK);
+    }
+    tiles.setSpan(current->target, row_x, row_y, row, row_count);
+    row_count = 0;
+} // void TextMapFile::flushRow(MapDocument &document)
+
+void TextMapFile::nextRow(MapDocument &document) {
+    flushRow(document);
+    put_x = 0;
+    put_y++;
+} // void TextMapFile::nextRow(MapDocument &document)
+
+bool TextMapFile::putValue(MapDocument &document, uint32_t value) {
+    int x = put_x, y = put_y;
+    put_x++;
+
+    if (x < map_width && y < map_height) {
+        if (current->target == TEXTMAP_COLLISION) {
+            document.getCollision().set(x, y, value != 0);
+        } else if (current->emitters) {
+            TileMap &tiles = document.getTiles();
+            Tile tile = tiles.get(current->target, x, y);
+            if (tile.getEmitter() != (short)value) {
+                tile.setEmitter(value);
+                tiles.set(current->target, x, y, tile);
+                document.getEmitters().set(current->target, x, y, tile.getEmitter());
+            }
+        } else {
+            Tile tile;
+            if (!gidToTile(value, tile)) {
+                char text[64];
+                snprintf(text, sizeof(text), "tile id %u out of range", value);
+                return fail(text);
+            }
+            if (row_count == 0) {
+                row_x = x;
+                row_y = y;
+            }
+            row[row_count++] = tile;
+
+            // Spans end with the chunk or the map
+            if (((x + 1) & CHUNK_MASK) == 0 || x + 1 == map_width) flushRow(document);
+        }
+    }
+
+    if (put_x == current->width) nextRow(document);
+    return true;
+} // bool TextMapFile::putValue(MapDocument &document, uint32_t value)
+
+/******************************************************************************
+*** JSON
+******************************************************************************/
+
+// Returns the punctuation itself, 's' for a string in token, 'n' for a
+// number in number, 'l' for true, false or null, 0 at the end and -1 for
+// anything else
+int TextMapFile::nextToken() {
+    skipBlanks();
+    int c = peek();
+    if (c < 0) return 0;
+
+    if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') {
+        in_pos++;
+        return c;
+    }
+
+    if (c == '"') {
+        in_pos++;
+        token.clear();
+        while ((c = get()) >= 0 && c != '"') {
+            if (c == '\\') c = get();
+            if (token.size() < TEXTMAP_TOKEN) token += (char)c;
+        }
+        return (c == '"') ? 's' : -1;
+    }
+
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        // Tile data may carry the flip flags, past what an int holds. No
+        // size comes anywhere near, those read as INT_MAX and fail its checks
+        if (c == '-') {
+            if (!readInt(number)) return -1;
+            gid = (uint32_t)number;
+        } else {
+            if (!readGid(gid)) return -1;
+            number = (gid > (uint32_t)INT_MAX) ? INT_MAX : (int)gid;
+        }
+        // Fractions and exponents don't matter to a map, skip them
+        while ((c = peek()) == '.' || c == 'e' || c == 'E' || c == '+' || c == '-' || (c >= '0' && c <= '9')) in_pos++;
+        return 'n';
+    }
+
+    if (c >= 'a' && c <= 'z') {
+        while ((c = peek()) >= 'a' && c <= 'z') in_pos++;
+        return 'l';
+    }
+    return -1;
+} // int TextMapFile::nextToken()
+
+bool TextMapFile::skipValue(int token) {
+    if (token == 's' || token == 'n' || token == 'l') return true;
+    if (token != '{' && token != '[') return fail("bad JSON");
+
+    int close = (token == '{') ? '}' : ']';
+    int t = nextToken();
+    if (t == close) return true;
+
+    while (true) {
+        if (token == '{') {
+            if (t != 's' || nextToken() != ':') return fail("bad JSON");
+            t = nextToken();
+        }
+        if (!skipValue(t)) return false;
+
+        t = nextToken();
+        if (t == close) return true;
+        if (t != ',') return fail("bad JSON");
+        t = nextToken();
+    }
+} // bool TextMapFile::skipValue(int token)
+
+bool TextMapFile::readJsonLayer(MapDocument &document, bool tiles) {
+    TextLayer found;
+    found.width = 0;
+    found.target = -2;
+    found.emitters = false;
+    string type;
+
+    // The second time round the first reading says where it goes
+    TextLayer *layer = tiles ? &layers[next_layer++] : &found;
+
+    int t = nextToken();
+    if (t == '}') {
+        if (!tiles) layers.push_back(found);
+        return true;
+    }
+
+    while (true) {
+        if (t != 's') return fail("bad JSON");
+        string key = token;
+        if (nextToken() != ':') return fail("bad JSON");
+        t = nextToken();
+
+        if (key == "name" && t == 's') {
+            found.name = token;
+        } else if (key == "type" && t == 's') {
+            type = token;
+        } else if (key == "width" && t == 'n') {
+            found.width = number;
+        } else if (key == "data" && t == '[') {
+            found.target = 0;
+            if (tiles && layer->target != -2) {
+                beginLayer(layer);
+                while ((t = nextToken()) == 'n' || t == ',') {
+                    if (t == 'n' && !putValue(document, gid)) return false;
+                }
+                flushRow(document);
+                if (t != ']') return fail("bad JSON");
+            } else if (!skipValue(t)) {
+                return false;
+            }
+        } else if (key == "data" && t == 's') {
+            return fail("only JSON layer data in arrays is supported");
+        } else if (!skipValue(t)) {
+            return false;
+        }
+
+        t = nextToken();
+        if (t == '}') break;
+        if (t != ',') return fail("bad JSON");
+        t = nextToken();
+    }
+
+    if (!tiles) {
+        if (!type.empty() && type != "tilelayer") found.target = -2;
+        layers.push_back(found);
+    }
+    return true;
+} // bool TextMapFile::readJsonLayer(MapDocument &document, bool tiles)
+
+bool TextMapFile::readJson(MapDocument &document, bool tiles) {
+    if (nextToken() != '{') return fail("not a JSON map");
+
+    int t = nextToken();
+    while (t != '}') {
+        if (t != 's') return fail("bad JSON");
+        string key = token;
+        if (nextToken() != ':') return fail("bad JSON");
+        t = nextToken();
+
+        if (key == "width" && t == 'n') {
+            map_width = number;
+        } else if (key == "height" && t == 'n') {
+            map_height = number;
+        } else if (key == "layers" && t == '[') {
+            t = nextToken();
+            while (t != ']') {
+                if (t != '{' || !readJsonLayer(document, tiles)) return fail("bad JSON");
+                t = nextToken();
+                if (t == ',') t = nextToken();
+            }
+        } else if (!skipValue(t)) {
+            return false;
+        }
+
+        t = nextToken();
+        if (t == ',') t = nextToken();
+        else if (t != '}') return fail("bad JSON");
+    }
+    return true;
+} // bool TextMapFile::readJson(MapDocument &document, bool tiles)
+
+/******************************************************************************
+*** TMX
+******************************************************************************/
+
+// Reads up to the next element tag, skipping text, comments and
+// declarations. The tag name goes in token, its attributes in attr_*
+bool TextMapFile::nextTag() {
+    int c;
+    while (true) {
+        while ((c = get()) >= 0 && c != '<') ;
+        if (c < 0) return false;
+
+        c = peek();
+        if (c == '?' || c == '!') {
+            // <?xml ?>, <!-- --> and <!DOCTYPE>, none of them nest a '>'
+            // that matters here
+            bool comment = false;
+            if (c == '!') {
+                in_pos++;
+                comment = (peek() == '-');
+            }
+            int last1 = 0, last2 = 0;
+            while ((c = get()) >= 0) {
+                if (c == '>' && (!comment || (last1 == '-' && last2 == '-'))) break;
+                last2 = last1;
+                last1 = c;
+            }
+            continue;
+        }
+        break;
+    }
+
+    tag_closing = (peek() == '/');
+    if (tag_closing) in_pos++;
+    tag_empty = false;
+    attr_names.clear();
+    attr_values.clear();
+
+    token.clear();
+    while ((c = peek()) >= 0 && c != '>' && c != '/' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        if (token.size() < TEXTMAP_TOKEN) token += (char)c;
+        in_pos++;
+    }
+
+    while (true) {
+        skipBlanks();
+        c = get();
+        if (c < 0) return false;
+        if (c == '>') return true;
+        if (c == '/') {
+            tag_empty = true;
+            continue;
+        }
+
+        string name(1, (char)c);
+        while ((c = peek()) >= 0 && c != '=' && c != '>' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            if (name.size() < TEXTMAP_TOKEN) name += (char)c;
+            in_pos++;
+        }
+        skipBlanks();
+        if (peek() != '=') continue;
+        in_pos++;
+        skipBlanks();
+
+        int quote = get();
+        if (quote != '"' && quote != '\'') return false;
+        string value;
+        while ((c = get()) >= 0 && c != quote) {
+            if (value.size() < TEXTMAP_TOKEN) value += (char)c;
+        }
+        attr_names.push_back(name);
+        attr_values.push_back(value);
+    }
+} // bool TextMapFile::nextTag()
+
+string TextMapFile::getAttribute(const char *name) {
+    for (size_t i = 0; i < attr_names.size(); i++) {
+        if (attr_names[i] == name) return attr_values[i];
+    }
+    return "";
+} // string TextMapFile::getAttribute(const char *name)
+
+bool TextMapFile::readTmxData(MapDocument &document, const string &encoding) {
+    int c;
+    if (encoding == "csv") {
+        while (true) {
+            skipBlanks();
+            c = peek();
+            if (c < 0 || c == '<') break;
+            if (c == ',') {
+                in_pos++;
+                continue;
+            }
+            uint32_t value;
+            if (!readGid(value)) return fail("bad CSV data");
+            if (!putValue(document, value)) return false;
+        }
+    } else if (encoding == "base64") {
+        // Four bytes a gid, little endian
+        uint32_t bits = 0, gid = 0;
+        int bit_count = 0, byte_count = 0;
+        while ((c = peek()) >= 0 && c != '<') {
+            in_pos++;
+            int v;
+            if (c >= 'A' && c <= 'Z') v = c - 'A';
+            else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') v = c - '0' + 52;
+            else if (c == '+') v = 62;
+            else if (c == '/') v = 63;
+            else continue;
+
+            bits = (bits << 6) | v;
+            bit_count += 6;
+            if (bit_count >= 8) {
+                bit_count -= 8;
+                gid |= ((bits >> bit_count) & 0xFF) << (8 * byte_count);
+                if (++byte_count == 4) {
+                    if (!putValue(document, gid)) return false;
+                    gid = 0;
+                    byte_count = 0;
+                }
+            }
+        }
+    } else if (encoding.empty()) {
+        while (nextTag()) {
+            if (tag_closing && token == "data") break;
+            if (!tag_closing && token == "tile") {
+                int gid = 0;
+                string text = getAttribute("gid");
+                convert.isInt(text, gid);
+                if (!putValue(document, (uint32_t)gid)) return false;
+            }
+        }
+    } else {
+        return fail("unknown TMX encoding " + encoding);
+    }
+
+    flushRow(document);
+    return true;
+} // bool TextMapFile::readTmxData(MapDocument &document, const string &encoding)
+
+bool TextMapFile::readTmx(MapDocument &document, bool tiles) {
+    bool found_map = false;
+    TextLayer *layer = NULL;
+
+    while (nextTag()) {
+        if (tag_closing) {
+            if (token == "layer") layer = NULL;
+            continue;
+        }
+
+        if (token == "map") {
+            found_map = true;
+            map_width = convert.stoi(getAttribute("width"));
+            map_height = convert.stoi(getAttribute("height"));
+        } else if (token == "layer") {
+            if (tiles) {
+                layer = &layers[next_layer++];
+            } else {
+                TextLayer found;
+                found.name = getAttribute("name");
+                found.width = convert.stoi(getAttribute("width"));
+                found.target = 0;
+                found.emitters = false;
+                layers.push_back(found);
+            }
+            if (tag_empty) layer = NULL;
+        } else if (token == "data" && tiles && layer != NULL && layer->target != -2 && !tag_empty) {
+            if (!getAttribute("compression").empty()) return fail("compressed TMX layers aren't supported");
+            beginLayer(layer);
+            if (!readTmxData(document, getAttribute("encoding"))) return false;
+        }
+    }
+
+    if (!found_map) return fail("not a TMX map");
+    return true;
+} // bool TextMapFile::readTmx(MapDocument &document, bool tiles)
+
+bool TextMapFile::load(const string &path, MapDocument &document, int format) {
+    if (!openRead(path)) return false;
+
+    map_width = map_height = 0;
+    layers.clear();
+    next_layer = 0;
+
+    // First the sizes and the layers, then the tiles
+    bool ok = (format == TEXTMAP_TMX) ? readTmx(document, false) : readJson(document, false);
+    ok = ok && assignLayers(document) && (rewind() || fail("can't read " + path));
+    if (ok) ok = (format == TEXTMAP_TMX) ? readTmx(document, true) : readJson(document, true);
+
+    closeRead();
+    return ok;
+} // bool TextMapFile::load(const string &path, MapDocument &document, int format)
+
+bool TextMapFile::loadCsv(const string &path, MapDocument &document, int layer) {
+    if (layer != TEXTMAP_COLLISION && (layer < 0 || layer >= document.getLayers())) return fail("no such layer");
+    if (!openRead(path)) return false;
+
+    // Rows end with the line, not after a number of cells
+    TextLayer grid;
+    grid.width = -1;
+    grid.target = layer;
+    grid.emitters = false;
+    map_width = document.getWidth();
+    map_height = document.getHeight();
+    beginLayer(&grid);
+
+    bool ok = true;
+    int c;
+    while (ok && (c = peek()) >= 0) {
+        if (c == '\n') {
+            in_pos++;
+            nextRow(document);
+        } else if (c == ',' || c == ' ' || c == '\t' || c == '\r') {
+            in_pos++;
+        } else {
+            uint32_t value;
+            ok = readGid(value) ? putValue(document, value) : fail("bad CSV data");
+        }
+    }
+    flushRow(document);
+
+    closeRead();
+    return ok;
+} // bool TextMapFile::loadCsv(const string &path, MapDocument &document, int layer)
@@ -0,0 +1,224 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    textmapfile.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the text map formats.
+***
+*** This code provides the TextMapFile class, which streams maps between a
+*** MapDocument and the text formats other tools read: Tiled's TMX and JSON
+*** maps, and CSV grids of a single layer.
+***
+*** Tiles are written a row at a time through a fixed buffer and read the
+*** same way, numbers are parsed in place by DataFormat::parseInt(), so
+*** memory use doesn't depend on the size of the file. TMX and JSON files
+*** are read twice: once for the sizes and the list of layers, which may
+*** come after the tiles, then for the tiles.
+***
+*** Every map layer becomes a tile layer named "layer <n>". The collision
+*** mask goes in a "collision" layer of 0 and 1, the emitters of map layer
+*** n in an "emitters <n>" layer holding the emitter types, written only
+*** for the layers that have any. On import every other tile layer is
+*** taken as the next map layer.
+***
+*** Tile ids (gids) follow Tiled: one tileset of TEXTMAP_TILESET_TILES per
+*** editor tileset, numbered from 1 and counted row by row over a tileset
+*** image TEXTMAP_COLUMNS tiles wide. The editor counts its tilesets column
+*** by column, TILESIZE tiles tall, so the index is transposed on the way.
+******************************************************************************/
+
+#ifndef TEXTMAPFILE_H
+#define TEXTMAPFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "mapdocument.h"
+#include "mapview.h"
+#include "..\utils\dataformat.h"
+
+using namespace std;
+
+/** \def Text map constants
+**/
+//@{
+#define TEXTMAP_TMX         0
+#define TEXTMAP_JSON        1
+#define TEXTMAP_CSV         2
+
+//! The tilesets written out and read back, the ones in mapData.dat
+#define TEXTMAP_TILESETS        TILE_TILESETS
+//! Tiles in each of them, all the indexes a tile can hold
+#define TEXTMAP_TILESET_TILES   4096
+//! Width of a tileset image in tiles, as Tiled counts them
+#define TEXTMAP_COLUMNS         (TEXTMAP_TILESET_TILES / TILESIZE)
+
+//! The CSV layer number that stands for the collision mask
+#define TEXTMAP_COLLISION   -1
+
+//! Size of the read and write buffers
+#define TEXTMAP_BUFFER      (64 * 1024)
+//! Longest number or name read at once, anything longer is cut short
+#define TEXTMAP_TOKEN       256
+//@}
+
+/** \struct TextLayer textmapfile.h "src\map\textmapfile.h"
+*** \brief A layer of a TMX or JSON map, as the first reading finds it
+**/
+typedef struct TextLayer {
+    string name;
+    int width;      //!< Cells in a row of its data
+    int target;     //!< Map layer it goes to, TEXTMAP_COLLISION, or -2 to be skipped
+    bool emitters;  //!< Holds the emitters of target rather than its tiles
+} TextLayer;
+
+/** \class TextMapFile textmapfile.h "src\map\textmapfile.h"
+*** \brief Streams maps to and from TMX, JSON and CSV
+**/
+class TextMapFile {
+public:
+    TextMapFile();
+    ~TextMapFile();
+
+    /** \name getFormat()
+    *** \brief The format a path's extension stands for, -1 if none
+    **/
+    static int getFormat(const string &path);
+
+    /** \name save()
+    *** \brief Writes the whole map as TMX or JSON
+    *** \return false if the file couldn't be written
+    **/
+    bool save(const string &path, MapDocument &document, int format);
+
+    /** \name load()
+    *** \brief Reads a TMX or JSON map, replacing the document's map. TMX
+    ***        layer data may be CSV, XML tiles or uncompressed base64.
+    *** \return false if the file can't be read, see getError()
+    **/
+    bool load(const string &path, MapDocument &document, int format);
+
+    /** \name CSV grids
+    *** \brief One map layer, or the collision mask, as rows of gids. A
+    ***        loaded grid goes into the document's map as it is; the part
+    ***        that doesn't fit is left out.
+    **/
+    //@{
+    bool saveCsv(const string &path, MapDocument &document, int layer);
+    bool loadCsv(const string &path, MapDocument &document, int layer);
+    //@}
+
+    //! Why the last load() or save() failed
+    const string &getError() { return error; }
+
+    /** \name Tile ids
+    *** \brief Tiled's flip flags are dropped, gid 0 (no tile) reads as the
+    ***        erase tile
+    **/
+    //@{
+    static uint32_t tileToGid(const Tile &tile);
+    static bool gidToTile(uint32_t gid, Tile &tile);
+    //@}
+private:
+    /** Writing, everything goes through out_buffer **/
+    //@{
+    bool openWrite(const string &path);
+    bool closeWrite();
+    void write(const char *text);
+    void write(const char *text, size_t size);
+    void writeInt(uint32_t value);
+    void writeLayerRows(MapDocument &document, int layer, bool emitters, const char *row_end, const char *last_end);
+    bool hasEmitters(MapDocument &document, int layer);
+    void writeTilesets(int format);
+    //@}
+
+    /** Reading, from a window of in_buffer kept full enough to parse a
+    *** token without crossing its end
+    **/
+    //@{
+    bool openRead(const string &path);
+    void closeRead();
+    bool rewind();
+    bool fill();
+    int peek();
+    int get();
+    void skipBlanks();
+    bool readInt(int &value);
+    bool readGid(uint32_t &value);
+    bool fail(const string &why);
+    bool assignLayers(MapDocument &document);
+    //@}
+
+    /** JSON, a pull parser over the read buffer **/
+    //@{
+    int nextToken();
+    bool skipValue(int token);
+    bool readJson(MapDocument &document, bool tiles);
+    bool readJsonLayer(MapDocument &document, bool tiles);
+    //@}
+
+    /** TMX, a pull parser for the few XML constructs it uses **/
+    //@{
+    bool nextTag();
+    string getAttribute(const char *name);
+    bool readTmx(MapDocument &document, bool tiles);
+    bool readTmxData(MapDocument &document, const string &encoding);
+    //@}
+
+    /** Where the tiles read go **/
+    //@{
+    void beginLayer(TextLayer *layer);
+    bool putValue(MapDocument &document, uint32_t value);
+    void nextRow(MapDocument &document);
+    void flushRow(MapDocument &document);
+    //@}
+
+    FILE *file;
+    vector<char> out_buffer;
+    size_t out_size;
+    bool out_failed;
+
+    vector<char> in_buffer;
+    size_t in_pos, in_end;
+    bool in_eof;
+
+    string token;                   //!< The last string, name or tag read
+    int number;                     //!< The last number read
+    uint32_t gid;                   //!< The same, unsigned so the flip flags fit
+    vector<string> attr_names, attr_values;
+    bool tag_closing, tag_empty;    //!< </tag>, <tag/>
+
+    int map_width, map_height;
+    vector<TextLayer> layers;
+    int layer_count;                //!< Map layers found by the first reading
+    int next_layer;                 //!< The layer of the file being read
+
+    /** The layer being read in, a row span at a time **/
+    //@{
+    TextLayer *current;
+    int put_x, put_y;
+    Tile row[CHUNK_SIZE];
+    int row_x, row_y, row_count;
+    //@}
+
+    DataFormat convert;
+    string error;
+};
+
+#endif // TEXTMAPFILE_H
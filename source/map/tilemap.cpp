@@ -0,0 +1,360 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    tilemap.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the map tile storage.
+******************************************************************************/
+
+#include "tilemap.h"
+#include "..\utils\mappedfile.h"
+
+#include <string.h>
+
+// Hash the chunk coordinates into the slot table
+static inline unsigned int chunkHash(int cx, int cy) {
+    return ((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u);
+}
+
+TileMap::TileMap() {
+    layer = NULL;
+    layers = width = height = 0;
+    backing = NULL;
+    modified = false;
+
+    last_lay = -1;
+    last_cx = last_cy = 0;
+    last_chunk = NULL;
+}
+
+TileMap::~TileMap() {
+    destroy();
+}
+
+bool TileMap::create(int layers, int width, int height) {
+
+    destroy();
+
+    if (layers <= 0 || width <= 0 || height <= 0) return false;
+
+    this->layers = layers;
+    this->width = width;
+    this->height = height;
+
+    layer = new ChunkLayer[layers];
+
+    // The erase tile from the default tileset, the same one BRUSH_ERASE paints
+    Tile empty = makeTile(1, 0, 0);
+
+    for (int l = 0; l < layers; l++) {
+        setFill(l, empty);
+        layer[l].slots.assign(64, -1);
+    }
+
+    return true;
+} // bool TileMap::create(int layers, int width, int height)
+
+void TileMap::destroy() {
+    for (int l = 0; l < layers; l++) {
+        for (size_t n = 0; n < layer[l].chunks.size(); n++) {
+            pager.release(layer[l].chunks[n]);
+            delete layer[l].chunks[n];
+        }
+    }
+    pager.reset();
+
+    delete backing;
+    backing = NULL;
+
+    delete[] layer;
+    layer = NULL;
+    layers = width = height = 0;
+    backing = NULL;
+
+    source.clear();
+    modified = false;
+
+    last_lay = -1;
+    last_chunk = NULL;
+} // void TileMap::destroy()
+
+void TileMap::setFill(int lay, const Tile &tile) {
+    layer[lay].fill = tile;
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        layer[lay].fillRow[i] = tile;
+    }
+    modified = true;
+} // void TileMap::setFill(int lay, const Tile &tile)
+
+// Linear probing, the table is kept at most half full
+int TileMap::findSlot(ChunkLayer &lay, int cx, int cy) {
+    size_t mask = lay.slots.size() - 1;
+    size_t slot = chunkHash(cx, cy) & mask;
+
+    while (lay.slots[slot] != -1) {
+        TileChunk *chunk = lay.chunks[lay.slots[slot]];
+        if (chunk->cx == cx && chunk->cy == cy) break;
+        slot = (slot + 1) & mask;
+    }
+    return (int)slot;
+} // int TileMap::findSlot(ChunkLayer &lay, int cx, int cy)
+
+void TileMap::rebuildSlots(ChunkLayer &lay, size_t size) {
+    lay.slots.assign(size, -1);
+    for (size_t n = 0; n < lay.chunks.size(); n++) {
+        int slot = findSlot(lay, lay.chunks[n]->cx, lay.chunks[n]->cy);
+        lay.slots[slot] = (int)n;
+    }
+} // void TileMap::rebuildSlots(ChunkLayer &lay, size_t size)
+
+TileChunk *TileMap::findChunk(int lay, int cx, int cy) {
+    // The cached chunk may have been paged out by a bulk pass since
+    if (lay == last_lay && cx == last_cx && cy == last_cy &&
+        (last_chunk == NULL || last_chunk->tiles != NULL)) return last_chunk;
+
+    ChunkLayer &l = layer[lay];
+    int slot = findSlot(l, cx, cy);
+    TileChunk *chunk = (l.slots[slot] == -1) ? NULL : l.chunks[l.slots[slot]];
+    if (chunk != NULL) pager.touch(chunk);
+
+    last_lay = lay;
+    last_cx = cx;
+    last_cy = cy;
+    last_chunk = chunk;
+
+    return chunk;
+} // TileChunk *TileMap::findChunk(int lay, int cx, int cy)
+
+// Enter a new chunk in the layer's index, without any tiles yet
+TileChunk *TileMap::addChunk(int lay, int cx, int cy) {
+    ChunkLayer &l = layer[lay];
+
+    TileChunk *chunk = new TileChunk;
+    chunk->cx = cx;
+    chunk->cy = cy;
+    chunk->tiles = NULL;
+    chunk->mapped = false;
+    chunk->shared = false;
+    chunk->unsaved = true;
+
+    l.chunks.push_back(chunk);
+    if (l.chunks.size() * 2 > l.slots.size()) {
+        rebuildSlots(l, l.slots.size() * 2);
+    } else {
+        l.slots[findSlot(l, cx, cy)] = (int)l.chunks.size() - 1;
+    }
+
+    last_lay = lay;
+    last_cx = cx;
+    last_cy = cy;
+    last_chunk = chunk;
+
+    return chunk;
+} // TileChunk *TileMap::addChunk(int lay, int cx, int cy)
+
+TileChunk *TileMap::getChunk(int lay, int cx, int cy) {
+    TileChunk *chunk = findChunk(lay, cx, cy);
+    if (chunk != NULL) return chunk;
+
+    chunk = addChunk(lay, cx, cy);
+    pager.attach(chunk);
+    for (int n = 0; n < CHUNK_TILES; n++) {
+        chunk->tiles[n] = layer[lay].fill;
+    }
+    return chunk;
+} // TileChunk *TileMap::getChunk(int lay, int cx, int cy)
+
+void TileMap::attachMapped(int lay, int cx, int cy, Tile *tiles) {
+    TileChunk *chunk = findChunk(lay, cx, cy);
+    if (chunk != NULL) {
+        pager.release(chunk);
+    } else chunk = addChunk(lay, cx, cy);
+
+    pager.attachMapped(chunk, tiles);
+    chunk->unsaved = false;
+} // void TileMap::attachMapped(int lay, int cx, int cy, Tile *tiles)
+
+void TileMap::setBacking(MappedFile *file) {
+    if (backing != NULL && backing != file) detachBacking();
+    backing = file;
+} // void TileMap::setBacking(MappedFile *file)
+
+void TileMap::detachBacking() {
+    if (backing == NULL) return;
+
+    for (int l = 0; l < layers; l++) {
+        for (size_t n = 0; n < layer[l].chunks.size(); n++) {
+            if (layer[l].chunks[n]->mapped) pager.promote(layer[l].chunks[n]);
+        }
+    }
+
+    delete backing;
+    backing = NULL;
+} // void TileMap::detachBacking()
+
+void TileMap::set(int lay, int x, int y, const Tile &tile) {
+    TileChunk *chunk = findChunk(lay, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    if (chunk == NULL) {
+        // Painting the fill over an elided chunk doesn't change anything
+        if (tile == layer[lay].fill) return;
+        chunk = getChunk(lay, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    } else if (chunk->tiles == NULL) {
+        return;
+    } else if (chunk->mapped || chunk->shared) {
+        Tile &old = chunk->tiles[((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK)];
+        if (old == tile) return;
+        pager.promote(chunk);
+    }
+    chunk->tiles[((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK)] = tile;
+    chunk->dirty = chunk->unsaved = true;
+} // void TileMap::set(int lay, int x, int y, const Tile &tile)
+
+int TileMap::getSpan(int lay, int x, int y, const Tile *&tiles) {
+    int count = CHUNK_SIZE - (x & CHUNK_MASK);
+    if (count > width - x) count = width - x;
+
+    TileChunk *chunk = findChunk(lay, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    if (chunk == NULL) {
+        tiles = layer[lay].fillRow;
+    } else if (chunk->tiles == NULL) {
+        for (int i = 0; i < CHUNK_SIZE; i++) lostRow[i] = chunk->summary;
+        tiles = lostRow;
+    } else {
+        tiles = chunk->tiles + ((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK);
+    }
+    return count;
+} // int TileMap::getSpan(int lay, int x, int y, const Tile *&tiles)
+
+void TileMap::setSpan(int lay, int x, int y, const Tile *tiles, int count) {
+    TileChunk *chunk = findChunk(lay, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    if (chunk == NULL) {
+        int i = 0;
+        while (i < count && tiles[i] == layer[lay].fill) i++;
+        if (i == count) return;
+        chunk = getChunk(lay, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    } else if (chunk->tiles == NULL) {
+        return;
+    } else if (chunk->mapped || chunk->shared) {
+        pager.promote(chunk);
+    }
+
+    memcpy(chunk->tiles + ((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK), tiles, count * sizeof(Tile));
+    chunk->dirty = chunk->unsaved = true;
+} // void TileMap::setSpan(int lay, int x, int y, const Tile *tiles, int count)
+
+void TileMap::compact() {
+    for (int l = 0; l < layers; l++) {
+        ChunkLayer &cl = layer[l];
+        size_t kept = 0;
+
+        for (size_t n = 0; n < cl.chunks.size(); n++) {
+            TileChunk *chunk = cl.chunks[n];
+            if (!pager.touch(chunk)) {
+                cl.chunks[kept++] = chunk;
+                continue;
+            }
+
+            int i = 0;
+            while (i < CHUNK_TILES && chunk->tiles[i] == cl.fill) i++;
+
+            if (i == CHUNK_TILES) {
+                pager.release(chunk);
+                delete chunk;
+            } else cl.chunks[kept++] = chunk;
+        }
+
+        if (kept != cl.chunks.size()) {
+            cl.chunks.resize(kept);
+            rebuildSlots(cl, cl.slots.size());
+            modified = true;
+        }
+    }
+    last_lay = -1;
+    last_chunk = NULL;
+} // void TileMap::compact()
+
+void TileMap::replace(int lay, int index, int tileset, int new_index, int new_tileset) {
+    ChunkLayer &cl = layer[lay];
+
+    // Index and tileset are compared and swapped as one masked word
+    uint32_t from = makeTile(index, tileset, 0).bits;
+    uint32_t to = makeTile(new_index, new_tileset, 0).bits;
+
+    for (size_t n = 0; n < cl.chunks.size(); n++) {
+        TileChunk *chunk = cl.chunks[n];
+        if (!pager.touch(chunk)) continue;
+
+        Tile *tile = chunk->tiles;
+        for (int i = 0; i < CHUNK_TILES; i++, tile++) {
+            if ((tile->bits & TILE_GFX_MASK) == from) {
+                if (chunk->mapped || chunk->shared) {
+                    pager.promote(chunk);
+                    tile = chunk->tiles + i;
+                }
+                tile->bits = (tile->bits & ~TILE_GFX_MASK) | to;
+                chunk->dirty = chunk->unsaved = true;
+            }
+        }
+    }
+
+    // The tiles that were never painted are all the fill tile
+    if ((cl.fill.bits & TILE_GFX_MASK) == from) {
+        Tile fill = cl.fill;
+        fill.bits = (fill.bits & ~TILE_GFX_MASK) | to;
+        setFill(lay, fill);
+    }
+} // void TileMap::replace(int lay, int index, int tileset, int new_index, int new_tileset)
+
+void TileMap::setSaved(const string &path) {
+    for (int l = 0; l < layers; l++) {
+        for (size_t n = 0; n < layer[l].chunks.size(); n++) {
+            layer[l].chunks[n]->unsaved = false;
+        }
+    }
+    source = path;
+    modified = false;
+} // void TileMap::setSaved(const string &path)
+
+void TileMap::endShare() {
+    for (int l = 0; l < layers; l++) {
+        for (size_t n = 0; n < layer[l].chunks.size(); n++) {
+            layer[l].chunks[n]->shared = false;
+        }
+    }
+    pager.dropOrphans();
+} // void TileMap::endShare()
+
+bool TileMap::isModified() {
+    if (modified) return true;
+    for (int l = 0; l < layers; l++) {
+        for (size_t n = 0; n < layer[l].chunks.size(); n++) {
+            if (layer[l].chunks[n]->unsaved) return true;
+        }
+    }
+    return false;
+} // bool TileMap::isModified()
+
+size_t TileMap::getMemoryUsage() {
+    size_t bytes = 0;
+    for (int l = 0; l < layers; l++) {
+        bytes += layer[l].chunks.size() * sizeof(TileChunk);
+        bytes += layer[l].slots.size() * sizeof(int);
+    }
+    bytes += (size_t)pager.getResident() * CHUNK_TILES * sizeof(Tile);
+    return bytes;
+} // size_t TileMap::getMemoryUsage()
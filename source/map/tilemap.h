@@ -0,0 +1,342 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    tilemap.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the map tile storage.
+***
+*** This code provides the TileMap class, a sparse, chunked store for the map
+*** tiles. Every layer is cut into CHUNK_SIZE x CHUNK_SIZE chunks which are
+*** only allocated once something different from the layer's fill tile is
+*** painted on them, so memory follows the painted area rather than the size
+*** of the map.
+******************************************************************************/
+
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "chunkpager.h"
+
+using namespace std;
+
+class MappedFile;
+
+/** \def Chunk geometry. A chunk is CHUNK_SIZE x CHUNK_SIZE tiles, stored
+***      row-major; CHUNK_SIZE has to be a power of two.
+**/
+//@{
+#define CHUNK_SHIFT 5
+#define CHUNK_SIZE  (1 << CHUNK_SHIFT)
+#define CHUNK_MASK  (CHUNK_SIZE - 1)
+#define CHUNK_TILES (CHUNK_SIZE * CHUNK_SIZE)
+//@}
+
+/** \def Layout of the packed tile word, from the lowest bit up:
+***      index (12 bits), tileset (3 bits), reserved (1 bit), emitter (16 bits).
+***      Collision lives in the map-wide CollisionMask.
+**/
+//@{
+#define TILE_INDEX_SHIFT     0
+#define TILE_INDEX_MASK      0x00000FFFu
+#define TILE_TILESET_SHIFT   12
+#define TILE_TILESET_MASK    0x00007000u
+#define TILE_RESERVED_MASK   0x00008000u
+#define TILE_EMITTER_SHIFT   16
+#define TILE_EMITTER_MASK    0xFFFF0000u
+
+//! The bits that select the graphic, index and tileset together
+#define TILE_GFX_MASK        (TILE_INDEX_MASK | TILE_TILESET_MASK)
+//! The tilesets mapData.dat holds, TILES1 to TILES7, the field has room for one more
+#define TILE_TILESETS        7
+//@}
+
+/** \struct Tile tilemap.h "src\map\tilemap.h"
+*** \brief The Tile structure defines a map tile, packed in a single 32-bit
+***        word so a chunk row fits a couple of cache lines.
+***
+*** The emitter field holds the particle type, 0 meaning no emitter.
+**/
+typedef struct Tile {
+    uint32_t bits;
+
+    short getIndex() const { return (short)((bits & TILE_INDEX_MASK) >> TILE_INDEX_SHIFT); }
+    short getTileset() const { return (short)((bits & TILE_TILESET_MASK) >> TILE_TILESET_SHIFT); }
+    short getEmitter() const { return (short)((bits & TILE_EMITTER_MASK) >> TILE_EMITTER_SHIFT); }
+
+    void setIndex(int index) {
+        bits = (bits & ~TILE_INDEX_MASK) | (((uint32_t)index << TILE_INDEX_SHIFT) & TILE_INDEX_MASK);
+    }
+    void setTileset(int tileset) {
+        bits = (bits & ~TILE_TILESET_MASK) | (((uint32_t)tileset << TILE_TILESET_SHIFT) & TILE_TILESET_MASK);
+    }
+    void setEmitter(int emitter) {
+        bits = (bits & ~TILE_EMITTER_MASK) | (emitter > 0 ? ((uint32_t)emitter << TILE_EMITTER_SHIFT) & TILE_EMITTER_MASK : 0);
+    }
+
+    bool operator==(const Tile &t) const { return bits == t.bits; }
+    bool operator!=(const Tile &t) const { return bits != t.bits; }
+} Tile;
+
+/** \name makeTile()
+*** \brief Packs the passed fields into a Tile. Negative emitters (the old
+***        "no emitter" -1) are stored as 0.
+**/
+inline Tile makeTile(int index, int tileset, int emitter) {
+    Tile tile;
+    tile.bits = 0;
+    tile.setIndex(index);
+    tile.setTileset(tileset);
+    tile.setEmitter(emitter);
+    return tile;
+}
+
+/** \struct TileChunk tilemap.h "src\map\tilemap.h"
+*** \brief A CHUNK_SIZE x CHUNK_SIZE block of tiles, tiles[y][x]
+***
+*** The tiles are owned by the ChunkPager and are NULL while the chunk is
+*** paged out. TileMap pages a chunk back in whenever it's looked up.
+**/
+typedef struct TileChunk {
+    int cx, cy;                         //!< Chunk coordinates, in chunks
+    Tile *tiles;                        //!< CHUNK_TILES tiles, NULL while paged out
+    bool unsaved;                       //!< Changed since the map file was last written
+
+    /** Paging state, see ChunkPager **/
+    //@{
+    Tile summary;                       //!< Sampled on eviction, drawn by the minimap
+    int64_t swap_slot;                  //!< Slot in the swap file, -1 if never written
+    bool dirty;                         //!< The tiles changed since they were last written
+    bool mapped;                        //!< The tiles point into a read-only map file
+    bool shared;                        //!< A save in flight reads the tiles or swap slot
+    TileChunk *lru_prev, *lru_next;
+    //@}
+} TileChunk;
+
+/** \struct ChunkLayer tilemap.h "src\map\tilemap.h"
+*** \brief The chunks of one layer, plus an open addressing index keyed on the
+***        chunk coordinates. Chunks that aren't in the index read as fill.
+**/
+typedef struct ChunkLayer {
+    Tile fill;                          //!< The tile every elided chunk is made of
+    Tile fillRow[CHUNK_SIZE];           //!< A row of fill tiles, handed out for elided chunks
+    vector<TileChunk*> chunks;          //!< Allocated chunks, in no particular order
+    vector<int> slots;                  //!< Index into chunks, -1 for an empty slot
+} ChunkLayer;
+
+/** \class TileMap tilemap.h "src\map\tilemap.h"
+*** \brief Sparse chunked storage for every layer of the map. Coordinates are
+***        32-bit tile coordinates.
+**/
+class TileMap {
+public:
+    TileMap();
+    ~TileMap();
+
+    /** \name create()
+    *** \brief Sets up an empty layers x width x height map, releasing any
+    ***        previous one. Nothing is allocated until tiles are painted.
+    *** \return false if the sizes are invalid
+    **/
+    bool create(int layers, int width, int height);
+
+    /** \name destroy()
+    *** \brief Releases every chunk
+    **/
+    void destroy();
+
+    /** \name Fill tile
+    *** \brief Every tile that isn't stored in a chunk reads as the layer's
+    ***        fill tile. Changing it repaints the unpainted area of the layer.
+    **/
+    //@{
+    void setFill(int lay, const Tile &tile);
+    const Tile &getFill(int lay) { return layer[lay].fill; }
+    //@}
+
+    /** \name contains()
+    *** \brief Checks wheter the passed coordinates are inside the map
+    **/
+    bool contains(int lay, int x, int y) {
+        return lay >= 0 && lay < layers && x >= 0 && x < width && y >= 0 && y < height;
+    }
+
+    /** \name Tile access
+    *** \brief get() never allocates. set() only allocates a chunk if the tile
+    ***        differs from the layer fill. edit() always hands out a writable
+    ***        tile, allocating its chunk if needed. The coordinates must be
+    ***        inside the map. References stay valid until the next lookup,
+    ***        which may page their chunk out.
+    ***
+    ***        A chunk the swap file can't give back (see hasIOError()) reads
+    ***        as its summary tile and drops whatever is written to it.
+    **/
+    //@{
+    const Tile &get(int lay, int x, int y) {
+        TileChunk *chunk = findChunk(lay, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+        if (chunk == NULL) return layer[lay].fill;
+        if (chunk->tiles == NULL) return chunk->summary;
+        return chunk->tiles[((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK)];
+    }
+    void set(int lay, int x, int y, const Tile &tile);
+    Tile &edit(int lay, int x, int y) {
+        TileChunk *chunk = getChunk(lay, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+        if (chunk->tiles == NULL) return lostTile;
+        if (chunk->mapped || chunk->shared) pager.promote(chunk);
+        chunk->dirty = chunk->unsaved = true;
+        return chunk->tiles[((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK)];
+    }
+    //@}
+
+    /** \name getSpan()
+    *** \brief Returns the tiles of row y starting at x, up to the end of the
+    ***        chunk or of the map, whichever comes first. Elided chunks return
+    ***        the layer's fill row, so callers never need to branch on them.
+    *** \param tiles Receives a pointer to the first tile of the span
+    *** \return Number of tiles in the span
+    **/
+    int getSpan(int lay, int x, int y, const Tile *&tiles);
+
+    /** \name setSpan()
+    *** \brief The bulk counterpart of getSpan(), copies count tiles to row y
+    ***        starting at x. The span must not cross a chunk. Spans made only
+    ***        of the fill don't allocate an elided chunk.
+    **/
+    void setSpan(int lay, int x, int y, const Tile *tiles, int count);
+
+    /** \name Chunk access
+    *** \brief findChunk() returns NULL for an elided chunk, getChunk()
+    ***        allocates it from the layer fill instead. Both page the chunk
+    ***        in. getChunkAt() doesn't, call touch() before using its tiles.
+    ***        The tiles stay NULL if the chunk couldn't be paged in.
+    **/
+    //@{
+    TileChunk *findChunk(int lay, int cx, int cy);
+    TileChunk *getChunk(int lay, int cx, int cy);
+    int getChunkCount(int lay) { return (int)layer[lay].chunks.size(); }
+    TileChunk *getChunkAt(int lay, int n) { return layer[lay].chunks[n]; }
+    bool touch(TileChunk *chunk) { return pager.touch(chunk); }
+    //@}
+
+    /** \name setPaging()
+    *** \brief Bounds the memory taken by the tiles, the least recently used
+    ***        chunks go to swap_path once budget_mb is exceeded. 0 keeps
+    ***        the whole map in memory.
+    **/
+    void setPaging(int budget_mb, const string &swap_path) {
+        pager.setBudget((size_t)budget_mb * 1024 * 1024, swap_path);
+    }
+
+    /** \name hasIOError()
+    *** \brief Wheter a paged out chunk couldn't be read back since the map
+    ***        was created. Its tiles are lost to this map, so the saves and
+    ***        exports refuse to write it until it's loaded again.
+    **/
+    bool hasIOError() { return pager.hasError(); }
+
+    /** \name Memory mapped backing
+    *** \brief A map opened from a mapped map file reads its chunks straight
+    ***        from the mapping, which the TileMap owns from setBacking() on.
+    ***        Chunks are copied to private memory the first time they're
+    ***        written. detachBacking() copies the ones left and unmaps the
+    ***        file, so it can be overwritten.
+    **/
+    //@{
+    void setBacking(MappedFile *file);
+    MappedFile *getBacking() { return backing; }
+    void detachBacking();
+    void attachMapped(int lay, int cx, int cy, Tile *tiles);
+    //@}
+
+    /** \name Save state
+    *** \brief Chunks changed since the map was last read from or written to
+    ***        getSource() are flagged unsaved, so a save only has to write
+    ***        those. setSaved() clears every flag and records the file.
+    **/
+    //@{
+    const string &getSource() { return source; }
+    void setSource(const string &path) { source = path; }
+    void setSaved(const string &path);
+    bool isModified();
+    //@}
+
+    /** \name Sharing with a save in flight
+    *** \brief share() hands a chunk's current tiles to a MapSnapshot, an
+    ***        edit copies them first from then on. endShare() stops sharing
+    ***        every chunk and frees the tiles left behind. The map mustn't
+    ***        be destroyed or re-backed in between.
+    **/
+    //@{
+    void share(TileChunk *chunk) { if (!chunk->mapped) chunk->shared = true; }
+    void endShare();
+    void flushSwap() { pager.flush(); }
+    const string &getSwapPath() { return pager.getSwapPath(); }
+    //@}
+
+    /** \name compact()
+    *** \brief Frees the chunks made only of the fill tile of their layer
+    **/
+    void compact();
+
+    /** \name replace()
+    *** \brief Replaces every tile of a layer matching index and tileset with
+    ***        the new pair. Unpainted area is handled by changing the fill.
+    **/
+    void replace(int lay, int index, int tileset, int new_index, int new_tileset);
+
+    int getLayers() { return layers; }
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+    int getChunksX() { return (width + CHUNK_MASK) >> CHUNK_SHIFT; }
+    int getChunksY() { return (height + CHUNK_MASK) >> CHUNK_SHIFT; }
+
+    /** \name getMemoryUsage()
+    *** \brief Number of bytes taken by the resident chunks and the index
+    **/
+    size_t getMemoryUsage();
+private:
+    int findSlot(ChunkLayer &lay, int cx, int cy);
+    TileChunk *addChunk(int lay, int cx, int cy);
+    void rebuildSlots(ChunkLayer &lay, size_t size);
+
+    ChunkLayer *layer;
+    int layers, width, height;
+
+    ChunkPager pager;
+    MappedFile *backing;
+
+    /** Handed out for the chunks that couldn't be paged in, never stored **/
+    //@{
+    Tile lostRow[CHUNK_SIZE];
+    Tile lostTile;
+    //@}
+
+    string source;                      //!< The map file the saved chunks are in
+    bool modified;                      //!< A fill changed or chunks were dropped
+
+    /** The last chunk looked up, most accesses hit the same chunk again **/
+    //@{
+    int last_lay, last_cx, last_cy;
+    TileChunk *last_chunk;
+    //@}
+};
+
+#endif // TILEMAP_H
@@ -0,0 +1,444 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapconv.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Command line converter and validator for map files.
+***
+*** Works on many maps at once, spread over a WorkerPool, one file per job:
+***
+***   mapconv <command> [--threads n] [--budget mb] [--out dir] files or dirs...
+***
+***   -# info: format, sizes, file size, painted chunks, emitters and the
+***      tiles drawn from each tileset
+***   -# validate: sane sizes, the chunk CRCs of v2 maps, tilesets in range
+***      and emitters in step with the tiles
+***   -# convert: writes old .dat maps and Tiled .tmx and .json maps in the
+***      v2 format, as .map next to them or in --out
+***   -# recompress: writes v2 maps anew in place, dropping the dead space
+***      appended saves leave behind and picking the codecs again
+***   -# export --to tmx|json|csv: writes .dat and .map maps for Tiled, csv
+***      as one name.layer<n>.csv per layer and a name.collision.csv
+***
+*** Directories are searched for .dat, .map, .tmx and .json files, those the
+*** command takes, not recursively. Each job pages
+*** its tiles out past --budget MB, so memory stays bounded by the number of
+*** threads rather than by the size of the maps. The exit code is 2 if any
+*** map failed.
+***
+*** \note This code uses the following libraries:
+***   -# Allegro 4.2.2, http://www.allegro.cc/
+******************************************************************************/
+
+#include <allegro.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "..\map\mapdocument.h"
+#include "..\map\mapfile.h"
+#include "..\map\legacyfile.h"
+#include "..\map\textmapfile.h"
+#include "..\utils\dataformat.h"
+#include "..\utils\workerpool.h"
+
+using namespace std;
+
+/** \def The commands
+**/
+//@{
+#define COMMAND_INFO       0
+#define COMMAND_VALIDATE   1
+#define COMMAND_CONVERT    2
+#define COMMAND_RECOMPRESS 3
+#define COMMAND_EXPORT     4
+#define COMMAND_COUNT      5
+//@}
+
+/** \def What a sane map looks like
+**/
+//@{
+#define MAPCONV_TILESETS   TILE_TILESETS
+#define MAPCONV_MAX_LAYERS 64
+#define MAPCONV_MAX_SIDE   65536
+//@}
+
+//! Tile memory of a job before its chunks are paged out, in MB
+#define MAPCONV_BUDGET     64
+
+static const char *command_names[COMMAND_COUNT] = { "info", "validate", "convert", "recompress", "export" };
+static const char *export_names[] = { "tmx", "json", "csv" };
+
+/** \struct MapJob mapconv.cpp "src\tools\mapconv.cpp"
+*** \brief One file of the batch and what came out of it
+**/
+typedef struct MapJob {
+    string path;
+    string target;      //!< Where convert and export write to
+    string report;      //!< The line printed for the file
+    bool ok;
+} MapJob;
+
+/** \struct MapBatch mapconv.cpp "src\tools\mapconv.cpp"
+*** \brief Shared by the jobs, which only write to their own MapJob
+**/
+typedef struct MapBatch {
+    int command;
+    int budget;
+    int export_format;  //!< TEXTMAP_TMX, TEXTMAP_JSON or TEXTMAP_CSV
+    string swap_dir;
+    vector<MapJob> jobs;
+} MapBatch;
+
+/** \struct MapStats mapconv.cpp "src\tools\mapconv.cpp"
+*** \brief What scanMap() finds in a map
+**/
+typedef struct MapStats {
+    double tilesets[MAPCONV_TILESETS];
+    double bad_tiles;           //!< Tiles from a tileset that doesn't exist
+    int emitter_tiles;          //!< Tiles with an emitter set
+    int chunks;
+} MapStats;
+
+/** \name stringf()
+*** \brief printf() into a string
+**/
+static string stringf(const char *format, ...) {
+    char text[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return text;
+} // static string stringf(const char *format, ...)
+
+/** \name getExtension()
+*** \brief The extension of a path, lower case and without the dot
+**/
+static string getExtension(const string &path) {
+    string ext = get_extension(path.c_str());
+    for (size_t i = 0; i < ext.size(); i++) ext[i] = tolower(ext[i]);
+    return ext;
+} // static string getExtension(const string &path)
+
+/** \name scanMap()
+*** \brief Reads every tile of a map once, a row at a time
+**/
+static void scanMap(TileMap &tiles, MapStats &stats) {
+    memset(&stats, 0, sizeof(stats));
+
+    for (int l = 0; l < tiles.getLayers(); l++) {
+        stats.chunks += tiles.getChunkCount(l);
+
+        for (int y = 0; y < tiles.getHeight(); y++) {
+            for (int x = 0; x < tiles.getWidth(); ) {
+                const Tile *span;
+                int count = tiles.getSpan(l, x, y, span);
+
+                for (int i = 0; i < count; i++) {
+                    int tileset = span[i].getTileset();
+                    if (tileset < MAPCONV_TILESETS) stats.tilesets[tileset]++;
+                    else stats.bad_tiles++;
+                    if (span[i].getEmitter() != 0) stats.emitter_tiles++;
+                }
+                x += count;
+            }
+        }
+    }
+} // static void scanMap(TileMap &tiles, MapStats &stats)
+
+/** \name runJob()
+*** \brief The WorkFunction of the batch, handles the index-th file
+**/
+static void runJob(void *context, int index) {
+    MapBatch *batch = (MapBatch*)context;
+    MapJob &job = batch->jobs[index];
+    job.ok = false;
+
+    // Which format is it, and are its sizes worth loading. Tiled maps only
+    // tell once they're read
+    string format;
+    int layers, width, height, damaged = 0;
+    int text_format = TextMapFile::getFormat(job.path);
+    {
+        MapFile mapFile;
+        LegacyMapFile legacyFile;
+
+        if (text_format == TEXTMAP_TMX || text_format == TEXTMAP_JSON) {
+            format = getExtension(job.path);
+            layers = width = height = 0;
+        } else if (mapFile.open(job.path)) {
+            format = "v2";
+            layers = mapFile.getLayers();
+            width = mapFile.getWidth();
+            height = mapFile.getHeight();
+            if (batch->command == COMMAND_VALIDATE) damaged = mapFile.verify();
+        } else if (legacyFile.open(job.path)) {
+            format = "dat";
+            layers = legacyFile.getLayers();
+            width = legacyFile.getWidth();
+            height = legacyFile.getHeight();
+        } else {
+            job.report = job.path + ": not a map";
+            return;
+        }
+    }
+
+    string sizes = stringf("%s %dx%dx%d", format.c_str(), layers, width, height);
+
+    if (layers > MAPCONV_MAX_LAYERS || width > MAPCONV_MAX_SIDE || height > MAPCONV_MAX_SIDE) {
+        job.report = job.path + ": " + sizes + ", sizes out of range";
+        return;
+    }
+
+    if (batch->command == COMMAND_CONVERT && format == "v2") {
+        job.report = job.path + ": v2 already";
+        job.ok = true;
+        return;
+    }
+    if (batch->command == COMMAND_RECOMPRESS && format != "v2") {
+        job.report = job.path + ": not a v2 map, convert it first";
+        return;
+    }
+    if (batch->command == COMMAND_EXPORT && format != "v2" && format != "dat") {
+        job.report = job.path + ": " + format + " already";
+        job.ok = true;
+        return;
+    }
+
+    // The job's tiles page out past the budget, the swap file goes with
+    // the document
+    MapDocument document;
+    document.getTiles().setPaging(batch->budget, batch->swap_dir + stringf("mapconv.%d.swp", index));
+
+    // The pool is busy with the files already, one thread per file
+    if (layers == 0) {
+        TextMapFile textFile;
+        if (!textFile.load(job.path, document, text_format)) {
+            job.report = job.path + ": " + format + ", " + textFile.getError();
+            return;
+        }
+        sizes = stringf("%s %dx%dx%d", format.c_str(), document.getLayers(), document.getWidth(), document.getHeight());
+    } else if (!document.load(job.path, 1)) {
+        // Damaged chunks and tiles out of range are read all the same, a
+        // validate goes on to list them with the rest
+        bool read = document.getLoadDamaged() > 0 || document.getLoadBadTiles() > 0;
+        if (batch->command != COMMAND_VALIDATE || !read) {
+            if (document.getLoadDamaged() > 0) {
+                job.report = job.path + ": " + sizes + stringf(", %d damaged chunks", document.getLoadDamaged());
+            } else if (document.getLoadBadTiles() > 0) {
+                job.report = job.path + ": " + sizes + stringf(", %d tiles out of range", document.getLoadBadTiles());
+            } else job.report = job.path + ": " + sizes + ", ends early";
+            return;
+        }
+    }
+
+    // The text formats only tell their sizes once read, and whatever was
+    // read is what gets walked
+    if (document.getLayers() > MAPCONV_MAX_LAYERS || document.getWidth() > MAPCONV_MAX_SIDE ||
+        document.getHeight() > MAPCONV_MAX_SIDE) {
+        job.report = job.path + ": " + sizes + ", sizes out of range";
+        return;
+    }
+
+    string kb_before = stringf("%.1f KB", file_size_ex(job.path.c_str()) / 1024.0);
+
+    if (batch->command == COMMAND_INFO || batch->command == COMMAND_VALIDATE) {
+        MapStats stats;
+        scanMap(document.getTiles(), stats);
+
+        if (batch->command == COMMAND_INFO) {
+            job.report = job.path + ": " + sizes + ", " + kb_before +
+                         stringf(", %d chunks, %d emitters, tilesets", stats.chunks, document.getEmitters().getCount());
+            for (int t = 0; t < MAPCONV_TILESETS; t++) {
+                if (stats.tilesets[t] > 0) job.report += stringf(" %d:%.0f", t, stats.tilesets[t]);
+            }
+            job.ok = true;
+            return;
+        }
+
+        string problems;
+        // The tiles were checked as the file holds them, a Tile would have
+        // masked them into range
+        if (damaged > 0) problems += stringf(", %d damaged chunks", damaged);
+        if (document.getLoadBadTiles() > 0) problems += stringf(", %d tiles out of range", document.getLoadBadTiles());
+        if (stats.bad_tiles > 0) problems += stringf(", %.0f tiles from missing tilesets", stats.bad_tiles);
+        if (stats.emitter_tiles != document.getEmitters().getCount()) problems += ", emitters out of step with the tiles";
+
+        job.ok = problems.empty();
+        job.report = job.path + ": " + sizes + (job.ok ? ", ok" : problems);
+        return;
+    }
+
+    if (batch->command == COMMAND_EXPORT) {
+        TextMapFile textFile;
+        string written = job.target;
+        bool saved = true;
+
+        if (batch->export_format == TEXTMAP_CSV) {
+            for (int l = TEXTMAP_COLLISION; saved && l < document.getLayers(); l++) {
+                string name = job.target + (l == TEXTMAP_COLLISION ? string(".collision.csv") : stringf(".layer%d.csv", l));
+                saved = textFile.saveCsv(name, document, l);
+            }
+            written += ".*.csv";
+        } else {
+            saved = textFile.save(job.target, document, batch->export_format);
+        }
+
+        job.ok = saved;
+        job.report = job.path + " -> " + written + ": " + sizes + (saved ? ", " + kb_before : ", " + textFile.getError());
+        return;
+    }
+
+    // A save to the file the map came from would only append the changes,
+    // forget it came from anywhere so the whole file is written anew
+    string target = (batch->command == COMMAND_CONVERT) ? job.target : job.path;
+    document.getTiles().setSource("");
+
+    if (!document.save(target, 1)) {
+        job.report = job.path + ": can't write " + target;
+        return;
+    }
+
+    job.report = job.path + (target != job.path ? " -> " + target : "") + ": " + kb_before +
+                 stringf(" -> %.1f KB", file_size_ex(target.c_str()) / 1024.0);
+    job.ok = true;
+} // static void runJob(void *context, int index)
+
+/** \name addPath()
+*** \brief Adds a file, or the map files of a directory, to the batch
+**/
+static void addPath(MapBatch &batch, string path, const string &out_dir) {
+    vector<string> files;
+    int attr;
+
+    if (file_exists(path.c_str(), FA_DIREC | FA_RDONLY | FA_ARCH, &attr) && (attr & FA_DIREC)) {
+        if (path[path.size() - 1] != '\\' && path[path.size() - 1] != '/') path += "\\";
+
+        struct al_ffblk info;
+        if (al_findfirst((path + "*.*").c_str(), &info, FA_RDONLY | FA_ARCH) == 0) {
+            do {
+                string ext = getExtension(info.name);
+                bool text = (ext == "tmx" || ext == "json");
+                bool wanted = (ext == "dat" && batch.command != COMMAND_RECOMPRESS) ||
+                              (ext == "map" && batch.command != COMMAND_CONVERT) ||
+                              (text && batch.command != COMMAND_RECOMPRESS && batch.command != COMMAND_EXPORT);
+                if (wanted) files.push_back(path + info.name);
+            } while (al_findnext(&info) == 0);
+            al_findclose(&info);
+        }
+        sort(files.begin(), files.end());
+    } else {
+        files.push_back(path);
+    }
+
+    for (size_t i = 0; i < files.size(); i++) {
+        MapJob job;
+        job.path = files[i];
+        job.ok = false;
+
+        // foo.dat becomes foo.map, or foo.tmx on export, in --out if given.
+        // The csv files add the layer to the name
+        string name = get_filename(job.path.c_str());
+        string base = out_dir.empty() ? job.path.substr(0, job.path.size() - name.size()) : out_dir;
+        if (!getExtension(name).empty()) name = name.substr(0, name.size() - getExtension(name).size() - 1);
+        job.target = base + name;
+        if (batch.command != COMMAND_EXPORT) job.target += ".map";
+        else if (batch.export_format != TEXTMAP_CSV) job.target += string(".") + export_names[batch.export_format];
+
+        batch.jobs.push_back(job);
+    }
+} // static void addPath(MapBatch &batch, string path, const string &out_dir)
+
+static void usage() {
+    fprintf(stderr, "usage: mapconv <info|validate|convert|recompress|export> [--threads n] [--budget mb]\n"
+                    "               [--out dir] [--to tmx|json|csv] files or dirs...\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    // The packfiles need Allegro, but nothing that touches the screen
+    if (install_allegro(SYSTEM_NONE, &errno, atexit) != 0) return 1;
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    MapBatch batch;
+    batch.command = -1;
+    batch.budget = MAPCONV_BUDGET;
+    batch.export_format = TEXTMAP_TMX;
+    for (int c = 0; c < COMMAND_COUNT; c++) {
+        if (argv[1] == string(command_names[c])) batch.command = c;
+    }
+
+    int threads = 0;
+    string out_dir;
+    vector<string> paths;
+    DataFormat convert;
+
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--threads" && has_value) {
+            if (!convert.isInt(argv[++i], threads) || threads < 0) batch.command = -1;
+        } else if (arg == "--budget" && has_value) {
+            if (!convert.isInt(argv[++i], batch.budget) || batch.budget < 0) batch.command = -1;
+        } else if (arg == "--out" && has_value) {
+            out_dir = argv[++i];
+        } else if (arg == "--to" && has_value) {
+            batch.export_format = TextMapFile::getFormat(string(".") + argv[++i]);
+            if (batch.export_format < 0) batch.command = -1;
+        } else if (arg.size() > 2 && arg.substr(0, 2) == "--") {
+            batch.command = -1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (batch.command < 0 || paths.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (!out_dir.empty() && out_dir[out_dir.size() - 1] != '\\' && out_dir[out_dir.size() - 1] != '/') out_dir += "\\";
+    batch.swap_dir = out_dir;
+
+    for (size_t i = 0; i < paths.size(); i++) addPath(batch, paths[i], out_dir);
+
+    WorkerPool pool(threads);
+    pool.run((int)batch.jobs.size(), runJob, &batch);
+
+    // In the order they were asked for, whichever finished first
+    int failed = 0;
+    for (size_t i = 0; i < batch.jobs.size(); i++) {
+        printf("%s\n", batch.jobs[i].report.c_str());
+        if (!batch.jobs[i].ok) failed++;
+    }
+    printf("%d maps, %d failed\n", (int)batch.jobs.size(), failed);
+
+    return failed > 0 ? 2 : 0;
+}
+END_OF_MAIN()
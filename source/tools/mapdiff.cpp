@@ -0,0 +1,197 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mapdiff.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Command line diff and patch tool for map files.
+***
+***   mapdiff <old map> <new map> [--out patch]
+***   mapdiff --apply <patch> <map> [--out map]
+***
+***   -# diff: prints what changed on every layer and in the collision, and
+***      writes the changes to a patch with --out. v2 maps are compared on
+***      their chunk tables, old .dat and Tiled maps are read whole
+***   -# apply: carries a patch over to a map of the same sizes and saves it
+***      in place, or to --out. A .dat output is written in the old layout
+***
+*** The exit code follows diff: 0 if the maps are the same or the patch went
+*** in, 1 if they differ and 2 on errors.
+***
+*** \note This code uses the following libraries:
+***   -# Allegro 4.2.2, http://www.allegro.cc/
+******************************************************************************/
+
+#include <allegro.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "..\map\mapdocument.h"
+#include "..\map\mappatch.h"
+#include "..\map\textmapfile.h"
+
+using namespace std;
+
+/** \name getExtension()
+*** \brief The extension of a path, lower case and without the dot
+**/
+static string getExtension(const string &path) {
+    string ext = get_extension(path.c_str());
+    for (size_t i = 0; i < ext.size(); i++) ext[i] = tolower(ext[i]);
+    return ext;
+} // static string getExtension(const string &path)
+
+/** \name loadMap()
+*** \brief Reads any map the tools know of, Tiled ones included
+**/
+static bool loadMap(const string &path, MapDocument &document) {
+    int format = TextMapFile::getFormat(path);
+    if (format == TEXTMAP_TMX || format == TEXTMAP_JSON) {
+        TextMapFile textFile;
+        if (textFile.load(path, document, format)) return true;
+        fprintf(stderr, "%s: %s\n", path.c_str(), textFile.getError().c_str());
+        return false;
+    }
+
+    if (document.load(path)) return true;
+    if (document.getLoadDamaged() > 0) {
+        fprintf(stderr, "%s: %d damaged chunks\n", path.c_str(), document.getLoadDamaged());
+    } else fprintf(stderr, "%s: not a map\n", path.c_str());
+    return false;
+} // static bool loadMap(const string &path, MapDocument &document)
+
+/** \name printPatch()
+*** \brief One line per layer that changed, and for the collision
+**/
+static void printPatch(MapPatch &patch) {
+    const vector<MapPatchRun> &runs = patch.getRuns();
+
+    for (int l = MAPPATCH_COLLISION; l < patch.getLayers(); l++) {
+        int count = 0, cells = 0;
+        int x1 = patch.getWidth(), y1 = patch.getHeight(), x2 = -1, y2 = -1;
+
+        for (size_t r = 0; r < runs.size(); r++) {
+            if (runs[r].lay != l) continue;
+            count++;
+            cells += runs[r].count;
+            if (runs[r].x < x1) x1 = runs[r].x;
+            if (runs[r].y < y1) y1 = runs[r].y;
+            if (runs[r].x + runs[r].count - 1 > x2) x2 = runs[r].x + runs[r].count - 1;
+            if (runs[r].y > y2) y2 = runs[r].y;
+        }
+        if (count == 0) continue;
+
+        if (l == MAPPATCH_COLLISION) printf("collision");
+        else printf("layer %d", l);
+        printf(": %d runs, %d cells, in %d,%d - %d,%d\n", count, cells, x1, y1, x2, y2);
+    }
+} // static void printPatch(MapPatch &patch)
+
+static void usage() {
+    fprintf(stderr, "usage: mapdiff <old map> <new map> [--out patch]\n"
+                    "       mapdiff --apply <patch> <map> [--out map]\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    // The packfiles need Allegro, but nothing that touches the screen
+    if (install_allegro(SYSTEM_NONE, &errno, atexit) != 0) return 2;
+
+    bool apply = false;
+    string out;
+    vector<string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--apply") {
+            apply = true;
+        } else if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (arg.size() > 2 && arg.substr(0, 2) == "--") {
+            paths.clear();
+            break;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.size() != 2) {
+        usage();
+        return 2;
+    }
+
+    MapPatch patch;
+
+    if (apply) {
+        MapDocument document;
+        if (!patch.load(paths[0])) {
+            fprintf(stderr, "%s\n", patch.getError().c_str());
+            return 2;
+        }
+        if (!loadMap(paths[1], document)) return 2;
+
+        if (!patch.apply(document)) {
+            fprintf(stderr, "%s: %s\n", paths[1].c_str(), patch.getError().c_str());
+            return 2;
+        }
+
+        // In place, a v2 map only gets the changed chunks appended
+        if (out.empty()) out = paths[1];
+        int format = TextMapFile::getFormat(out);
+        TextMapFile textFile;
+
+        bool saved;
+        if (format >= 0 && format != TEXTMAP_CSV) saved = textFile.save(out, document, format);
+        else if (getExtension(out) == "dat") saved = document.exportMap(out);
+        else saved = document.save(out);
+
+        if (!saved) {
+            fprintf(stderr, "can't write %s\n", out.c_str());
+            return 2;
+        }
+        printf("%s: %d runs applied\n", out.c_str(), (int)patch.getRuns().size());
+        return 0;
+    }
+
+    bool text = TextMapFile::getFormat(paths[0]) >= 0 || TextMapFile::getFormat(paths[1]) >= 0;
+    bool compared;
+    if (text) {
+        MapDocument from, to;
+        if (!loadMap(paths[0], from) || !loadMap(paths[1], to)) return 2;
+        compared = patch.compare(from, to);
+    } else {
+        compared = patch.compareFiles(paths[0], paths[1]);
+    }
+
+    if (!compared) {
+        fprintf(stderr, "%s\n", patch.getError().c_str());
+        return 2;
+    }
+
+    printPatch(patch);
+    if (!out.empty() && !patch.save(out)) {
+        fprintf(stderr, "%s\n", patch.getError().c_str());
+        return 2;
+    }
+
+    if (patch.isEmpty()) printf("the maps are the same\n");
+    return patch.isEmpty() ? 0 : 1;
+}
+END_OF_MAIN()
@@ -23,6 +23,8 @@
 
 #include "dataformat.h"
 
+#include <limits.h>
+
 DataFormat::DataFormat()
 {
     //ctor
@@ -34,15 +36,56 @@ DataFormat::~DataFormat()
 }
 
 bool DataFormat::isInt(const string s, int &i) {
-  istringstream convert(s);
+    const char *text = s.c_str();
+    return parseInt(text, text + s.size(), i);
+}
 
-  if (convert>>i)
-    return true;
-  else
-    return false;
+int DataFormat::stoi(string s) {
+    const char *text = s.c_str();
+    int i = 0;
+    parseInt(text, text + s.size(), i);
+    return i;
+}
+
+bool DataFormat::parseInt(const char *&text, const char *end, int &value) {
+    const char *p = text;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    if (p == end || *p < '0' || *p > '9') return false;
 
+    // Accumulated negative, so INT_MIN fits as well
+    int n = 0;
+    const int limit = INT_MIN / 10;
+    while (p < end && *p >= '0' && *p <= '9') {
+        int digit = *p++ - '0';
+        if (n < limit || (n == limit && digit > -(INT_MIN % 10))) return false;
+        n = n * 10 - digit;
+    }
+    if (!negative) {
+        if (n == INT_MIN) return false;
+        n = -n;
+    }
+
+    value = n;
+    text = p;
+    return true;
 }
 
-int DataFormat::stoi(string s) {
-    return (atoi(s.c_str()));
+bool DataFormat::parseUint(const char *&text, const char *end, uint32_t &value) {
+    const char *p = text;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    if (p == end || *p < '0' || *p > '9') return false;
+
+    uint32_t n = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        uint32_t digit = *p++ - '0';
+        if (n > (0xFFFFFFFFu - digit) / 10) return false;
+        n = n * 10 + digit;
+    }
+
+    value = n;
+    text = p;
+    return true;
 }
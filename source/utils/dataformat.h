@@ -31,6 +31,7 @@
 #ifndef DATAFORMAT_H
 #define DATAFORMAT_H
 
+#include <stdint.h>
 #include <string>
 #include <sstream>
 
@@ -63,6 +64,25 @@ public:
     **/
     int stoi(string s);
 
+    /** \name parseInt()
+    *** \brief Reads a decimal integer, skipping leading blanks, straight from
+    ***        a character buffer. Nothing is allocated, so it can be used on
+    ***        every number of a multi-gigabyte file.
+    *** \param text Where to start reading, moved past the number if there is one
+    *** \param end One past the last character that may be read
+    *** \param value Receives the number
+    *** \return false if there's no number at text or it doesn't fit an int
+    **/
+    bool parseInt(const char *&text, const char *end, int &value);
+
+    /** \name parseUint()
+    *** \brief parseInt() for unsigned 32-bit numbers, which take no sign.
+    ***        Tiled keeps its flip flags in the top bits of a tile, past
+    ***        what an int holds.
+    *** \return false if there's no number at text or it doesn't fit 32 bits
+    **/
+    bool parseUint(const char *&text, const char *end, uint32_t &value);
+
 protected:
 private:
 };
@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mappedfile.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the MappedFile class
+******************************************************************************/
+
+#include "mappedfile.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+    file_handle = map_handle = NULL;
+    fd = -1;
+    data = NULL;
+    size = 0;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string &path) {
+    close();
+
+#ifdef _WIN32
+    // Writers are let in, saving appends to the file a map is mapped from
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 ||
+        (unsigned long long)file_size.QuadPart > (size_t)-1) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle = file;
+    map_handle = mapping;
+    data = (const char*)view;
+    size = (size_t)file_size.QuadPart;
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat st;
+    if (fstat(file, &st) != 0 || st.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED) {
+        ::close(file);
+        return false;
+    }
+
+    fd = file;
+    data = (const char*)view;
+    size = (size_t)st.st_size;
+#endif
+
+    this->path = path;
+    return true;
+} // bool MappedFile::open(const string &path)
+
+void MappedFile::close() {
+    if (data == NULL) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile((void*)data);
+    CloseHandle((HANDLE)map_handle);
+    CloseHandle((HANDLE)file_handle);
+    file_handle = map_handle = NULL;
+#else
+    munmap((void*)data, size);
+    ::close(fd);
+    fd = -1;
+#endif
+
+    data = NULL;
+    size = 0;
+    path.clear();
+} // void MappedFile::close()
+
+bool replaceFile(const string &from, const string &to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+} // bool replaceFile(const string &from, const string &to)
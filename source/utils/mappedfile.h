@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    mappedfile.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the MappedFile class
+***
+*** This code maps a whole file read-only into memory, through
+*** CreateFileMapping() on Windows and mmap() everywhere else.
+******************************************************************************/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <string>
+
+using namespace std;
+
+/** \name replaceFile()
+*** \brief Moves from over to in one step, whoever opens to finds either
+***        the old file or the new one whole
+*** \return false if the file couldn't be moved
+**/
+bool replaceFile(const string &from, const string &to);
+
+/** \class MappedFile mappedfile.h "src\utils\mappedfile.h"
+*** \brief A read-only view of a file
+**/
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    /** \name open()
+    *** \brief Maps the passed file, closing any previous one
+    *** \return false if the file couldn't be opened or mapped
+    **/
+    bool open(const string &path);
+
+    /** \name close()
+    *** \brief Unmaps the file, every pointer into it becomes invalid
+    **/
+    void close();
+
+    const char *getData() { return data; }
+    size_t getSize() { return size; }
+    const string &getPath() { return path; }
+private:
+    /** Platform handles, kept opaque so the header doesn't pull in windows.h **/
+    //@{
+    void *file_handle, *map_handle;
+    int fd;
+    //@}
+
+    const char *data;
+    size_t size;
+    string path;
+};
+
+#endif // MAPPEDFILE_H
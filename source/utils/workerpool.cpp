@@ -0,0 +1,311 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    workerpool.cpp
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Source file for the WorkerPool class
+******************************************************************************/
+
+#include "workerpool.h"
+
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// What every thread of a run() batch shares
+typedef struct WorkBatch {
+    WorkFunction work;
+    void *context;
+    int count;
+#ifdef _WIN32
+    volatile LONG next;
+#else
+    volatile int next;
+#endif
+} WorkBatch;
+
+static void runBatch(WorkBatch *batch) {
+    for (;;) {
+#ifdef _WIN32
+        int index = (int)InterlockedIncrement(&batch->next) - 1;
+#else
+        int index = __sync_fetch_and_add(&batch->next, 1);
+#endif
+        if (index >= batch->count) break;
+        batch->work(batch->context, index);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI threadMain(LPVOID arg) {
+    runBatch((WorkBatch*)arg);
+    return 0;
+}
+#else
+static void *threadMain(void *arg) {
+    runBatch((WorkBatch*)arg);
+    return NULL;
+}
+#endif
+
+int getCpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+} // int getCpuCount()
+
+void sleepThread(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+} // void sleepThread(int ms)
+
+WorkerPool::WorkerPool(int threads) {
+    setThreads(threads);
+}
+
+WorkerPool::~WorkerPool() {
+}
+
+void WorkerPool::setThreads(int threads) {
+    this->threads = (threads > 0) ? threads : getCpuCount();
+} // void WorkerPool::setThreads(int threads)
+
+void WorkerPool::run(int count, WorkFunction work, void *context) {
+    if (count <= 0) return;
+
+    WorkBatch batch;
+    batch.work = work;
+    batch.context = context;
+    batch.count = count;
+    batch.next = 0;
+
+    int helpers = ((threads < count) ? threads : count) - 1;
+
+#ifdef _WIN32
+    vector<HANDLE> handles;
+    for (int i = 0; i < helpers; i++) {
+        HANDLE handle = CreateThread(NULL, 0, threadMain, &batch, 0, NULL);
+        if (handle != NULL) handles.push_back(handle);
+    }
+
+    runBatch(&batch);
+
+    for (size_t i = 0; i < handles.size(); i++) {
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+    }
+#else
+    vector<pthread_t> handles;
+    for (int i = 0; i < helpers; i++) {
+        pthread_t handle;
+        if (pthread_create(&handle, NULL, threadMain, &batch) == 0) handles.push_back(handle);
+    }
+
+    // A thread that couldn't be started just leaves more jobs to the others
+    runBatch(&batch);
+
+    for (size_t i = 0; i < handles.size(); i++) {
+        pthread_join(handles[i], NULL);
+    }
+#endif
+} // void WorkerPool::run(int count, WorkFunction work, void *context)
+
+// What a WorkerThread and its thread share
+struct ThreadState {
+    WorkFunction work;
+    void *context;
+#ifdef _WIN32
+    HANDLE handle;
+    volatile LONG done;
+#else
+    pthread_t handle;
+    volatile int done;
+#endif
+};
+
+#ifdef _WIN32
+static DWORD WINAPI jobMain(LPVOID arg) {
+    ThreadState *state = (ThreadState*)arg;
+    state->work(state->context, 0);
+    InterlockedExchange(&state->done, 1);
+    return 0;
+}
+#else
+static void *jobMain(void *arg) {
+    ThreadState *state = (ThreadState*)arg;
+    state->work(state->context, 0);
+    __sync_lock_test_and_set(&state->done, 1);
+    return NULL;
+}
+#endif
+
+WorkerThread::WorkerThread() {
+    state = NULL;
+}
+
+WorkerThread::~WorkerThread() {
+    wait();
+}
+
+bool WorkerThread::start(WorkFunction work, void *context) {
+    if (state != NULL) return false;
+
+    state = new ThreadState;
+    state->work = work;
+    state->context = context;
+    state->done = 0;
+
+#ifdef _WIN32
+    state->handle = CreateThread(NULL, 0, jobMain, state, 0, NULL);
+    bool started = state->handle != NULL;
+#else
+    bool started = pthread_create(&state->handle, NULL, jobMain, state) == 0;
+#endif
+
+    if (!started) {
+        delete state;
+        state = NULL;
+    }
+    return started;
+} // bool WorkerThread::start(WorkFunction work, void *context)
+
+bool WorkerThread::isDone() {
+    if (state == NULL) return true;
+#ifdef _WIN32
+    return InterlockedCompareExchange(&state->done, 0, 0) != 0;
+#else
+    return __sync_fetch_and_add(&state->done, 0) != 0;
+#endif
+} // bool WorkerThread::isDone()
+
+void WorkerThread::wait() {
+    if (state == NULL) return;
+
+#ifdef _WIN32
+    WaitForSingleObject(state->handle, INFINITE);
+    CloseHandle(state->handle);
+#else
+    pthread_join(state->handle, NULL);
+#endif
+
+    delete state;
+    state = NULL;
+} // void WorkerThread::wait()
+
+struct MutexState {
+#ifdef _WIN32
+    CRITICAL_SECTION section;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+Mutex::Mutex() {
+    state = new MutexState;
+#ifdef _WIN32
+    InitializeCriticalSection(&state->section);
+#else
+    pthread_mutex_init(&state->mutex, NULL);
+#endif
+}
+
+Mutex::~Mutex() {
+#ifdef _WIN32
+    DeleteCriticalSection(&state->section);
+#else
+    pthread_mutex_destroy(&state->mutex);
+#endif
+    delete state;
+}
+
+void Mutex::lock() {
+#ifdef _WIN32
+    EnterCriticalSection(&state->section);
+#else
+    pthread_mutex_lock(&state->mutex);
+#endif
+} // void Mutex::lock()
+
+void Mutex::unlock() {
+#ifdef _WIN32
+    LeaveCriticalSection(&state->section);
+#else
+    pthread_mutex_unlock(&state->mutex);
+#endif
+} // void Mutex::unlock()
+
+// An auto-reset event on Windows, it stays set until a wait() takes it, so a
+// wake() that comes first isn't lost. There's only ever one thread waiting
+struct SignalState {
+#ifdef _WIN32
+    HANDLE event;
+#else
+    pthread_cond_t cond;
+#endif
+};
+
+Signal::Signal() {
+    state = new SignalState;
+#ifdef _WIN32
+    state->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+    pthread_cond_init(&state->cond, NULL);
+#endif
+}
+
+Signal::~Signal() {
+#ifdef _WIN32
+    CloseHandle(state->event);
+#else
+    pthread_cond_destroy(&state->cond);
+#endif
+    delete state;
+}
+
+void Signal::wait(Mutex &lock) {
+#ifdef _WIN32
+    lock.unlock();
+    WaitForSingleObject(state->event, INFINITE);
+    lock.lock();
+#else
+    pthread_cond_wait(&state->cond, &lock.state->mutex);
+#endif
+} // void Signal::wait(Mutex &lock)
+
+void Signal::wake() {
+#ifdef _WIN32
+    SetEvent(state->event);
+#else
+    pthread_cond_signal(&state->cond);
+#endif
+} // void Signal::wake()
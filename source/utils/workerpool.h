@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+//            Copyright (C) 2009 by Hazardous Gaming
+//                         All Rights Reserved
+//
+// This code is licensed under the MIT License. It is free software
+// and you may modify it and/or redistribute it under the terms of this license.
+// See http://www.opensource.org/licenses/mit-license.php for details.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+/******************************************************************************
+*** \file    workerpool.h
+*** \author  Gilcescu-Ceia Claudiu, hazardous.dev@gmail.com
+*** \brief   Header file for the WorkerPool class
+***
+*** A minimal thread shim over Win32 threads and pthreads, enough to run the
+*** map file encoding and decoding on every core and the saves and loads in
+*** the background.
+******************************************************************************/
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <stddef.h>
+
+/** \name getCpuCount()
+*** \brief Returns the number of processors the OS reports, at least 1
+**/
+int getCpuCount();
+
+/** \name sleepThread()
+*** \brief Gives up the processor for about ms milliseconds
+**/
+void sleepThread(int ms);
+
+/** \name WorkFunction
+*** \brief A job of a WorkerPool::run() batch, index is the job number
+**/
+typedef void (*WorkFunction)(void *context, int index);
+
+/** \class WorkerPool workerpool.h "src\utils\workerpool.h"
+*** \brief Runs batches of independent jobs on a number of threads
+***
+*** Every run() starts the helper threads, lets all of them (the calling
+*** thread included) pull job numbers from a shared counter until none are
+*** left, and joins them again. Batches are expected to be large enough for
+*** the thread start-up to be lost in the noise.
+**/
+class WorkerPool {
+public:
+    /** \param threads Number of threads, 0 for one per processor **/
+    WorkerPool(int threads = 0);
+    ~WorkerPool();
+
+    /** \name run()
+    *** \brief Calls work(context, i) for every i in [0, count) and returns
+    ***        once all of them are done. The order isn't defined.
+    **/
+    void run(int count, WorkFunction work, void *context);
+
+    void setThreads(int threads);
+    int getThreads() { return threads; }
+private:
+    int threads;
+};
+
+struct ThreadState;
+
+/** \class WorkerThread workerpool.h "src\utils\workerpool.h"
+*** \brief Runs one job on a thread of its own, for work that outlives a
+***        frame. The owner polls isDone() and collects it with wait().
+**/
+class WorkerThread {
+public:
+    WorkerThread();
+    //! Waits for the job, if any
+    ~WorkerThread();
+
+    /** \name start()
+    *** \brief Calls work(context, 0) on a new thread
+    *** \return false if a job is still running or the thread couldn't start
+    **/
+    bool start(WorkFunction work, void *context);
+
+    //! Wheter a job was started and not waited for yet
+    bool isRunning() { return state != NULL; }
+    //! Wheter the job is over, never blocks
+    bool isDone();
+    //! Blocks until the job is over
+    void wait();
+private:
+    ThreadState *state;                 //!< Kept opaque so the header doesn't pull in windows.h
+};
+
+struct MutexState;
+
+/** \class Mutex workerpool.h "src\utils\workerpool.h"
+*** \brief A lock for the little state a WorkerThread shares with its owner
+**/
+class Mutex {
+public:
+    Mutex();
+    ~Mutex();
+
+    void lock();
+    void unlock();
+private:
+    friend class Signal;
+    MutexState *state;
+
+    //! Not copyable
+    Mutex(const Mutex &);
+    Mutex &operator=(const Mutex &);
+};
+
+struct SignalState;
+
+/** \class Signal workerpool.h "src\utils\workerpool.h"
+*** \brief Lets one thread sleep until another changes the state a Mutex
+***        guards, rather than polling it
+**/
+class Signal {
+public:
+    Signal();
+    ~Signal();
+
+    /** \name wait()
+    *** \brief Unlocks lock, sleeps until wake() and locks it again. It may
+    ***        return early, so the state is checked again in a loop
+    **/
+    void wait(Mutex &lock);
+
+    //! Wakes the thread in wait(), or the next one to call it
+    void wake();
+private:
+    SignalState *state;
+
+    //! Not copyable
+    Signal(const Signal &);
+    Signal &operator=(const Signal &);
+};
+
+#endif // WORKERPOOL_H